@@ -0,0 +1,92 @@
+#include "TextureAnalyzer.h"
+#include "HistogramKernels.h"
+#include "TestPatterns.h"
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Уровни для смещений: с квантованием строк, как в пирамиде при AnalysisOptions::levels < 256
+const int kOffsetLevels = 32;
+
+template <typename Fn>
+double bestTimeMs(Fn fn, int repeats) {
+    double best = 1e30;
+    for (int r = 0; r < repeats; r++) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    int size = (argc > 1) ? std::stoi(argv[1]) : 2048;
+    int repeats = (argc > 2) ? std::stoi(argv[2]) : 5;
+    
+    std::vector<std::pair<std::string, cv::Mat>> inputs = {
+        {"uniform", TestPatterns::uniform(size)},
+        {"noise", TestPatterns::noise(size)},
+        {"chessboard", TestPatterns::chessboard(size)}
+    };
+    
+    KernelIsa detected = HistogramKernels::detectIsa();
+    std::vector<KernelIsa> isas = {KernelIsa::Scalar};
+    if (detected == KernelIsa::SSE2 || detected == KernelIsa::AVX2) {
+        isas.push_back(KernelIsa::SSE2);
+    }
+    if (detected == KernelIsa::AVX2) {
+        isas.push_back(KernelIsa::AVX2);
+    }
+    
+    std::cout << "Histogram kernel benchmark: " << size << "x" << size 
+              << ", best of " << repeats << ", detected ISA: " 
+              << HistogramKernels::isaName(detected) << std::endl;
+    std::cout << std::left << std::setw(12) << "input" << std::setw(16) << "kernel" 
+              << std::setw(8) << "ISA" << std::right << std::setw(12) << "ms" 
+              << std::setw(12) << "MPix/s" << std::endl;
+    
+    const double megapixels = static_cast<double>(size) * size / 1e6;
+    
+    for (const auto& input : inputs) {
+        for (KernelIsa isa : isas) {
+            HistogramKernels::setIsa(isa);
+            TextureAnalyzer analyzer;
+            
+            double diffMs = bestTimeMs([&]() { analyzer.buildDifferenceHistogram(input.second, 1, 0); }, repeats);
+            double glcmMs = bestTimeMs([&]() { analyzer.buildGLCM(input.second, 1, 0); }, repeats);
+            // Проход по признакам на уже построенной GLCM (последний вызов buildGLCM)
+            double featuresMs = bestTimeMs([&]() { analyzer.computeFeatures(FeatureAll); }, repeats);
+            double sweepMs = bestTimeMs([&]() { analyzer.analyzeMultiDirectional(input.second); }, repeats);
+            
+            std::vector<std::pair<std::string, double>> rows = {
+                {"difference", diffMs}, {"glcm", glcmMs}, {"haralick", featuresMs}, 
+                {"4-dir sweep", sweepMs}
+            };
+            
+            // Смещения пирамиды текстуры: время должно расти с D не быстрее линейного
+            for (int distances : {1, 2, 4, 8}) {
+                std::vector<int> histograms(4 * distances * kOffsetLevels);
+                double offsetsMs = bestTimeMs([&]() {
+                    HistogramKernels::accumulateOffsets(input.second, 0, input.second.rows, distances,
+                                                        kOffsetLevels, histograms.data(), isa);
+                }, repeats);
+                rows.push_back({"offsets D=" + std::to_string(distances), offsetsMs});
+            }
+            for (const auto& row : rows) {
+                std::cout << std::left << std::setw(12) << input.first << std::setw(16) << row.first 
+                          << std::setw(8) << HistogramKernels::isaName(isa) << std::right 
+                          << std::fixed << std::setprecision(3) << std::setw(12) << row.second 
+                          << std::setprecision(1) << std::setw(12) << megapixels / (row.second / 1000.0) 
+                          << std::endl;
+            }
+        }
+    }
+    
+    HistogramKernels::setIsa(detected);
+    return 0;
+}
@@ -0,0 +1,387 @@
+#include "ImageLoader.h"
+#include "AnalysisWorkspace.h"
+#include "TextureAnalyzer.h"
+#include "MorphologyAnalyzer.h"
+#include "HistogramKernels.h"
+#include "TestPatterns.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+
+// Счётчики выделений памяти: все operator new программы и буферы cv::Mat
+// (OpenCV выделяет их через MatAllocator, минуя operator new)
+namespace {
+
+std::atomic<size_t> g_allocations(0);
+std::atomic<size_t> g_allocatedBytes(0);
+
+void countAllocation(size_t bytes) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    g_allocatedBytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+}
+
+void* operator new(size_t size) {
+    countAllocation(size);
+    if (void* pointer = std::malloc(size ? size : 1)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    countAllocation(size);
+    size_t align = static_cast<size_t>(alignment);
+    if (void* pointer = std::aligned_alloc(align, (size + align - 1) / align * align)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+namespace {
+
+// Считает новые буферы матриц и передаёт работу стандартному аллокатору;
+// освобождение идёт напрямую через него, так как он записан в UMatData
+class CountingMatAllocator : public cv::MatAllocator {
+public:
+    explicit CountingMatAllocator(cv::MatAllocator* base) : base_(base) {}
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override {
+        if (!data) {
+            size_t bytes = CV_ELEM_SIZE(type);
+            for (int i = 0; i < dims; i++) {
+                bytes *= static_cast<size_t>(sizes[i]);
+            }
+            countAllocation(bytes);
+        }
+        return base_->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    }
+
+    bool allocate(cv::UMatData* data, cv::AccessFlag accessFlags,
+                  cv::UMatUsageFlags usageFlags) const override {
+        return base_->allocate(data, accessFlags, usageFlags);
+    }
+
+    void deallocate(cv::UMatData* data) const override {
+        base_->deallocate(data);
+    }
+
+private:
+    cv::MatAllocator* base_;
+};
+
+struct Measurement {
+    std::string pattern;
+    int size;
+    std::string stage;
+    double ms;
+    double mpixPerSecond;
+    double allocations;
+    double bytes;
+};
+
+std::string key(const std::string& pattern, int size, const std::string& stage) {
+    return pattern + "/" + std::to_string(size) + "/" + stage;
+}
+
+// Лучшее время из repeats запусков; выделения усредняются по запускам
+template <typename Fn>
+Measurement measure(const std::string& pattern, int size, const std::string& stage,
+                    int repeats, Fn fn) {
+    double best = 1e30;
+    size_t allocationsBefore = g_allocations.load();
+    size_t bytesBefore = g_allocatedBytes.load();
+
+    for (int r = 0; r < repeats; r++) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+
+    Measurement m;
+    m.pattern = pattern;
+    m.size = size;
+    m.stage = stage;
+    m.ms = best;
+    m.mpixPerSecond = static_cast<double>(size) * size / 1e6 / (std::max(best, 1e-6) / 1000.0);
+    m.allocations = static_cast<double>(g_allocations.load() - allocationsBefore) / repeats;
+    m.bytes = static_cast<double>(g_allocatedBytes.load() - bytesBefore) / repeats;
+    return m;
+}
+
+// Анализ одного изображения так же, как в основной программе с --objects: буферы из рабочего
+// пространства и objects переживают повторы, поэтому выделения показывают установившийся режим
+void analyzeEndToEnd(const cv::Mat& gray, AnalysisWorkspace& workspace, std::vector<DiameterResult>& objects) {
+    cv::Mat resized = ImageLoader::resizeImage(gray, 512, workspace.resized);
+
+    cv::Mat frame;
+    TextureAnalyzer::sweepFrame(resized, 256, workspace, frame);
+
+    int threshold = MorphologyAnalyzer::otsuThreshold(workspace.intensity);
+    cv::Mat binary = MorphologyAnalyzer::binarizeImage(frame, threshold, workspace.binary);
+    MorphologyAnalyzer::findContours(binary, workspace.contours);
+    int largest = MorphologyAnalyzer::findLargestContour(workspace.contours);
+    if (largest >= 0) {
+        MorphologyAnalyzer::calculateMaxDiameter(workspace.contours[largest]);
+    }
+    MorphologyAnalyzer::analyzeObjects(binary, workspace, objects);
+}
+
+std::vector<Measurement> benchmarkPattern(const std::string& pattern, int size, int repeats) {
+    std::vector<Measurement> results;
+    cv::Mat image = TestPatterns::make(pattern, size);
+
+    TextureAnalyzer analyzer;
+    results.push_back(measure(pattern, size, "glcm", repeats, [&]() {
+        analyzer.buildGLCM(image, 1, 0);
+    }));
+    results.push_back(measure(pattern, size, "idm", repeats, [&]() {
+        analyzer.calculateIDM();
+    }));
+    results.push_back(measure(pattern, size, "multidirectional", repeats, [&]() {
+        analyzer.analyzeMultiDirectional(image);
+    }));
+
+    cv::Mat binary;
+    results.push_back(measure(pattern, size, "otsu", repeats, [&]() {
+        binary = MorphologyAnalyzer::binarizeImageOtsu(image);
+    }));
+
+    std::vector<std::vector<cv::Point>> contours;
+    results.push_back(measure(pattern, size, "contours", repeats, [&]() {
+        contours = MorphologyAnalyzer::findContours(binary);
+    }));
+
+    int largest = MorphologyAnalyzer::findLargestContour(contours);
+    if (largest >= 0) {
+        results.push_back(measure(pattern, size, "diameter", repeats, [&]() {
+            MorphologyAnalyzer::calculateMaxDiameter(contours[largest]);
+        }));
+        results.push_back(measure(pattern, size, "diameter_approx", repeats, [&]() {
+            MorphologyAnalyzer::calculateMaxDiameter(contours[largest], DiameterMode::Approximate);
+        }));
+    }
+
+    // Перевод BGR в серый, гистограммы разностей и яркости одним проходом
+    AnalysisWorkspace workspace;
+    cv::Mat color;
+    cv::Mat frame;
+    cv::cvtColor(image, color, cv::COLOR_GRAY2BGR);
+    TextureAnalyzer::sweepFrame(color, 256, workspace, frame);
+    results.push_back(measure(pattern, size, "front_end_bgr", repeats, [&]() {
+        TextureAnalyzer::sweepFrame(color, 256, workspace, frame);
+    }));
+
+    // Расстояния 1..4 по 4 направлениям на 3 уровнях пирамиды
+    TextureAnalyzer::analyzePyramid(image, 256, 4, 3, workspace);
+    results.push_back(measure(pattern, size, "texture_pyramid", repeats, [&]() {
+        TextureAnalyzer::analyzePyramid(image, 256, 4, 3, workspace);
+    }));
+
+    std::vector<DiameterResult> objects;
+    analyzeEndToEnd(image, workspace, objects);
+    results.push_back(measure(pattern, size, "end_to_end", repeats, [&]() {
+        analyzeEndToEnd(image, workspace, objects);
+    }));
+
+    return results;
+}
+
+bool saveBaseline(const std::string& path, const std::vector<Measurement>& results) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Error creating baseline file: " << path << std::endl;
+        return false;
+    }
+
+    file << "{\n  \"isa\": \"" << HistogramKernels::isaName(HistogramKernels::activeIsa())
+         << "\",\n  \"records\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Measurement& m = results[i];
+        file << "    {\"pattern\": \"" << m.pattern << "\", \"size\": " << m.size
+             << ", \"stage\": \"" << m.stage << "\", \"ms\": " << std::setprecision(9) << m.ms
+             << ", \"mpix_s\": " << m.mpixPerSecond << ", \"allocations\": " << m.allocations
+             << ", \"bytes\": " << m.bytes << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    file << "  ]\n}\n";
+    return static_cast<bool>(file);
+}
+
+std::string jsonField(const std::string& line, const std::string& name) {
+    std::string pattern = "\"" + name + "\":";
+    size_t position = line.find(pattern);
+    if (position == std::string::npos) {
+        return std::string();
+    }
+    position = line.find_first_not_of(" \"", position + pattern.size());
+    size_t end = line.find_first_of(",\"}", position);
+    return line.substr(position, end - position);
+}
+
+// Базовая линия пишется этой же программой, по одной записи на строку
+bool loadBaseline(const std::string& path, std::map<std::string, Measurement>& baseline) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Error: Cannot open baseline " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.find("\"stage\"") == std::string::npos) {
+            continue;
+        }
+        Measurement m;
+        m.pattern = jsonField(line, "pattern");
+        m.size = std::atoi(jsonField(line, "size").c_str());
+        m.stage = jsonField(line, "stage");
+        m.ms = std::atof(jsonField(line, "ms").c_str());
+        m.mpixPerSecond = std::atof(jsonField(line, "mpix_s").c_str());
+        m.allocations = std::atof(jsonField(line, "allocations").c_str());
+        m.bytes = std::atof(jsonField(line, "bytes").c_str());
+        baseline[key(m.pattern, m.size, m.stage)] = m;
+    }
+    return true;
+}
+
+std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<int> sizes = {256, 1024, 4096, 16384};
+    std::vector<std::string> patterns = TestPatterns::names();
+    int repeats = 5;
+    std::string savePath;
+    std::string comparePath;
+    double tolerance = 0.10;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--sizes" && i + 1 < argc) {
+            sizes.clear();
+            for (const std::string& size : splitList(argv[++i])) {
+                sizes.push_back(std::atoi(size.c_str()));
+            }
+        } else if (arg == "--patterns" && i + 1 < argc) {
+            patterns = splitList(argv[++i]);
+        } else if (arg == "--repeats" && i + 1 < argc) {
+            repeats = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--save-baseline" && i + 1 < argc) {
+            savePath = argv[++i];
+        } else if (arg == "--compare" && i + 1 < argc) {
+            comparePath = argv[++i];
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            tolerance = std::atof(argv[++i]);
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--sizes 256,1024,...] [--patterns noise,circle,...]"
+                      << " [--repeats N] [--save-baseline file.json] [--compare file.json]"
+                      << " [--tolerance 0.10]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::map<std::string, Measurement> baseline;
+    if (!comparePath.empty() && !loadBaseline(comparePath, baseline)) {
+        return 1;
+    }
+
+    CountingMatAllocator matAllocator(cv::Mat::getStdAllocator());
+    cv::Mat::setDefaultAllocator(&matAllocator);
+
+    std::cout << "Image analysis benchmark: best of " << repeats << ", ISA "
+              << HistogramKernels::isaName(HistogramKernels::activeIsa())
+              << ", OpenCV threads " << cv::getNumThreads() << std::endl;
+    std::cout << std::left << std::setw(12) << "pattern" << std::right << std::setw(7) << "size"
+              << "  " << std::left << std::setw(18) << "stage" << std::right << std::setw(12) << "ms"
+              << std::setw(12) << "MPix/s" << std::setw(10) << "allocs" << std::setw(12) << "KB";
+    if (!baseline.empty()) {
+        std::cout << std::setw(10) << "vs base";
+    }
+    std::cout << std::endl;
+
+    std::vector<Measurement> results;
+    int regressions = 0;
+
+    for (int size : sizes) {
+        // Самые большие изображения слишком дороги для многократного прогона
+        int runs = (static_cast<size_t>(size) * size >= 64u * 1024 * 1024) ? 1 : repeats;
+
+        for (const std::string& pattern : patterns) {
+            if (TestPatterns::make(pattern, 1).empty()) {
+                std::cerr << "Unknown pattern: " << pattern << std::endl;
+                return 1;
+            }
+
+            for (const Measurement& m : benchmarkPattern(pattern, size, runs)) {
+                std::cout << std::left << std::setw(12) << m.pattern << std::right << std::setw(7)
+                          << m.size << "  " << std::left << std::setw(18) << m.stage << std::right
+                          << std::fixed << std::setprecision(3) << std::setw(12) << m.ms
+                          << std::setprecision(1) << std::setw(12) << m.mpixPerSecond
+                          << std::setw(10) << m.allocations << std::setw(12) << m.bytes / 1024.0;
+
+                auto base = baseline.find(key(m.pattern, m.size, m.stage));
+                if (base != baseline.end() && base->second.mpixPerSecond > 0) {
+                    double change = m.mpixPerSecond / base->second.mpixPerSecond - 1.0;
+                    std::cout << std::showpos << std::setw(9) << 100.0 * change << "%" << std::noshowpos;
+                    if (change < -tolerance) {
+                        std::cout << "  REGRESSION";
+                        regressions++;
+                    }
+                }
+                std::cout << std::endl;
+
+                results.push_back(m);
+            }
+        }
+    }
+
+    cv::Mat::setDefaultAllocator(nullptr);
+
+    if (!savePath.empty() && saveBaseline(savePath, results)) {
+        std::cout << "Baseline saved to: " << savePath << std::endl;
+    }
+
+    if (!baseline.empty()) {
+        std::cout << regressions << " regression(s) beyond " << std::setprecision(0)
+                  << 100.0 * tolerance << "% against " << comparePath << std::endl;
+    }
+
+    return regressions > 0 ? 2 : 0;
+}
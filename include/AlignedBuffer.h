@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+
+template <typename T, size_t Alignment = 64>
+class AlignedBuffer {
+private:
+    T* data_;
+    size_t size_;
+    size_t capacity_;
+    
+    void deallocate() {
+        if (data_) {
+            ::operator delete(data_, std::align_val_t(Alignment));
+        }
+    }
+    
+public:
+    AlignedBuffer() : data_(nullptr), size_(0), capacity_(0) {}
+    explicit AlignedBuffer(size_t size) : AlignedBuffer() { resize(size); }
+    ~AlignedBuffer() { deallocate(); }
+    
+    AlignedBuffer(const AlignedBuffer& other) : AlignedBuffer() {
+        resize(other.size_);
+        if (size_ > 0) {
+            std::memcpy(data_, other.data_, size_ * sizeof(T));
+        }
+    }
+    
+    AlignedBuffer& operator=(const AlignedBuffer& other) {
+        if (this != &other) {
+            resize(other.size_);
+            if (size_ > 0) {
+                std::memcpy(data_, other.data_, size_ * sizeof(T));
+            }
+        }
+        return *this;
+    }
+    
+    // Перенос забирает блок без копирования; исходный буфер остаётся пустым
+    AlignedBuffer(AlignedBuffer&& other) noexcept
+        : data_(other.data_), size_(other.size_), capacity_(other.capacity_) {
+        other.data_ = nullptr;
+        other.size_ = 0;
+        other.capacity_ = 0;
+    }
+    
+    AlignedBuffer& operator=(AlignedBuffer&& other) noexcept {
+        if (this != &other) {
+            deallocate();
+            data_ = other.data_;
+            size_ = other.size_;
+            capacity_ = other.capacity_;
+            other.data_ = nullptr;
+            other.size_ = 0;
+            other.capacity_ = 0;
+        }
+        return *this;
+    }
+    
+    // Память выделяется заново только при росте; содержимое после resize не определено.
+    // Новый блок выделяется до освобождения старого: если new бросит, буфер остаётся прежним
+    void resize(size_t size) {
+        if (size > capacity_) {
+            if (size > static_cast<size_t>(-1) / sizeof(T)) {
+                throw std::bad_array_new_length();
+            }
+            T* block = static_cast<T*>(::operator new(size * sizeof(T), std::align_val_t(Alignment)));
+            deallocate();
+            data_ = block;
+            capacity_ = size;
+        }
+        size_ = size;
+    }
+    
+    void zero() {
+        if (size_ > 0) {
+            std::memset(data_, 0, size_ * sizeof(T));
+        }
+    }
+    
+    T* data() { return data_; }
+    const T* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    T& operator[](size_t i) { return data_[i]; }
+    const T& operator[](size_t i) const { return data_[i]; }
+};
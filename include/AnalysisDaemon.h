@@ -0,0 +1,176 @@
+#pragma once
+
+#include "ImageAnalysisCore.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+struct DaemonOptions {
+    std::string socketPath;
+    // Потоки анализа; 0 - по числу ядер
+    int workers = 0;
+    // Запросы сверх этого числа отклоняются ответом busy
+    size_t queueCapacity = 256;
+    // Пока есть свободные потоки, запрос уходит в пул сразу. Когда заняты все, запросы
+    // копятся в очереди и уходят пакетом по мере освобождения потоков, не больше maxBatch
+    // за раз; 0 - вдвое больше числа потоков
+    size_t maxBatch = 16;
+    AnalysisOptions analysis;
+};
+
+struct DaemonStats {
+    uint64_t served = 0;
+    uint64_t failed = 0;
+    uint64_t rejected = 0;
+    uint64_t batches = 0;
+    // Принятые запросы без ответа: в очереди и в работе
+    size_t queueDepth = 0;
+    size_t queueCapacity = 0;
+    // Задержка от приёма запроса до отправки ответа, по последним замерам
+    double p50Us = 0.0;
+    double p95Us = 0.0;
+    double p99Us = 0.0;
+    double maxUs = 0.0;
+};
+
+// Долгоживущий сервер анализа на UNIX-сокете: пул потоков и OpenCV прогреваются
+// один раз, дальше запросы разных клиентов собираются в пакеты, когда пул занят.
+// Ответы пишутся в сокет без блокировки; что не ушло сразу, досылает поток ввода-вывода.
+//
+// Запросы - текстовые строки:
+//   ANALYZE <путь>
+//   FRAME <имя shm> <ширина> <высота> <stride> <каналы>   (кадр в POSIX shared memory;
+//                                                            клиент не меняет его до ответа)
+//   FORMAT json|binary                                     (формат ответов соединения)
+//   STATS                                                  (счётчики и задержки демона)
+// Ответы приходят по мере готовности, не обязательно по порядку; поле request -
+// номер запроса в соединении, начиная с 0 (строки FORMAT не нумеруются). JSON-ответ - одна строка:
+//   {"request":N,"status":"ok|error|busy","latency_us":...,"result":{...}}
+// Двоичный ответ на анализ - BinaryReply, затем objectCount записей BinaryObject;
+// на STATS - BinaryStats. Записи различаются по первым четырём байтам (magic).
+class AnalysisDaemon {
+public:
+    static constexpr uint32_t kReplyMagic = 0x31444149;   // "IAD1"
+    static constexpr uint32_t kStatsMagic = 0x31534149;   // "IAS1"
+
+    enum ReplyStatus : uint32_t {
+        StatusOk = 0,
+        StatusError = 1,
+        StatusBusy = 2
+    };
+
+#pragma pack(push, 1)
+    struct BinaryReply {
+        uint32_t magic;
+        uint32_t status;
+        uint64_t request;
+        uint64_t latencyNs;
+        double idm;
+        double maxDiameter;
+        double area;
+        double perimeter;
+        double circularity;
+        float point1X;
+        float point1Y;
+        float point2X;
+        float point2Y;
+        int32_t contourPoints;
+        uint32_t objectCount;
+    };
+
+    struct BinaryObject {
+        int32_t label;
+        int32_t contourPoints;
+        double maxDiameter;
+        double area;
+        double perimeter;
+        double circularity;
+    };
+
+    struct BinaryStats {
+        uint32_t magic;
+        uint32_t status;
+        uint64_t request;
+        uint64_t served;
+        uint64_t failed;
+        uint64_t rejected;
+        uint64_t batches;
+        uint64_t queueDepth;
+        uint64_t queueCapacity;
+        double p50Us;
+        double p95Us;
+        double p99Us;
+        double maxUs;
+    };
+#pragma pack(pop)
+
+    explicit AnalysisDaemon(const DaemonOptions& options);
+    ~AnalysisDaemon();
+
+    AnalysisDaemon(const AnalysisDaemon&) = delete;
+    AnalysisDaemon& operator=(const AnalysisDaemon&) = delete;
+
+    // Блокирует до stop(); false, если сокет не открыт
+    bool run();
+    // Можно вызывать из обработчика сигнала: только атомарная запись и write() в канал
+    void stop();
+
+    DaemonStats stats() const;
+    static void printStats(const DaemonStats& stats, std::ostream& out = std::cout);
+
+private:
+    struct Connection;
+
+    struct Request {
+        std::shared_ptr<Connection> connection;
+        uint64_t id = 0;
+        int64_t receivedNs = 0;
+        // Пустое имя кадра - анализ файла path
+        std::string path;
+        std::string frameName;
+        int width = 0;
+        int height = 0;
+        size_t stride = 0;
+        int channels = 0;
+    };
+
+    DaemonOptions options_;
+    std::unique_ptr<ThreadPool> pool_;
+    std::atomic<bool> stopping_;
+    int wakePipe_[2];
+
+    mutable std::mutex queueMutex_;
+    std::condition_variable queueReady_;
+    std::deque<Request> queue_;
+    // Запросы, переданные пулу и ещё без ответа; вместе с queue_ ограничены queueCapacity
+    size_t inFlight_;
+
+    std::atomic<uint64_t> served_;
+    std::atomic<uint64_t> failed_;
+    std::atomic<uint64_t> rejected_;
+    std::atomic<uint64_t> batches_;
+
+    // Кольцо последних задержек в наносекундах
+    mutable std::mutex latencyMutex_;
+    std::vector<int64_t> latencies_;
+    size_t latencyNext_;
+
+    void warmUp();
+    void wake();
+    void dispatchLoop();
+    void handleLine(const std::shared_ptr<Connection>& connection, const std::string& line);
+    void process(Request& request);
+    void reply(Request& request, uint32_t status, const AnalysisResults* results,
+               const std::string& message);
+    void replyStats(Request& request);
+    void writeReply(Connection& connection, const std::string& buffer);
+    void recordLatency(int64_t nanoseconds);
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "AnalysisResults.h"
+#include <opencv2/opencv.hpp>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct PipelineOptions {
+    int readers = 2;
+    int analyzers = 0;
+    size_t queueCapacity = 16;
+    size_t memoryBudgetBytes = 1024ull * 1024 * 1024;
+    // Период строки прогресса в stdout; 0 - без отчётов (по умолчанию для встраивания)
+    int reportIntervalMs = 0;
+};
+
+struct StageQueueStats {
+    size_t capacity = 0;
+    size_t maxDepth = 0;
+    double averageDepth = 0.0;
+};
+
+struct PipelineStats {
+    // Готовые результаты из стадии поиска, минуя декодирование и анализ
+    size_t cached = 0;
+    size_t decoded = 0;
+    size_t analysed = 0;
+    size_t written = 0;
+    size_t failed = 0;
+    size_t peakInFlightBytes = 0;
+    double seconds = 0.0;
+    StageQueueStats decodeQueue;
+    StageQueueStats outputQueue;
+};
+
+// Три стадии: чтение/декодирование -> анализ -> вывод, связанные ограниченными очередями.
+// Чтение новых файлов приостанавливается, пока декодированные изображения превышают бюджет памяти.
+// Перед декодированием читатель резервирует размер кадра из заголовка, после - заменяет его фактическим.
+class AnalysisPipeline {
+public:
+    typedef std::function<cv::Mat(const std::string&)> DecodeStage;
+    typedef std::function<AnalysisResults(const std::string&, const cv::Mat&)> AnalyzeStage;
+    typedef std::function<void(const AnalysisResults&)> OutputStage;
+    // Вызывается читателем до декодирования; true - результат готов и сразу идёт в вывод
+    typedef std::function<bool(const std::string&, AnalysisResults&)> LookupStage;
+    
+    AnalysisPipeline(const PipelineOptions& options, DecodeStage decode, 
+                     AnalyzeStage analyze, OutputStage output, LookupStage lookup = LookupStage());
+    
+    PipelineStats run(const std::vector<std::string>& paths);
+    static void printStats(const PipelineStats& stats);
+    
+private:
+    PipelineOptions options_;
+    DecodeStage decode_;
+    AnalyzeStage analyze_;
+    OutputStage output_;
+    LookupStage lookup_;
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "MorphologyAnalyzer.h"
+#include "TextureAnalyzer.h"
+#include <string>
+#include <vector>
+
+// Координаты, площади и диаметры - в пикселях кадра анализа (AnalysisOptions::analysisSize)
+struct AnalysisResults {
+    double idm_value;
+    DiameterResult diameter_result;
+    // Все объекты с метками (--objects); пусто, если режим выключен
+    std::vector<DiameterResult> objects;
+    // IDM по расстояниям и масштабам (--texture-distances, --texture-scales); пусто, если режим выключен
+    TexturePyramid texture_pyramid;
+    std::string image_path;
+    std::string texture_interpretation;
+    std::string size_interpretation;
+};
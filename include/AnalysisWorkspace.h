@@ -0,0 +1,75 @@
+#pragma once
+
+#include "AlignedBuffer.h"
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <vector>
+
+// Ненулевая ячейка GLCM: уровни i (текущий пиксель) и j (сосед)
+struct GLCMCell {
+    uint16_t i;
+    uint16_t j;
+    int count;
+};
+
+// Буферы для анализа одного изображения. Все они растут только тогда, когда приходит
+// изображение крупнее прежнего, поэтому при одном рабочем пространстве на поток
+// анализ в установившемся режиме не выделяет память.
+// Текстура и морфология используют разные поля и могут идти параллельно
+// над одним рабочим пространством; два изображения одновременно - нет.
+struct AnalysisWorkspace {
+    // Загрузка
+    cv::Mat resizedColor;
+    cv::Mat gray;
+    cv::Mat resized;
+
+    // Текстура: гистограммы разностей по 4 направлениям, 4 * levels на полосу строк
+    // (в TextureAnalyzer::sweepFrame ещё 256 бинов яркости)
+    AlignedBuffer<int> directionHistograms;
+    // Гистограмма яркости кадра для порога Оцу
+    std::vector<int64_t> intensity;
+    // Признаки Харалика одного смещения (TextureAnalyzer::computeFeatures): гистограмма
+    // разностей, плотная GLCM, её ненулевые ячейки и маргинальные суммы строк/столбцов
+    std::vector<int> differenceHistogram;
+    AlignedBuffer<int> glcm;
+    std::vector<GLCMCell> glcmCells;
+    std::vector<int64_t> rowMarginal;
+    std::vector<int64_t> colMarginal;
+    // Пирамида TextureAnalyzer::analyzePyramid: уровни начиная с первого
+    // и гистограммы всех смещений, 4 * distances * levels на полосу строк
+    std::vector<cv::Mat> pyramid;
+    AlignedBuffer<int> offsetHistograms;
+    // Нулевой уровень пирамиды, если он крупнее кадра анализа (AnalysisOptions::textureBaseSize)
+    cv::Mat pyramidBaseColor;
+    cv::Mat pyramidBase;
+
+    // Морфология
+    cv::Mat binary;
+    std::vector<std::vector<cv::Point>> contours;
+    cv::Mat labels;
+    cv::Mat stats;
+    cv::Mat centroids;
+    // Метки объектов не меньше minPixels (MorphologyAnalyzer::analyzeObjects)
+    std::vector<int> keptLabels;
+
+    // Вид rows x cols на storage; storage перевыделяется, только если он меньше
+    // или другого типа. Вид может быть несплошным (step больше ширины строки)
+    static cv::Mat reserve(cv::Mat& storage, int rows, int cols, int type);
+
+    // Рабочее пространство потока на время вызова. Вложенный вызов в том же потоке
+    // (задача пула, которую поток взял, пока ждал свою группу) получает другой экземпляр
+    class Lease {
+    public:
+        Lease();
+        ~Lease();
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        AnalysisWorkspace& operator*() const { return *workspace_; }
+        AnalysisWorkspace* operator->() const { return workspace_; }
+
+    private:
+        AnalysisWorkspace* workspace_;
+    };
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+// Ограниченная lock-free очередь MPMC (кольцевой буфер с номерами последовательности)
+template <typename T>
+class BoundedQueue {
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+    
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> enqueuePos_;
+    alignas(64) std::atomic<size_t> dequeuePos_;
+    
+public:
+    explicit BoundedQueue(size_t capacity) : enqueuePos_(0), dequeuePos_(0) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        cells_.reset(new Cell[size]);
+        mask_ = size - 1;
+        for (size_t i = 0; i < size; i++) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+    
+    bool tryPush(T&& value) {
+        size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells_[pos & mask_];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+    
+    bool tryPop(T& value) {
+        size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells_[pos & mask_];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.value);
+                    cell.value = T();
+                    cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeuePos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+    
+    size_t size() const {
+        size_t enqueued = enqueuePos_.load(std::memory_order_relaxed);
+        size_t dequeued = dequeuePos_.load(std::memory_order_relaxed);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+    
+    size_t capacity() const { return mask_ + 1; }
+};
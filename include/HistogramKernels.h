@@ -0,0 +1,50 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+enum class KernelIsa {
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+class HistogramKernels {
+public:
+    static constexpr int kSubHistograms = 4;
+    
+    typedef void (*DifferenceRowFn)(const uchar* row, const uchar* neighbor, int count,
+                                    int shift, int* subHistograms, int bins);
+    typedef void (*CooccurrenceRowFn)(const uchar* row, const uchar* neighbor, int count,
+                                      int shift, int levelBits, int* subHistograms, int bins);
+    
+    static KernelIsa detectIsa();
+    static KernelIsa activeIsa();
+    static void setIsa(KernelIsa isa);
+    static const char* isaName(KernelIsa isa);
+    
+    static DifferenceRowFn differenceRow(KernelIsa isa);
+    static CooccurrenceRowFn cooccurrenceRow(KernelIsa isa);
+    
+    // Накопление по всему изображению; результат добавляется к output
+    static int accumulateDifferences(const cv::Mat& image, int dx, int dy, int levels,
+                                     int* histogram, KernelIsa isa);
+    static int accumulateCooccurrence(const cv::Mat& image, int dx, int dy, int levels,
+                                      int* glcm, KernelIsa isa);
+    // Гистограммы разностей для (1,0), (0,1), (1,1), (1,-1) по строкам [yStart, yEnd)
+    static void accumulateDirections(const cv::Mat& image, int yStart, int yEnd, int levels,
+                                     int* histograms, KernelIsa isa);
+    // То же вместе с гистограммой яркости (256 бинов без квантования) за один проход по строкам.
+    // Цветной image (BGR или BGRA) переводится в серый блоками строк прямо перед подсчётом
+    // и пишется в строки [yStart, yEnd) заранее выделенного gray того же размера;
+    // для серого image gray не используется
+    static void accumulateFrame(const cv::Mat& image, cv::Mat& gray, int yStart, int yEnd, int levels,
+                                int* histograms, int* intensity, KernelIsa isa);
+    // Гистограммы разностей для (d,0), (0,d), (d,d), (d,-d) при всех d = 1..distances по строкам
+    // [yStart, yEnd). Пара относится к своей нижней строке: строка y сравнивается с y-1 .. y-distances,
+    // которые только что прошли и ещё в кэше, так что каждая строка читается из памяти один раз
+    // на все смещения. Порядок гистограмм - [d - 1][направление], по levels бинов
+    static void accumulateOffsets(const cv::Mat& image, int yStart, int yEnd, int distances, int levels,
+                                  int* histograms, KernelIsa isa);
+    
+    static void mergeSubHistograms(const int* subHistograms, int bins, int* output);
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "AnalysisResults.h"
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+class ResultCache;
+class VisualizationRenderer;
+struct AnalysisWorkspace;
+
+struct AnalysisOptions {
+    // Большая сторона, до которой уменьшается кадр перед анализом; 0 - полное разрешение.
+    // Файлы декодируются сразу в этот размер (JPEG - масштабированием DCT, остальные форматы
+    // целиком с последующим уменьшением), и на нём же идут IDM, пирамида текстуры, порог,
+    // контуры и все площади и диаметры. Тайловый режим всегда работает в полном разрешении.
+    // Кадр анализа больше INT_MAX пикселей отклоняется: его можно разобрать только по тайлам
+    int analysisSize = 512;
+    // Уровни квантования серого для GLCM: 8, 16, 32, 64, 128 или 256
+    int levels = 256;
+    // Сторона тайла для анализа в полном разрешении; 0 - обычный режим
+    int tileSize = 0;
+    // Размер кадров .raw без заголовка
+    cv::Size rawFrameSize;
+    // Статистика по всем объектам, а не только по наибольшему
+    bool allObjects = false;
+    // Минимальная площадь объекта в пикселях кадра анализа (после уменьшения до analysisSize)
+    int minObjectPixels = 0;
+    // Режим диаметра; в DiameterMode::Approximate - число направлений (точность против скорости)
+    DiameterMode diameterMode = DiameterMode::RotatingCalipers;
+    int diameterDirections = MorphologyAnalyzer::kDefaultDirections;
+    // Пирамида текстуры: расстояния 1..textureDistances на textureScales уровнях.
+    // При 1 и 1 не считается: IDM на расстоянии 1 и так есть в idm_value
+    int textureDistances = 1;
+    int textureScales = 1;
+    // Большая сторона нулевого уровня пирамиды. 0 или не больше analysisSize - сам кадр анализа;
+    // больше - файл декодируется в этом размере (но не больше исходного), и пирамида строится
+    // от него, а IDM, порог и морфология по-прежнему идут на analysisSize
+    int textureBaseSize = 0;
+    // Кэш результатов по содержимому файла; не владеет объектом
+    ResultCache* cache = nullptr;
+    // Визуализация наибольшего объекта в потоке визуализации; nullptr - ничего не рисуется
+    // и не копируется. Не владеет объектом
+    VisualizationRenderer* visualizer = nullptr;
+};
+
+// Встраиваемый анализ: ничего не печатает сам (диагностика идёт через Logger, который
+// можно перенаправить Logger::setSink) и не копирует переданные изображения.
+// Результаты пишутся в AnalysisResults вызывающей стороны. Промежуточные буферы берутся
+// из AnalysisWorkspace потока, так что повторные вызовы в потоке не выделяют под них память.
+class ImageAnalysisCore {
+public:
+    typedef std::function<void(size_t index, AnalysisResults& results)> BatchCallback;
+
+    static std::string interpretIDM(double idm);
+    static std::string interpretSize(double diameter, double area);
+    static bool succeeded(const AnalysisResults& results);
+
+    // Файл: кэш, отображение несжатых кадров в память, уменьшенное декодирование
+    // или тайловый режим. Ошибки чтения и OpenCV возвращаются как false
+    static bool analyzeFile(const std::string& path, const AnalysisOptions& options,
+                            AnalysisResults& results, ThreadPool* pool = nullptr);
+
+    // Изображение вызывающей стороны (CV_8UC1, CV_8UC3 BGR или CV_8UC4 BGRA), в том числе
+    // вид на чужой буфер. Серые изображения не больше analysisSize анализируются на месте.
+    // Кэш не используется, image_path не меняется
+    static bool analyzeImage(const cv::Mat& image, const AnalysisOptions& options,
+                             AnalysisResults& results, ThreadPool* pool = nullptr);
+    // То же для сырого буфера: stride в байтах, channels 1, 3 или 4
+    static bool analyzeBuffer(const uint8_t* pixels, int width, int height, size_t stride,
+                              int channels, const AnalysisOptions& options,
+                              AnalysisResults& results, ThreadPool* pool = nullptr);
+
+    // Пакет файлов, по изображению на задачу пула (без пула - последовательно).
+    // callback вызывается из рабочих потоков по мере готовности, в любом порядке.
+    // Возвращает число успешно проанализированных изображений
+    static size_t analyzeBatch(const std::vector<std::string>& paths, const AnalysisOptions& options,
+                               ThreadPool* pool, const BatchCallback& callback);
+    // results[i] соответствует paths[i]
+    static size_t analyzeBatch(const std::vector<std::string>& paths, const AnalysisOptions& options,
+                               std::vector<AnalysisResults>& results, ThreadPool* pool = nullptr);
+
+    // Стадии по отдельности для конвейеров, которые декодируют сами.
+    // loadGray возвращает кадр не больше analysisSize (или textureBaseSize, если основание
+    // пирамиды крупнее); отображённые в память несжатые кадры - в полном размере,
+    // их уменьшает уже анализ
+    static cv::Mat loadGray(const std::string& path, const AnalysisOptions& options);
+    static std::string cacheKey(const std::string& path, const AnalysisOptions& options);
+    // Морфология по готовой маске: diameter_result, size_interpretation и objects.
+    // grayImage нужен только для визуализации (options.visualizer)
+    static void analyzeMask(const cv::Mat& binaryImage, const cv::Mat& grayImage,
+                            const AnalysisOptions& options, AnalysisResults& results,
+                            AnalysisWorkspace& workspace);
+};
@@ -7,9 +7,27 @@
 class ImageLoader {
 public:
     static cv::Mat loadImage(const std::string& filepath);
+    // Сразу в оттенках серого; JPEG декодируется с уменьшением 1/2, 1/4 или 1/8,
+    // наибольшая сторона результата не превышает maxSize (0 - без уменьшения)
+    static cv::Mat loadGrayscale(const std::string& filepath, int maxSize = 512);
+    // Отображение несжатого 8-битного кадра (PGM P5, NPY uint8, .raw/.gray при заданном rawSize)
+    // в память без копирования; отображение снимается вместе с последней ссылкой на матрицу.
+    // Пустая матрица, если файл не такого формата
+    static cv::Mat mapImage(const std::string& filepath, const cv::Size& rawSize = cv::Size());
+    // Размер кадра и смещение пикселей для тех же форматов; строки идут подряд без выравнивания
+    static bool probeUncompressed(const std::string& filepath, const cv::Size& rawSize,
+                                  cv::Size& size, size_t& offset);
+    // Размер из заголовка файла без декодирования (PNG, JPEG, BMP, PNM)
+    static bool readImageSize(const std::string& filepath, cv::Size& size);
     static cv::Mat convertToGrayscale(const cv::Mat& image);
+    // Без копии для одноканального изображения; иначе результат пишется в storage
+    // (AnalysisWorkspace::reserve), который перевыделяется только при росте
+    static cv::Mat convertToGrayscale(const cv::Mat& image, cv::Mat& storage);
     static void displayImage(const cv::Mat& image, const std::string& windowName = "Image");
     static bool saveImage(const cv::Mat& image, const std::string& filepath);
     static bool validateImage(const cv::Mat& image);
+    // maxSize 0 - без уменьшения
     static cv::Mat resizeImage(const cv::Mat& image, int maxSize = 512);
+    // То же без копии для изображения, которое уже не больше maxSize
+    static cv::Mat resizeImage(const cv::Mat& image, int maxSize, cv::Mat& storage);
 };
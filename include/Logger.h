@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <sstream>
+#include <string>
+
+enum class LogLevel {
+    Off,
+    Error,
+    Warning,
+    Info,
+    Debug
+};
+
+// Уровни выше этого вырезаются при компиляции (-DIMAGE_ANALYSIS_MAX_LOG_LEVEL=2 оставит только ошибки и предупреждения)
+#ifndef IMAGE_ANALYSIS_MAX_LOG_LEVEL
+#define IMAGE_ANALYSIS_MAX_LOG_LEVEL 4
+#endif
+
+class Logger {
+public:
+    static bool enabled(LogLevel level) {
+        return static_cast<int>(level) <= IMAGE_ANALYSIS_MAX_LOG_LEVEL &&
+               static_cast<int>(level) <= level_.load(std::memory_order_relaxed);
+    }
+
+    static LogLevel level() { return static_cast<LogLevel>(level_.load(std::memory_order_relaxed)); }
+    static void setLevel(LogLevel level) { level_.store(static_cast<int>(level), std::memory_order_relaxed); }
+    static bool parseLevel(const std::string& name, LogLevel& level);
+
+    // Одна строка за вызов, без сброса буфера stdout; ошибки и предупреждения идут в stderr
+    static void write(LogLevel level, const std::string& message);
+
+    typedef std::function<void(LogLevel level, const std::string& message)> Sink;
+    // Перенаправление сообщений в приложение, встроившее анализ; пустой sink возвращает
+    // вывод в stdout/stderr. Sink вызывается под мьютексом логгера, по одному сообщению
+    static void setSink(Sink sink);
+
+private:
+    inline static std::atomic<int> level_{static_cast<int>(LogLevel::Warning)};
+};
+
+// Аргументы форматируются только если уровень включён
+#define IA_LOG(level, expression)                                   \
+    do {                                                            \
+        if (Logger::enabled(level)) {                               \
+            std::ostringstream logStream_;                          \
+            logStream_ << expression;                               \
+            Logger::write(level, logStream_.str());                 \
+        }                                                           \
+    } while (0)
+
+#define LOG_ERROR(expression) IA_LOG(LogLevel::Error, expression)
+#define LOG_WARNING(expression) IA_LOG(LogLevel::Warning, expression)
+#define LOG_INFO(expression) IA_LOG(LogLevel::Info, expression)
+#define LOG_DEBUG(expression) IA_LOG(LogLevel::Debug, expression)
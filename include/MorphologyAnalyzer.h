@@ -1,10 +1,20 @@
 #pragma once
 
+#include "AnalysisWorkspace.h"
 #include <opencv2/opencv.hpp>
+#include <cstdint>
 #include <vector>
 #include <cmath>
 #include <limits>
 
+enum class DiameterMode {
+    BruteForce,
+    RotatingCalipers,
+    // Наибольшая протяжённость по K равномерным направлениям; занижает диаметр
+    // не больше чем в relativeError = 1 - cos(pi / 2K) раз
+    Approximate
+};
+
 struct DiameterResult {
     double maxDiameter;
     cv::Point2f point1, point2;
@@ -12,17 +22,66 @@ struct DiameterResult {
     double perimeter;
     int contourPoints;
     double circularity;
+    // Метка компоненты в режиме нескольких объектов; 0 для одиночного контура
+    int label;
+    // Гарантированная граница относительной ошибки maxDiameter: (D - maxDiameter) / D
+    // не больше неё. 0 для точных режимов
+    double relativeError;
 };
 
 class MorphologyAnalyzer {
 public:
+    // Направлений в DiameterMode::Approximate по умолчанию: ошибка не больше 0.12%
+    static constexpr int kDefaultDirections = 32;
+    
     static cv::Mat binarizeImage(const cv::Mat& grayImage, int threshold = 128);
+    // Один проход порога; с порогом из otsuThreshold совпадает с binarizeImageOtsu
+    static cv::Mat binarizeImage(const cv::Mat& grayImage, int threshold, cv::Mat& storage);
     static cv::Mat binarizeImageOtsu(const cv::Mat& grayImage);
+    static cv::Mat binarizeImageOtsu(const cv::Mat& grayImage, cv::Mat& storage);
+    // Порог Оцу по готовой 256-бинной гистограмме (тот же критерий, что у cv::THRESH_OTSU)
+    static int otsuThreshold(const std::vector<int64_t>& histogram);
     static std::vector<std::vector<cv::Point>> findContours(const cv::Mat& binaryImage);
-    static DiameterResult calculateMaxDiameter(const std::vector<cv::Point>& contour);
+    // Внешние векторы переиспользуются: память не выделяется, пока контуров не больше прежнего
+    static void findContours(const cv::Mat& binaryImage, std::vector<std::vector<cv::Point>>& contours);
+    // directions используется только в DiameterMode::Approximate: больше направлений -
+    // точнее и медленнее
+    static DiameterResult calculateMaxDiameter(const std::vector<cv::Point>& contour,
+                                               DiameterMode mode = DiameterMode::RotatingCalipers,
+                                               int directions = kDefaultDirections);
+    // Граница относительной ошибки приближённого диаметра по directions направлениям
+    static double approximationError(int directions);
     static double euclideanDistance(const cv::Point2f& p1, const cv::Point2f& p2);
     static int findLargestContour(const std::vector<std::vector<cv::Point>>& contours);
+    // Все объекты изображения: разметка связных компонент за один проход со статистикой
+    // по меткам, объекты меньше minPixels пропускаются, остальные измеряются параллельно.
+    // Результаты упорядочены по метке
+    static std::vector<DiameterResult> analyzeObjects(const cv::Mat& binaryImage, int minPixels = 0,
+                                                      DiameterMode mode = DiameterMode::RotatingCalipers,
+                                                      int directions = kDefaultDirections);
+    // Разметка пишется в labels/stats/centroids рабочего пространства
+    static std::vector<DiameterResult> analyzeObjects(const cv::Mat& binaryImage, AnalysisWorkspace& workspace,
+                                                      int minPixels = 0,
+                                                      DiameterMode mode = DiameterMode::RotatingCalipers,
+                                                      int directions = kDefaultDirections);
+    // Результаты пишутся в objects, который сохраняет ёмкость между вызовами: с тем же
+    // рабочим пространством и objects анализ в установившемся режиме не выделяет память
+    static void analyzeObjects(const cv::Mat& binaryImage, AnalysisWorkspace& workspace,
+                               std::vector<DiameterResult>& objects, int minPixels = 0,
+                               DiameterMode mode = DiameterMode::RotatingCalipers,
+                               int directions = kDefaultDirections);
     static cv::Mat visualizeResults(const cv::Mat& image, 
                                    const std::vector<cv::Point>& contour,
                                    const DiameterResult& result);
+    static cv::Mat visualizeResults(const cv::Mat& image,
+                                   const std::vector<cv::Point>& contour,
+                                   const DiameterResult& result, cv::Mat& storage);
+
+private:
+    static void measureContour(const std::vector<cv::Point>& contour, DiameterMode mode,
+                               int directions, DiameterResult& result);
+    static void findDiameterBruteForce(const std::vector<cv::Point>& contour, DiameterResult& result);
+    static void findDiameterRotatingCalipers(const std::vector<cv::Point>& contour, DiameterResult& result);
+    static void findDiameterApproximate(const std::vector<cv::Point>& contour, int directions,
+                                        DiameterResult& result);
 };
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "AnalysisResults.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+struct CacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stores;
+    uint64_t evictions;
+};
+
+// Кэш результатов на диске, адресуемый содержимым: ключ — хеш байтов файла
+// и строки параметров анализа, поэтому переименование файла не мешает попаданию,
+// а смена параметров даёт новый ключ. Одна запись — один файл <ключ>.iac.
+// Записи публикуются через rename(), так что каталог можно делить между потоками
+// и процессами: читатель видит либо целую запись, либо её отсутствие.
+class ResultCache {
+public:
+    static constexpr uint32_t kMagic = 0x31434149;   // "IAC1"
+    static constexpr uint32_t kVersion = 4;
+
+    ResultCache(const std::string& directory, uint64_t maxBytes);
+
+    bool isOpen() const { return open_; }
+
+    // Пустой ключ, если файл не прочитан
+    static std::string makeKey(const std::string& imagePath, const std::string& parameters);
+    static bool hashFile(const std::string& path, uint64_t& hash);
+
+    // image_path в найденной записи заменяется на переданный путь
+    bool lookup(const std::string& key, const std::string& imagePath, AnalysisResults& results);
+    void store(const std::string& key, const AnalysisResults& results);
+
+    CacheStats stats() const;
+
+private:
+    std::string directory_;
+    uint64_t maxBytes_;
+    bool open_;
+    // Оценка размера каталога; уточняется при каждой очистке
+    std::atomic<uint64_t> usedBytes_;
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> stores_;
+    std::atomic<uint64_t> evictions_;
+    std::mutex evictMutex_;
+
+    std::string entryPath(const std::string& key) const;
+    uint64_t scanUsedBytes() const;
+    void evict();
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "AnalysisResults.h"
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class ResultFormat {
+    JsonLines,
+    Csv,
+    Binary
+};
+
+// Приёмник результатов: записи копятся в буфере и сбрасываются пачками.
+// write() можно вызывать из нескольких потоков одновременно.
+class ResultSink {
+public:
+    explicit ResultSink(size_t batchSize = 256);
+    virtual ~ResultSink();
+    
+    void write(const AnalysisResults& results);
+    void flush();
+    bool isOpen() const { return open_; }
+    size_t recordsWritten() const;
+    
+    static std::unique_ptr<ResultSink> create(ResultFormat format, const std::string& path);
+    static bool parseFormat(const std::string& name, ResultFormat& format);
+    
+protected:
+    std::fstream file_;
+    bool open_;
+    
+    bool openFile(const std::string& path, bool binary);
+    // Вызываются под мьютексом
+    virtual void encode(const AnalysisResults& results, std::string& buffer) = 0;
+    virtual void finishBatch(std::string& buffer) { (void)buffer; }
+    // После записи пакета в файл
+    virtual void batchWritten() {}
+    
+private:
+    mutable std::mutex mutex_;
+    std::string buffer_;
+    size_t pending_;
+    size_t batchSize_;
+    size_t written_;
+    
+    void flushLocked();
+};
+
+class JsonLinesSink : public ResultSink {
+public:
+    explicit JsonLinesSink(const std::string& path);
+    
+    // Один JSON-объект без перевода строки (используется и ответами демона)
+    static void encodeObject(const AnalysisResults& results, std::string& buffer);
+    
+protected:
+    void encode(const AnalysisResults& results, std::string& buffer) override;
+};
+
+// Только наибольший объект: список objects пишет лишь JsonLinesSink
+class CsvSink : public ResultSink {
+public:
+    explicit CsvSink(const std::string& path);
+    
+protected:
+    void encode(const AnalysisResults& results, std::string& buffer) override;
+};
+
+// Колоночный формат фиксированной ширины для mmap.
+// Файл: FileHeader, затем блоки. Каждый сброшенный пакет — один блок:
+// BlockHeader и столбцы подряд (по recordCount значений каждый),
+// затем длины путей (uint32) и сами пути; блок выровнен на 8 байт.
+// Счётчики в FileHeader обновляются после каждого сброшенного блока, так что файл
+// читается и во время записи. Непустой файл другого формата или версии не открывается.
+class BinarySink : public ResultSink {
+public:
+    static constexpr uint32_t kMagic = 0x31524149;   // "IAR1"
+    static constexpr uint32_t kVersion = 1;
+    
+#pragma pack(push, 1)
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t recordCount;
+        uint64_t blockCount;
+        uint64_t reserved;
+    };
+    
+    struct BlockHeader {
+        uint32_t recordCount;
+        uint32_t pathBytes;
+    };
+#pragma pack(pop)
+    
+    explicit BinarySink(const std::string& path);
+    ~BinarySink() override;
+    
+protected:
+    void encode(const AnalysisResults& results, std::string& buffer) override;
+    void finishBatch(std::string& buffer) override;
+    void batchWritten() override;
+    
+private:
+    std::vector<double> idm_;
+    std::vector<double> maxDiameter_;
+    std::vector<double> area_;
+    std::vector<double> perimeter_;
+    std::vector<double> circularity_;
+    std::vector<float> point1X_;
+    std::vector<float> point1Y_;
+    std::vector<float> point2X_;
+    std::vector<float> point2Y_;
+    std::vector<int32_t> contourPoints_;
+    std::vector<uint32_t> pathLengths_;
+    std::string paths_;
+    uint64_t records_;
+    uint64_t blocks_;
+    
+    void writeHeader();
+};
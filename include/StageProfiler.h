@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+enum class Stage {
+    Decode,
+    Grayscale,
+    Resize,
+    GLCM,
+    IDM,
+    Otsu,
+    Contours,
+    Diameter,
+    Count
+};
+
+// Время стадий анализа по всем потокам. Пока профилирование выключено,
+// StageProfiler::Scope стоит одной атомарной загрузки.
+class StageProfiler {
+public:
+    class Scope {
+    public:
+        explicit Scope(Stage stage)
+            : stage_(stage), start_(StageProfiler::enabled() ? StageProfiler::nowNs() : -1) {}
+        ~Scope() {
+            if (start_ >= 0) {
+                StageProfiler::record(stage_, start_, StageProfiler::nowNs() - start_);
+            }
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Stage stage_;
+        int64_t start_;
+    };
+
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+    static void setEnabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+
+    static int64_t nowNs();
+    static const char* stageName(Stage stage);
+    static void record(Stage stage, int64_t startNs, int64_t durationNs);
+    static void reset();
+
+    // Число вызовов, суммарное время и p50/p95/p99/max по каждой стадии. Поток хранит
+    // последние события каждой стадии в кольце, так что память не растёт в демоне
+    // и потоковом режиме; перцентили и трасса - по хранимым событиям
+    static void printReport(std::ostream& out = std::cout);
+    // Формат Trace Event (chrome://tracing, Perfetto)
+    static bool writeChromeTrace(const std::string& path);
+
+private:
+    inline static std::atomic<bool> enabled_{false};
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "ImageAnalysisCore.h"
+#include "AnalysisWorkspace.h"
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+struct StreamOptions {
+    // Сторона тайла на кадре размера analysisSize
+    int tileSize = 32;
+    // Тайл считается изменившимся, если хоть один пиксель отличается
+    // от опорного кадра больше чем на tolerance уровней серого
+    int tolerance = 8;
+    // Каждые keyframeInterval кадров всё пересчитывается с нуля; 0 - только при смене размера.
+    // Иначе медленный дрейф ниже tolerance не попадает в опорный кадр
+    int keyframeInterval = 0;
+    AnalysisOptions analysis;
+};
+
+struct StreamStats {
+    uint64_t frames = 0;
+    uint64_t keyframes = 0;
+    // Тайлы с изменившимися пикселями и тайлы, чьи гистограммы пересчитаны
+    // (изменившиеся и соседи, чьи пары заходят в них)
+    uint64_t changedTiles = 0;
+    uint64_t textureTiles = 0;
+    uint64_t totalTiles = 0;
+    uint64_t morphologyRuns = 0;
+};
+
+// Анализ последовательности кадров с пересчётом только изменившихся тайлов.
+// Каждый тайл хранит свой вклад в гистограммы разностей по 4 направлениям (пары,
+// первый пиксель которых лежит в тайле) и в гистограмму яркости. У изменившегося тайла
+// вклад вычитается из общих сумм и добавляется заново. Морфология пересчитывается,
+// только если изменилась бинарная маска.
+// Результат совпадает с ImageAnalysisCore::analyzeImage для опорного кадра, в который
+// переносятся только изменившиеся тайлы; при tolerance = 0 - с analyzeImage для самого кадра
+class StreamAnalyzer {
+public:
+    explicit StreamAnalyzer(const StreamOptions& options = StreamOptions());
+
+    // Кадр CV_8UC1, CV_8UC3 (BGR) или CV_8UC4; results.image_path не меняется
+    bool process(const cv::Mat& frame, AnalysisResults& results, ThreadPool* pool = nullptr);
+    void reset();
+
+    const StreamStats& stats() const { return stats_; }
+    static void printStats(const StreamStats& stats);
+
+private:
+    StreamOptions options_;
+    StreamStats stats_;
+    AnalysisWorkspace workspace_;
+
+    // Кадр, по которому посчитаны все гистограммы, и бинарная маска по нему
+    cv::Mat reference_;
+    cv::Mat binary_;
+    int threshold_;
+    int columns_;
+    int rows_;
+
+    // По 4 * levels и 256 счётчиков на тайл, тайлы построчно
+    std::vector<int> tileDifferences_;
+    std::vector<int> tileIntensity_;
+    std::vector<std::vector<int64_t>> differences_;
+    std::vector<int64_t> intensity_;
+
+    std::vector<char> changed_;
+    std::vector<char> textureDirty_;
+    std::vector<int> dirtyTiles_;
+
+    // Морфология последней маски
+    DiameterResult diameter_;
+    std::vector<DiameterResult> objects_;
+    std::string sizeInterpretation_;
+
+    cv::Rect tileRect(int tile) const;
+    void start(const cv::Mat& gray);
+    bool detectChanges(const cv::Mat& gray);
+    void updateTexture(ThreadPool* pool);
+    void accumulateTile(int tile);
+    bool updateMask(const cv::Rect& region);
+    double idm() const;
+};
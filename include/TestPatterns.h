@@ -0,0 +1,20 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+// Синтетические изображения для тестов и бенчмарков; геометрия масштабируется
+// вместе с размером (при size = 200 совпадает с исходными тестовыми изображениями)
+class TestPatterns {
+public:
+    static cv::Mat uniform(int size);
+    static cv::Mat circle(int size);
+    static cv::Mat chessboard(int size);
+    static cv::Mat square(int size);
+    static cv::Mat noise(int size);
+
+    static const std::vector<std::string>& names();
+    // Пустая матрица для неизвестного имени
+    static cv::Mat make(const std::string& name, int size);
+};
@@ -1,22 +1,133 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 #include <opencv2/opencv.hpp>
 #include <iostream>
 #include <iomanip>
+#include "AlignedBuffer.h"
+#include "AnalysisWorkspace.h"
+
+class ThreadPool;
+
+enum class TextureSweepMode {
+    PerDirection,
+    SinglePassParallel
+};
+
+// Признаки Харалика; набор задаётся битовой маской
+enum HaralickFeature : unsigned {
+    FeatureContrast    = 1u << 0,
+    FeatureEnergy      = 1u << 1,
+    FeatureEntropy     = 1u << 2,
+    FeatureCorrelation = 1u << 3,
+    FeatureHomogeneity = 1u << 4,   // sum p / (1 + |i - j|)
+    FeatureIDM         = 1u << 5,   // sum p / (1 + (i - j)^2)
+    FeatureAll         = (1u << 6) - 1
+};
+
+struct HaralickFeatures {
+    double contrast;
+    double energy;
+    double entropy;
+    double correlation;
+    double homogeneity;
+    double idm;
+    unsigned computed;   // какие поля заполнены
+};
+
+// IDM по расстояниям, направлениям и уровням пирамиды изображения
+struct TexturePyramid {
+    int distances = 0;
+    // Посчитанные уровни: уровень со стороной не больше distances уже не берётся
+    int scales = 0;
+    // [уровень][расстояние - 1][направление]; направления (d,0), (0,d), (d,d), (d,-d)
+    std::vector<double> idm;
+    
+    double at(int scale, int distance, int direction) const {
+        return idm[(static_cast<size_t>(scale) * distances + distance - 1) * 4 + direction];
+    }
+    // Среднее по направлениям, scales * distances значений в порядке [уровень][расстояние - 1]
+    std::vector<double> averageOverDirections() const;
+};
 
 class TextureAnalyzer {
 private:
-    std::vector<std::vector<int>> glcm_;
+    // GLCM строится лениво, в workspace_ (glcm, glcmCells и маргинальные суммы):
+    // только по запросу getNormalizedGLCM / printGLCMStats / computeFeatures,
+    // поэтому эти методы не const
+    AnalysisWorkspace workspace_;
+    bool glcmBuilt_;
+    std::vector<int> diffHistogram_;
+    cv::Mat source_;
+    int dx_;
+    int dy_;
     int levels_;
     int totalPairs_;
     
+    void materializeGLCM();
+    // Гистограмма разностей одного смещения; возвращает число пар
+    static int accumulateDifferences(const cv::Mat& image, int dx, int dy, int levels, int* histogram);
+    // GLCM смещения в workspace.glcm, затем сжатый список ненулевых ячеек и маргинальные суммы:
+    // проход по признакам не трогает нулевые ячейки
+    static void buildCooccurrence(const cv::Mat& image, int dx, int dy, int levels,
+                                  AnalysisWorkspace& workspace);
+    // Признаки по гистограмме разностей или, если нужны энергия, энтропия или корреляция,
+    // по ячейкам и маргинальным суммам из workspace (buildCooccurrence)
+    static HaralickFeatures evaluateFeatures(const int* differenceHistogram, const AnalysisWorkspace& workspace,
+                                             int levels, int totalPairs, unsigned features);
+    // Гистограммы 4 направлений подряд в начале histograms (по levels на направление).
+    // С frameGray проход идёт через accumulateFrame: за ними ещё 256 бинов яркости,
+    // а цветной image переводится в frameGray. С pool полосы строк - задачи пула
+    static void buildDirectionalHistograms(const cv::Mat& image, int levels,
+                                           AlignedBuffer<int>& histograms, int totals[4],
+                                           cv::Mat* frameGray = nullptr, ThreadPool* pool = nullptr);
+    // 4 * distances гистограмм accumulateOffsets подряд в начале histograms
+    static void buildOffsetHistograms(const cv::Mat& image, int levels, int distances,
+                                      AlignedBuffer<int>& histograms, ThreadPool* pool);
+    static double averageDirectionalIDM(const int* histograms, int levels, const int totals[4]);
+    static double idmFromHistogram(const int* histogram, int levels, int64_t totalPairs);
+    
 public:
+    // levels — число уровней квантования серого: 8, 16, 32, 64, 128 или 256
     explicit TextureAnalyzer(int levels = 256);
     void buildGLCM(const cv::Mat& image, int dx, int dy);
+    void buildDifferenceHistogram(const cv::Mat& image, int dx, int dy);
     double calculateIDM();
-    std::vector<std::vector<double>> getNormalizedGLCM() const;
-    void printGLCMStats() const;
-    double analyzeMultiDirectional(const cv::Mat& image);
+    std::vector<std::vector<double>> getNormalizedGLCM();
+    void printGLCMStats();
+    // Любой набор признаков за один проход по ненулевым ячейкам.
+    // Контраст, однородность и IDM зависят только от |i - j|: если нужны только они,
+    // GLCM не строится и хватает гистограммы разностей
+    HaralickFeatures computeFeatures(unsigned features = FeatureAll);
+    // То же для смещения (dx, dy) без состояния объекта: GLCM и ячейки строятся
+    // в рабочем пространстве, поэтому функцию можно звать из любого числа потоков
+    static HaralickFeatures computeFeatures(const cv::Mat& image, int dx, int dy, int levels,
+                                            unsigned features, AnalysisWorkspace& workspace);
+    // Признаки, усреднённые по направлениям (1,0), (0,1), (1,1), (1,-1)
+    HaralickFeatures analyzeFeatures(const cv::Mat& image, unsigned features = FeatureAll);
+    double analyzeMultiDirectional(const cv::Mat& image,
+                                   TextureSweepMode mode = TextureSweepMode::SinglePassParallel);
+    // Средний IDM по 4 направлениям без состояния объекта: все буферы берутся
+    // из рабочего пространства, поэтому функцию можно звать из любого числа потоков
+    static double multiDirectionalIDM(const cv::Mat& image, int levels, AnalysisWorkspace& workspace);
+    // То же за один проход по кадру CV_8UC1, BGR или BGRA: перевод в серый, гистограммы
+    // разностей и гистограмма яркости для порога Оцу (в workspace.intensity).
+    // gray - серый кадр, по которому шёл подсчёт: сам image или вид на workspace.gray
+    static double sweepFrame(const cv::Mat& image, int levels, AnalysisWorkspace& workspace,
+                             cv::Mat& gray, ThreadPool* pool = nullptr);
+    // IDM для всех сочетаний расстояния 1..distances, 4 направлений и scales уровней пирамиды.
+    // Уровень 0 - сам image (CV_8UC1), каждый следующий - cv::pyrDown предыдущего
+    // в workspace.pyramid. Каждый уровень проходится один раз на все смещения
+    static TexturePyramid analyzePyramid(const cv::Mat& image, int levels, int distances, int scales,
+                                         AnalysisWorkspace& workspace, ThreadPool* pool = nullptr);
+    // Карта IDM по окну windowSize x windowSize вокруг каждого пикселя (CV_32F).
+    // Окно с центром в пикселе: windowSize нечётный и не меньше 3, иначе пустая матрица
+    cv::Mat computeIDMMap(const cv::Mat& image, int windowSize) const;
     void clear();
+    int levels() const { return levels_; }
+    
+    static bool isSupportedLevels(int levels);
+    // IDM по гистограмме разностей с 64-битными счётчиками (потайловое накопление)
+    static double idmFromCounts(const std::vector<int64_t>& histogram, int64_t totalPairs);
 };
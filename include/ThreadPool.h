@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Пул потоков с захватом работы: у каждого потока своя очередь,
+// свои задачи берутся с конца (LIFO), чужие — с начала (FIFO)
+class ThreadPool {
+public:
+    typedef std::function<void()> Task;
+    
+    class TaskGroup {
+    private:
+        struct State {
+            std::atomic<int> pending{0};
+            std::mutex mutex;
+            // Первое исключение задач группы; wait() пробрасывает его вызывающему
+            std::exception_ptr error;
+        };
+        
+        ThreadPool& pool_;
+        std::shared_ptr<State> state_;
+        
+        void join();
+        
+    public:
+        explicit TaskGroup(ThreadPool& pool);
+        // Дожидается задач; исключение, не забранное wait(), теряется
+        ~TaskGroup();
+        void run(Task task);
+        // Пока группа не завершена, вызывающий поток сам выполняет задачи пула,
+        // а когда их нет - спит до новой задачи или завершения группы.
+        // Если задача бросила исключение, оно пробрасывается после завершения всех задач
+        void wait();
+    };
+    
+    explicit ThreadPool(int threads = 0);
+    ~ThreadPool();
+    
+    // Исключение из задачи, поставленной напрямую, пишется в лог; нужен результат - TaskGroup
+    void submit(Task task);
+    void waitAll();
+    int threadCount() const { return static_cast<int>(workers_.size()); }
+    
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+    
+    std::vector<std::thread> workers_;
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::mutex sleepMutex_;
+    std::condition_variable wakeUp_;
+    std::condition_variable idle_;
+    std::atomic<int> pending_;
+    std::atomic<int> queued_;
+    std::atomic<unsigned> nextQueue_;
+    bool stopping_;
+    
+    void workerLoop(int index);
+    bool tryRunOne(int preferredQueue);
+    void notifyGroupDone();
+    bool popLocal(int index, Task& task);
+    bool steal(int thief, Task& task);
+    static int& currentWorker();
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "MorphologyAnalyzer.h"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Источник тайлов: чтение прямоугольных областей без загрузки всего изображения
+class TileSource {
+public:
+    virtual ~TileSource() {}
+
+    virtual cv::Size size() const = 0;
+    // region целиком внутри изображения; tile только читается вызывающим кодом
+    virtual bool read(const cv::Rect& region, cv::Mat& tile) = 0;
+
+    // Несжатые кадры (PGM, NPY, raw) читаются с диска по строкам тайла.
+    // Сжатые форматы OpenCV умеет декодировать только целиком, и тогда
+    // память зависит от размера изображения
+    static std::unique_ptr<TileSource> open(const std::string& path,
+                                            const cv::Size& rawSize = cv::Size());
+};
+
+struct TiledOptions {
+    int tileSize = 2048;
+    int levels = 256;
+};
+
+struct TiledResults {
+    cv::Size imageSize;
+    int tiles;
+    // Направления (1,0), (0,1), (1,1), (1,-1)
+    std::array<double, 4> directionalIDM;
+    std::array<int64_t, 4> totalPairs;
+    double idm;
+    int otsuThreshold;
+    int64_t objectCount;
+    // Наибольший объект: площадь в пикселях, периметр по длине границы пикселей
+    DiameterResult diameter;
+};
+
+// Анализ в полном разрешении по тайлам: память определяется размером тайла
+// и шириной изображения (одна строка меток на границе рядов тайлов)
+class TiledAnalyzer {
+public:
+    explicit TiledAnalyzer(const TiledOptions& options = TiledOptions());
+
+    // Два прохода: текстура и гистограмма яркости, затем разметка объектов
+    // по порогу Оцу со слиянием частей, разрезанных границами тайлов
+    bool analyze(TileSource& source, TiledResults& results);
+
+private:
+    TiledOptions options_;
+
+    template <typename Fn>
+    bool forEachTile(TileSource& source, Fn fn);
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "MorphologyAnalyzer.h"
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct VisualizationOptions {
+    // Каталог для <имя>_visual.png
+    std::string directory;
+    // Большая сторона эскиза; 0 - в размере анализа
+    int thumbnailSize = 0;
+    size_t queueCapacity = 16;
+};
+
+struct VisualizationStats {
+    uint64_t submitted = 0;
+    uint64_t written = 0;
+    uint64_t failed = 0;
+    // Сколько раз submit ждал места в очереди
+    uint64_t waits = 0;
+};
+
+// Визуализация наибольшего объекта, отложенная в отдельный поток с пониженным приоритетом.
+// Поток анализа только копирует в задание серый кадр и контур; уменьшение до эскиза, рисование
+// и запись PNG идут в потоке визуализации. Задания после записи возвращаются в запас вместе
+// с буферами, так что в установившемся режиме submit не выделяет память.
+// При полной очереди submit ждёт: визуализации не теряются, анализ притормаживает до скорости записи.
+// Поток визуализации, submit и finish ждут на условных переменных, без опроса
+class VisualizationRenderer {
+public:
+    explicit VisualizationRenderer(const VisualizationOptions& options);
+    // Дорисовывает всё, что стоит в очереди
+    ~VisualizationRenderer();
+
+    VisualizationRenderer(const VisualizationRenderer&) = delete;
+    VisualizationRenderer& operator=(const VisualizationRenderer&) = delete;
+
+    // Каталог создан или уже существует
+    bool isOpen() const { return open_; }
+
+    // Из любого потока анализа. imagePath даёт имя файла; пустой - по номеру задания.
+    // Повторное имя другого файла (a/img.png и b/img.png, img.png и img.jpg) дополняется
+    // номером задания; повторный анализ того же файла перезаписывает его визуализацию
+    void submit(const std::string& imagePath, const cv::Mat& grayImage,
+                const std::vector<cv::Point>& contour, const DiameterResult& result);
+    // Ждёт, пока очередь опустеет и все задания будут записаны
+    void finish();
+
+    VisualizationStats stats() const;
+    void printStats() const;
+
+    static std::string fileName(const std::string& imagePath, uint64_t sequence);
+
+private:
+    // Имя файла строится уже в потоке визуализации
+    struct Job {
+        std::string imagePath;
+        uint64_t sequence = 0;
+        cv::Mat gray;
+        std::vector<cv::Point> contour;
+        DiameterResult result;
+    };
+
+    VisualizationOptions options_;
+    bool open_;
+    size_t capacity_;
+
+    std::mutex mutex_;
+    // Задание в очереди или остановка - для потока визуализации
+    std::condition_variable ready_;
+    // Место в очереди - для submit
+    std::condition_variable space_;
+    // Задание записано - для finish
+    std::condition_variable done_;
+    // Кольцо из capacity_ заданий: перемещение в него и из него не выделяет память
+    std::vector<Job> queue_;
+    size_t head_;
+    size_t queued_;
+    std::vector<Job> spare_;
+    bool stopping_;
+
+    std::atomic<uint64_t> submitted_;
+    std::atomic<uint64_t> written_;
+    std::atomic<uint64_t> failed_;
+    std::atomic<uint64_t> waits_;
+    std::thread worker_;
+
+    // Только в потоке визуализации
+    cv::Mat thumbnail_;
+    cv::Mat canvas_;
+    std::unordered_set<std::string> names_;
+    std::unordered_map<std::string, std::string> pathNames_;
+
+    void run();
+    void render(Job& job);
+    std::string uniqueName(const Job& job);
+};
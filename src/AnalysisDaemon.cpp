@@ -0,0 +1,701 @@
+#include "AnalysisDaemon.h"
+#include "ResultSink.h"
+#include "TestPatterns.h"
+#include "ThreadPool.h"
+#include "Logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <thread>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Столько последних задержек хранится для перцентилей
+const size_t kLatencySamples = 65536;
+// Строка запроса длиннее этого без перевода строки - клиент отключается
+const size_t kMaxLineBytes = 64 * 1024;
+// Столько неотправленных ответов держится для клиента, который их не читает; дальше он отключается
+const size_t kMaxOutputBytes = 16 * 1024 * 1024;
+// При остановке оставшиеся ответы досылаются не дольше этого на соединение
+const int kFlushTimeoutMs = 5000;
+
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Ближайший ранг по отсортированной выборке
+double percentileUs(const std::vector<int64_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t rank = static_cast<size_t>(p / 100.0 * sorted.size() + 0.999999);
+    rank = std::min(std::max<size_t>(rank, 1), sorted.size());
+    return sorted[rank - 1] / 1e3;
+}
+
+void appendNumber(std::string& buffer, double value) {
+    char text[32];
+    int length = std::snprintf(text, sizeof(text), "%.9g", value);
+    buffer.append(text, length);
+}
+
+#ifndef _WIN32
+
+// Пишет, сколько сокет примет без ожидания; в written - отправленные байты.
+// false - соединение сломано
+bool sendSome(int fd, const char* data, size_t size, size_t& written) {
+    written = 0;
+    while (written < size) {
+        ssize_t sent = send(fd, data + written, size - written, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        written += static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+// Кадр в POSIX shared memory отображается только на чтение на время анализа
+bool analyzeSharedFrame(const std::string& name, int width, int height, size_t stride, int channels,
+                        const AnalysisOptions& options, AnalysisResults& results, ThreadPool* pool) {
+    std::string objectName = name[0] == '/' ? name : "/" + name;
+    // Параметры приходят от клиента: длина отображения считается только по проверенным
+    if (width <= 0 || height <= 0 || (channels != 1 && channels != 3 && channels != 4) ||
+        stride < static_cast<size_t>(width) * channels ||
+        stride > std::numeric_limits<size_t>::max() / static_cast<size_t>(height)) {
+        LOG_ERROR("Error: Invalid frame parameters for shared memory " << objectName);
+        return false;
+    }
+
+    int fd = shm_open(objectName.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        LOG_ERROR("Error: Cannot open shared memory " << objectName);
+        return false;
+    }
+
+    struct stat info;
+    size_t length = stride * static_cast<size_t>(height - 1) + static_cast<size_t>(width) * channels;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < length) {
+        LOG_ERROR("Error: Shared memory " << objectName << " is shorter than the frame");
+        close(fd);
+        return false;
+    }
+
+    void* base = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        LOG_ERROR("Error: Cannot map shared memory " << objectName);
+        return false;
+    }
+
+    bool ok = ImageAnalysisCore::analyzeBuffer(static_cast<const uint8_t*>(base), width, height,
+                                               stride, channels, options, results, pool);
+    munmap(base, length);
+    results.image_path = "shm:" + objectName;
+    return ok;
+}
+
+#endif
+
+}
+
+struct AnalysisDaemon::Connection {
+    int fd;
+    // Хвост ответов, который сокет не принял сразу: дописывает любой поток,
+    // досылает поток ввода-вывода по POLLOUT. Под writeMutex, как и broken
+    std::mutex writeMutex;
+    std::string output;
+    bool broken;
+    std::atomic<bool> binary;
+    // Принятые в очередь запросы без ответа: соединение живёт, пока они не отвечены
+    std::atomic<int> pending;
+    // Только для потока ввода-вывода
+    uint64_t nextRequest;
+    std::string input;
+    bool readClosed;
+
+    explicit Connection(int socket)
+        : fd(socket), broken(false), binary(false), pending(0), nextRequest(0), readClosed(false) {}
+    ~Connection() {
+#ifndef _WIN32
+        close(fd);
+#endif
+    }
+};
+
+AnalysisDaemon::AnalysisDaemon(const DaemonOptions& options)
+    : options_(options), pool_(new ThreadPool(options.workers)), stopping_(false),
+      inFlight_(0), served_(0), failed_(0), rejected_(0), batches_(0), latencyNext_(0) {
+    wakePipe_[0] = wakePipe_[1] = -1;
+    if (options_.queueCapacity == 0) {
+        options_.queueCapacity = 1;
+    }
+    if (options_.maxBatch == 0) {
+        options_.maxBatch = 2 * static_cast<size_t>(pool_->threadCount());
+    }
+    latencies_.reserve(kLatencySamples);
+}
+
+AnalysisDaemon::~AnalysisDaemon() {
+#ifndef _WIN32
+    if (wakePipe_[0] >= 0) {
+        close(wakePipe_[0]);
+        close(wakePipe_[1]);
+    }
+#endif
+}
+
+void AnalysisDaemon::stop() {
+    stopping_.store(true);
+    wake();
+}
+
+// Будит poll потока ввода-вывода; канал неблокирующий, полный канал будит и так
+void AnalysisDaemon::wake() {
+#ifndef _WIN32
+    if (wakePipe_[1] >= 0) {
+        char byte = 1;
+        ssize_t ignored = write(wakePipe_[1], &byte, 1);
+        (void)ignored;
+    }
+#endif
+}
+
+// Первый анализ платит за ленивую инициализацию OpenCV и рост рабочих пространств
+// потоков; пусть это случится до первого клиента
+void AnalysisDaemon::warmUp() {
+    const int analysisSize = options_.analysis.analysisSize;
+    cv::Mat pattern = TestPatterns::make("noise", analysisSize > 0 ? analysisSize : 512);
+    AnalysisOptions options = options_.analysis;
+    options.cache = nullptr;
+
+    ThreadPool::TaskGroup group(*pool_);
+    for (int i = 0; i < pool_->threadCount(); i++) {
+        group.run([&pattern, &options]() {
+            AnalysisResults results{};
+            ImageAnalysisCore::analyzeImage(pattern, options, results);
+        });
+    }
+    group.wait();
+}
+
+bool AnalysisDaemon::run() {
+#ifdef _WIN32
+    LOG_ERROR("Error: Daemon mode requires UNIX domain sockets");
+    return false;
+#else
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (options_.socketPath.empty() || options_.socketPath.size() >= sizeof(address.sun_path)) {
+        LOG_ERROR("Error: Invalid socket path " << options_.socketPath);
+        return false;
+    }
+    std::memcpy(address.sun_path, options_.socketPath.c_str(), options_.socketPath.size());
+
+    if (pipe(wakePipe_) != 0) {
+        LOG_ERROR("Error: Cannot create wake-up pipe");
+        return false;
+    }
+    fcntl(wakePipe_[0], F_SETFL, O_NONBLOCK);
+    fcntl(wakePipe_[1], F_SETFL, O_NONBLOCK);
+
+    // Сокет, оставшийся от упавшего процесса, заменяется; обычный файл - нет
+    struct stat existing;
+    if (lstat(options_.socketPath.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+        unlink(options_.socketPath.c_str());
+    }
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0 || bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listenFd, 128) != 0) {
+        LOG_ERROR("Error: Cannot listen on " << options_.socketPath << ": " << std::strerror(errno));
+        if (listenFd >= 0) {
+            close(listenFd);
+        }
+        return false;
+    }
+
+    warmUp();
+    std::thread dispatcher(&AnalysisDaemon::dispatchLoop, this);
+    LOG_INFO("Daemon listening on " << options_.socketPath << " with "
+             << pool_->threadCount() << " workers");
+
+    std::vector<std::shared_ptr<Connection>> connections;
+    std::vector<pollfd> fds;
+    char chunk[16384];
+
+    // Досылает хвост ответов, сколько примет сокет; сломанное соединение закрывается
+    auto flush = [](Connection& connection) {
+        std::lock_guard<std::mutex> lock(connection.writeMutex);
+        size_t written = 0;
+        if (!connection.broken &&
+            !sendSome(connection.fd, connection.output.data(), connection.output.size(), written)) {
+            LOG_DEBUG("Daemon: client went away with replies pending");
+            connection.broken = true;
+            shutdown(connection.fd, SHUT_RDWR);
+        }
+        if (connection.broken) {
+            connection.output.clear();
+        } else {
+            connection.output.erase(0, written);
+        }
+    };
+    auto hasOutput = [](Connection& connection) {
+        std::lock_guard<std::mutex> lock(connection.writeMutex);
+        return !connection.output.empty();
+    };
+
+    while (!stopping_.load()) {
+        fds.clear();
+        fds.push_back({wakePipe_[0], POLLIN, 0});
+        fds.push_back({listenFd, POLLIN, 0});
+        for (const auto& connection : connections) {
+            short events = connection->readClosed ? 0 : POLLIN;
+            if (hasOutput(*connection)) {
+                events |= POLLOUT;
+            }
+            // Закрытое на чтение соединение без хвоста ждёт только ответов пула, poll его не смотрит
+            fds.push_back({events != 0 ? connection->fd : -1, events, 0});
+        }
+
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("Error: poll failed: " << std::strerror(errno));
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            while (read(wakePipe_[0], chunk, sizeof(chunk)) > 0) {
+            }
+        }
+
+        // Индексы fds сдвинуты на два относительно connections
+        std::vector<std::shared_ptr<Connection>> alive;
+        alive.reserve(connections.size() + 1);
+        for (size_t i = 0; i < connections.size(); i++) {
+            const std::shared_ptr<Connection>& connection = connections[i];
+            const short revents = fds[i + 2].revents;
+
+            if ((fds[i + 2].events & POLLOUT) && (revents & (POLLOUT | POLLHUP | POLLERR))) {
+                flush(*connection);
+            }
+
+            if (!connection->readClosed && (revents & (POLLIN | POLLHUP | POLLERR))) {
+                ssize_t received = read(connection->fd, chunk, sizeof(chunk));
+                if (received > 0) {
+                    connection->input.append(chunk, static_cast<size_t>(received));
+                    size_t start = 0;
+                    size_t end;
+                    while ((end = connection->input.find('\n', start)) != std::string::npos) {
+                        handleLine(connection, connection->input.substr(start, end - start));
+                        start = end + 1;
+                    }
+                    connection->input.erase(0, start);
+
+                    if (connection->input.size() > kMaxLineBytes) {
+                        LOG_WARNING("Daemon: request line too long, closing connection");
+                        std::lock_guard<std::mutex> lock(connection->writeMutex);
+                        connection->broken = true;
+                        connection->output.clear();
+                        shutdown(connection->fd, SHUT_RDWR);
+                        connection->readClosed = true;
+                    }
+                } else if (received == 0 || errno != EINTR) {
+                    // Ответы на уже принятые запросы держат соединение до отправки
+                    shutdown(connection->fd, SHUT_RD);
+                    connection->readClosed = true;
+                }
+            }
+
+            // Соединение уходит из списка, когда клиент закончил, все его запросы отвечены
+            // и хвост отправлен; последний shared_ptr закрывает сокет. pending проверяется
+            // раньше хвоста: пул дописывает ответ до того, как уменьшить pending
+            if (connection->readClosed && connection->pending.load() == 0 && !hasOutput(*connection)) {
+                continue;
+            }
+            alive.push_back(connection);
+        }
+        connections.swap(alive);
+
+        if (fds[1].revents & POLLIN) {
+            int clientFd = accept(listenFd, nullptr, nullptr);
+            if (clientFd >= 0) {
+                connections.push_back(std::make_shared<Connection>(clientFd));
+            }
+        }
+    }
+    close(listenFd);
+    unlink(options_.socketPath.c_str());
+
+    // Принятые запросы дорабатываются до конца
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        stopping_.store(true);
+    }
+    queueReady_.notify_all();
+    dispatcher.join();
+
+    // Ответы на запросы, принятые до остановки, досылаются
+    for (const auto& connection : connections) {
+        while (hasOutput(*connection)) {
+            pollfd writable = {connection->fd, POLLOUT, 0};
+            if (poll(&writable, 1, kFlushTimeoutMs) <= 0) {
+                break;
+            }
+            flush(*connection);
+        }
+    }
+
+    LOG_INFO("Daemon stopped");
+    return true;
+#endif
+}
+
+void AnalysisDaemon::handleLine(const std::shared_ptr<Connection>& connection, const std::string& line) {
+    std::string text = line;
+    if (!text.empty() && text.back() == '\r') {
+        text.pop_back();
+    }
+    if (text.empty()) {
+        return;
+    }
+
+    std::istringstream stream(text);
+    std::string verb;
+    stream >> verb;
+
+    if (verb == "FORMAT") {
+        std::string format;
+        stream >> format;
+        connection->binary.store(format == "binary" || format == "bin");
+        return;
+    }
+
+    Request request;
+    request.connection = connection;
+    request.id = connection->nextRequest++;
+    request.receivedNs = nowNs();
+
+    if (verb == "STATS") {
+        replyStats(request);
+        return;
+    }
+
+    if (verb == "ANALYZE") {
+        std::getline(stream >> std::ws, request.path);
+        if (request.path.empty()) {
+            reply(request, StatusError, nullptr, "missing path");
+            return;
+        }
+    } else if (verb == "FRAME") {
+        stream >> request.frameName >> request.width >> request.height
+               >> request.stride >> request.channels;
+        if (!stream || request.frameName.empty()) {
+            reply(request, StatusError, nullptr, "expected FRAME <name> <width> <height> <stride> <channels>");
+            return;
+        }
+    } else {
+        reply(request, StatusError, nullptr, "unknown request");
+        return;
+    }
+
+    // Противодавление: при полной очереди клиент сразу узнаёт об этом и повторяет позже,
+    // вместо того чтобы задержка росла без предела
+    {
+        std::unique_lock<std::mutex> lock(queueMutex_);
+        if (queue_.size() + inFlight_ >= options_.queueCapacity) {
+            lock.unlock();
+            rejected_++;
+            reply(request, StatusBusy, nullptr, "queue full");
+            return;
+        }
+        connection->pending++;
+        queue_.push_back(std::move(request));
+    }
+    queueReady_.notify_one();
+}
+
+void AnalysisDaemon::dispatchLoop() {
+    // Каждый запрос - своя задача пула. Пока в пуле есть свободные потоки, запрос уходит
+    // сразу после приёма: ожидание попутчиков только добавило бы задержку. Когда заняты все,
+    // запросы копятся в очереди и уходят пакетом по мере освобождения потоков, по одному
+    // на поток. Группа нужна только для того, чтобы при остановке дождаться всех принятых запросов
+    ThreadPool::TaskGroup group(*pool_);
+    const size_t workers = static_cast<size_t>(pool_->threadCount());
+    std::vector<Request> batch;
+
+    while (true) {
+        batch.clear();
+        {
+            std::unique_lock<std::mutex> lock(queueMutex_);
+            queueReady_.wait(lock, [this, workers]() {
+                return queue_.empty() ? stopping_.load() : inFlight_ < workers;
+            });
+            if (queue_.empty()) {
+                break;
+            }
+
+            size_t count = std::min(std::min(queue_.size(), workers - inFlight_), options_.maxBatch);
+            for (size_t i = 0; i < count; i++) {
+                batch.push_back(std::move(queue_.front()));
+                queue_.pop_front();
+            }
+            inFlight_ += count;
+        }
+
+        batches_++;
+        for (Request& request : batch) {
+            group.run([this, request]() mutable {
+                process(request);
+                {
+                    std::lock_guard<std::mutex> lock(queueMutex_);
+                    inFlight_--;
+                }
+                // Освободился поток: диспетчер отдаёт ему следующий запрос из очереди
+                queueReady_.notify_one();
+                // Последний ответ соединения, закрытого клиентом на запись: поток
+                // ввода-вывода может его отпустить
+                if (request.connection->pending.fetch_sub(1) == 1) {
+                    wake();
+                }
+            });
+        }
+    }
+    group.wait();
+}
+
+void AnalysisDaemon::process(Request& request) {
+    AnalysisResults results{};
+    bool ok = false;
+
+    if (request.frameName.empty()) {
+        ok = ImageAnalysisCore::analyzeFile(request.path, options_.analysis, results, pool_.get());
+    } else {
+#ifndef _WIN32
+        ok = analyzeSharedFrame(request.frameName, request.width, request.height, request.stride,
+                                request.channels, options_.analysis, results, pool_.get());
+#endif
+    }
+
+    // В перцентили идут только запросы, прошедшие очередь, без мгновенных отказов
+    recordLatency(nowNs() - request.receivedNs);
+    if (ok) {
+        served_++;
+        reply(request, StatusOk, &results, std::string());
+    } else {
+        failed_++;
+        reply(request, StatusError, nullptr, "analysis failed");
+    }
+}
+
+void AnalysisDaemon::reply(Request& request, uint32_t status, const AnalysisResults* results,
+                           const std::string& message) {
+    int64_t latency = nowNs() - request.receivedNs;
+
+    std::string buffer;
+    if (request.connection->binary.load()) {
+        BinaryReply header;
+        std::memset(&header, 0, sizeof(header));
+        header.magic = kReplyMagic;
+        header.status = status;
+        header.request = request.id;
+        header.latencyNs = static_cast<uint64_t>(latency);
+        if (results) {
+            const DiameterResult& d = results->diameter_result;
+            header.idm = results->idm_value;
+            header.maxDiameter = d.maxDiameter;
+            header.area = d.area;
+            header.perimeter = d.perimeter;
+            header.circularity = d.circularity;
+            header.point1X = d.point1.x;
+            header.point1Y = d.point1.y;
+            header.point2X = d.point2.x;
+            header.point2Y = d.point2.y;
+            header.contourPoints = d.contourPoints;
+            header.objectCount = static_cast<uint32_t>(results->objects.size());
+        }
+        buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        for (uint32_t i = 0; i < header.objectCount; i++) {
+            const DiameterResult& object = results->objects[i];
+            BinaryObject record;
+            record.label = object.label;
+            record.contourPoints = object.contourPoints;
+            record.maxDiameter = object.maxDiameter;
+            record.area = object.area;
+            record.perimeter = object.perimeter;
+            record.circularity = object.circularity;
+            buffer.append(reinterpret_cast<const char*>(&record), sizeof(record));
+        }
+    } else {
+        static const char* const names[] = {"ok", "error", "busy"};
+        buffer = "{\"request\":" + std::to_string(request.id) + ",\"status\":\"" + names[status] +
+                 "\",\"latency_us\":";
+        appendNumber(buffer, latency / 1e3);
+        if (results) {
+            buffer += ",\"result\":";
+            JsonLinesSink::encodeObject(*results, buffer);
+        } else {
+            buffer += ",\"message\":\"" + message + "\"";
+        }
+        buffer += "}\n";
+    }
+
+    writeReply(*request.connection, buffer);
+}
+
+// Ответ пишется без ожидания, и поток ввода-вывода (отказы busy, STATS, ошибки разбора)
+// не стоит на медленном клиенте. Что сокет не принял, уходит в хвост соединения
+// за уже ждущими ответами, чтобы записи не перемешались, и досылается по POLLOUT
+void AnalysisDaemon::writeReply(Connection& connection, const std::string& buffer) {
+#ifndef _WIN32
+    bool queued = false;
+    {
+        std::lock_guard<std::mutex> lock(connection.writeMutex);
+        if (connection.broken) {
+            return;
+        }
+        size_t written = 0;
+        if (connection.output.empty() && !sendSome(connection.fd, buffer.data(), buffer.size(), written)) {
+            // Ответ мог уйти частично, и поток ответов уже не разобрать: соединение закрывается,
+            // цикл ввода-вывода увидит POLLHUP, а остальные ответы сразу отбрасываются
+            LOG_DEBUG("Daemon: client went away before reply");
+            connection.broken = true;
+            shutdown(connection.fd, SHUT_RDWR);
+            return;
+        }
+        if (written < buffer.size()) {
+            if (connection.output.size() + (buffer.size() - written) > kMaxOutputBytes) {
+                LOG_WARNING("Daemon: client does not read replies, closing connection");
+                connection.broken = true;
+                connection.output.clear();
+                shutdown(connection.fd, SHUT_RDWR);
+                return;
+            }
+            queued = connection.output.empty();
+            connection.output.append(buffer, written, std::string::npos);
+        }
+    }
+    // Поток ввода-вывода начинает ждать POLLOUT только после пробуждения
+    if (queued) {
+        wake();
+    }
+#else
+    (void)connection;
+    (void)buffer;
+#endif
+}
+
+// Отвечает поток ввода-вывода, в обход очереди: в формате соединения, как и анализ
+void AnalysisDaemon::replyStats(Request& request) {
+    DaemonStats current = stats();
+
+    std::string buffer;
+    if (request.connection->binary.load()) {
+        BinaryStats record;
+        std::memset(&record, 0, sizeof(record));
+        record.magic = kStatsMagic;
+        record.status = StatusOk;
+        record.request = request.id;
+        record.served = current.served;
+        record.failed = current.failed;
+        record.rejected = current.rejected;
+        record.batches = current.batches;
+        record.queueDepth = current.queueDepth;
+        record.queueCapacity = current.queueCapacity;
+        record.p50Us = current.p50Us;
+        record.p95Us = current.p95Us;
+        record.p99Us = current.p99Us;
+        record.maxUs = current.maxUs;
+        buffer.append(reinterpret_cast<const char*>(&record), sizeof(record));
+    } else {
+        buffer = "{\"request\":" + std::to_string(request.id) + ",\"status\":\"ok\",\"stats\":{";
+        buffer += "\"served\":" + std::to_string(current.served);
+        buffer += ",\"failed\":" + std::to_string(current.failed);
+        buffer += ",\"rejected\":" + std::to_string(current.rejected);
+        buffer += ",\"batches\":" + std::to_string(current.batches);
+        buffer += ",\"queue\":" + std::to_string(current.queueDepth);
+        buffer += ",\"queue_capacity\":" + std::to_string(current.queueCapacity);
+        buffer += ",\"p50_us\":";
+        appendNumber(buffer, current.p50Us);
+        buffer += ",\"p95_us\":";
+        appendNumber(buffer, current.p95Us);
+        buffer += ",\"p99_us\":";
+        appendNumber(buffer, current.p99Us);
+        buffer += ",\"max_us\":";
+        appendNumber(buffer, current.maxUs);
+        buffer += "}}\n";
+    }
+
+    writeReply(*request.connection, buffer);
+}
+
+void AnalysisDaemon::recordLatency(int64_t nanoseconds) {
+    std::lock_guard<std::mutex> lock(latencyMutex_);
+    if (latencies_.size() < kLatencySamples) {
+        latencies_.push_back(nanoseconds);
+    } else {
+        latencies_[latencyNext_] = nanoseconds;
+        latencyNext_ = (latencyNext_ + 1) % kLatencySamples;
+    }
+}
+
+DaemonStats AnalysisDaemon::stats() const {
+    DaemonStats result;
+    result.served = served_.load();
+    result.failed = failed_.load();
+    result.rejected = rejected_.load();
+    result.batches = batches_.load();
+    result.queueCapacity = options_.queueCapacity;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        result.queueDepth = queue_.size() + inFlight_;
+    }
+
+    std::vector<int64_t> samples;
+    {
+        std::lock_guard<std::mutex> lock(latencyMutex_);
+        samples = latencies_;
+    }
+    std::sort(samples.begin(), samples.end());
+    result.p50Us = percentileUs(samples, 50);
+    result.p95Us = percentileUs(samples, 95);
+    result.p99Us = percentileUs(samples, 99);
+    result.maxUs = samples.empty() ? 0.0 : samples.back() / 1e3;
+    return result;
+}
+
+void AnalysisDaemon::printStats(const DaemonStats& stats, std::ostream& out) {
+    out << "\nDaemon served " << stats.served << " requests, " << stats.failed << " failed, "
+        << stats.rejected << " rejected (queue full), " << stats.batches << " batches";
+    if (stats.batches > 0) {
+        out << ", " << std::fixed << std::setprecision(1)
+            << static_cast<double>(stats.served + stats.failed) / stats.batches << " per batch";
+    }
+    out << std::endl;
+    out << "   latency: p50 " << std::fixed << std::setprecision(2) << stats.p50Us / 1e3
+        << " ms, p95 " << stats.p95Us / 1e3 << " ms, p99 " << stats.p99Us / 1e3
+        << " ms, max " << stats.maxUs / 1e3 << " ms" << std::endl;
+}
@@ -0,0 +1,296 @@
+#include "AnalysisPipeline.h"
+#include "BoundedQueue.h"
+#include "ImageLoader.h"
+#include "Logger.h"
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <thread>
+
+namespace {
+
+struct DecodedImage {
+    std::string path;
+    cv::Mat image;
+    size_t bytes = 0;
+};
+
+struct AnalysedImage {
+    AnalysisResults results{};
+    bool valid = false;
+};
+
+class Backoff {
+private:
+    int spins_ = 0;
+    
+public:
+    void pause() {
+        if (spins_ < 64) {
+            spins_++;
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+    void reset() { spins_ = 0; }
+};
+
+template <typename T>
+void pushBlocking(BoundedQueue<T>& queue, T&& value) {
+    Backoff backoff;
+    while (!queue.tryPush(std::move(value))) {
+        backoff.pause();
+    }
+}
+
+struct DepthSampler {
+    size_t maxDepth = 0;
+    double depthSum = 0.0;
+    size_t samples = 0;
+    
+    void sample(size_t depth) {
+        maxDepth = std::max(maxDepth, depth);
+        depthSum += depth;
+        samples++;
+    }
+    
+    StageQueueStats stats(size_t capacity) const {
+        StageQueueStats result;
+        result.capacity = capacity;
+        result.maxDepth = maxDepth;
+        result.averageDepth = samples > 0 ? depthSum / samples : 0.0;
+        return result;
+    }
+};
+
+}
+
+AnalysisPipeline::AnalysisPipeline(const PipelineOptions& options, DecodeStage decode,
+                                   AnalyzeStage analyze, OutputStage output, LookupStage lookup)
+    : options_(options), decode_(decode), analyze_(analyze), output_(output), lookup_(lookup) {
+    if (options_.readers <= 0) {
+        options_.readers = 1;
+    }
+    if (options_.analyzers <= 0) {
+        options_.analyzers = std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+PipelineStats AnalysisPipeline::run(const std::vector<std::string>& paths) {
+    BoundedQueue<DecodedImage> decodeQueue(options_.queueCapacity);
+    BoundedQueue<AnalysedImage> outputQueue(options_.queueCapacity);
+    
+    std::atomic<size_t> nextPath(0);
+    std::atomic<size_t> inFlightBytes(0);
+    std::atomic<size_t> peakInFlightBytes(0);
+    std::atomic<int> activeReaders(options_.readers);
+    std::atomic<int> activeAnalyzers(options_.analyzers);
+    std::atomic<size_t> cached(0);
+    std::atomic<size_t> decoded(0);
+    std::atomic<size_t> analysed(0);
+    std::atomic<size_t> failed(0);
+    std::atomic<bool> outputDone(false);
+    size_t written = 0;
+    
+    auto start = std::chrono::steady_clock::now();
+    
+    auto updatePeak = [&](size_t current) {
+        size_t peak = peakInFlightBytes.load();
+        while (current > peak && !peakInFlightBytes.compare_exchange_weak(peak, current)) {
+        }
+    };
+    
+    auto reserve = [&](size_t bytes) {
+        Backoff backoff;
+        size_t current = inFlightBytes.load();
+        while (true) {
+            if (current > 0 && current + bytes > options_.memoryBudgetBytes) {
+                backoff.pause();
+                current = inFlightBytes.load();
+                continue;
+            }
+            if (inFlightBytes.compare_exchange_weak(current, current + bytes)) {
+                break;
+            }
+        }
+        updatePeak(current + bytes);
+    };
+    
+    auto reader = [&]() {
+        while (true) {
+            size_t index = nextPath.fetch_add(1);
+            if (index >= paths.size()) {
+                break;
+            }
+            
+            // Поиск идёт параллельно в читателях, а не до запуска конвейера
+            if (lookup_) {
+                AnalysedImage hit;
+                if (lookup_(paths[index], hit.results)) {
+                    hit.valid = true;
+                    cached++;
+                    pushBlocking(outputQueue, std::move(hit));
+                    continue;
+                }
+            }
+            
+            // Оценка по заголовку (полный кадр в оттенках серого: столько держит декодер, пока не
+            // уменьшит кадр) резервируется до декодирования одной операцией, так что несколько
+            // читателей не проходят проверку бюджета одновременно. Хотя бы одно изображение
+            // допускается всегда, даже если оно больше бюджета
+            cv::Size headerSize;
+            size_t estimate = ImageLoader::readImageSize(paths[index], headerSize) ?
+                static_cast<size_t>(headerSize.width) * headerSize.height : 0;
+            reserve(estimate);
+            
+            DecodedImage item;
+            item.path = paths[index];
+            try {
+                item.image = decode_(item.path);
+            } catch (const std::exception& e) {
+                // Не только cv::Exception: bad_alloc или ошибка файловой системы из декодера
+                // не должны завершать поток читателя. Пустой кадр анализатор считает неудачей
+                LOG_ERROR("Error decoding " << item.path << ": " << e.what());
+                item.image.release();
+            }
+            item.bytes = item.image.empty() ? 0 : item.image.total() * item.image.elemSize();
+            
+            // Резерв заменяется фактическим размером декодированного изображения
+            if (item.bytes >= estimate) {
+                updatePeak(inFlightBytes.fetch_add(item.bytes - estimate) + item.bytes - estimate);
+            } else {
+                inFlightBytes.fetch_sub(estimate - item.bytes);
+            }
+            
+            decoded++;
+            pushBlocking(decodeQueue, std::move(item));
+        }
+        activeReaders--;
+    };
+    
+    auto analyzer = [&]() {
+        Backoff backoff;
+        while (true) {
+            DecodedImage item;
+            if (!decodeQueue.tryPop(item)) {
+                if (activeReaders.load() == 0 && decodeQueue.size() == 0) {
+                    break;
+                }
+                backoff.pause();
+                continue;
+            }
+            backoff.reset();
+            
+            AnalysedImage result;
+            if (!item.image.empty()) {
+                try {
+                    result.results = analyze_(item.path, item.image);
+                    result.valid = result.results.idm_value > 0 || 
+                                   result.results.diameter_result.maxDiameter > 0;
+                } catch (const std::exception& e) {
+                    LOG_ERROR("Error analysing " << item.path << ": " << e.what());
+                    result.valid = false;
+                }
+            }
+            if (!result.valid) {
+                result.results.image_path = item.path;
+            }
+            
+            item.image.release();
+            inFlightBytes.fetch_sub(item.bytes);
+            analysed++;
+            pushBlocking(outputQueue, std::move(result));
+        }
+        activeAnalyzers--;
+    };
+    
+    auto writer = [&]() {
+        Backoff backoff;
+        while (true) {
+            AnalysedImage item;
+            if (!outputQueue.tryPop(item)) {
+                if (activeAnalyzers.load() == 0 && outputQueue.size() == 0) {
+                    break;
+                }
+                backoff.pause();
+                continue;
+            }
+            backoff.reset();
+            
+            if (item.valid) {
+                output_(item.results);
+                written++;
+            } else {
+                failed++;
+            }
+        }
+        outputDone = true;
+    };
+    
+    std::vector<std::thread> threads;
+    for (int i = 0; i < options_.readers; i++) {
+        threads.emplace_back(reader);
+    }
+    for (int i = 0; i < options_.analyzers; i++) {
+        threads.emplace_back(analyzer);
+    }
+    std::thread writerThread(writer);
+    
+    // Глубины очередей показывают узкое место: полная очередь перед стадией — стадия не успевает
+    DepthSampler decodeDepth;
+    DepthSampler outputDepth;
+    auto lastReport = std::chrono::steady_clock::now();
+    while (!outputDone.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        decodeDepth.sample(decodeQueue.size());
+        outputDepth.sample(outputQueue.size());
+        
+        auto now = std::chrono::steady_clock::now();
+        if (options_.reportIntervalMs > 0 && 
+            now - lastReport >= std::chrono::milliseconds(options_.reportIntervalMs)) {
+            lastReport = now;
+            std::cout << "[pipeline] decoded " << decoded.load() << "/" << paths.size()
+                      << ", cached " << cached.load() << ", analysed " << analysed.load()
+                      << " | decode->analyse " << decodeQueue.size() << "/" << decodeQueue.capacity()
+                      << ", analyse->output " << outputQueue.size() << "/" << outputQueue.capacity()
+                      << " | in flight " << inFlightBytes.load() / (1024 * 1024) << " MB" << std::endl;
+        }
+    }
+    
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    writerThread.join();
+    
+    PipelineStats stats;
+    stats.cached = cached.load();
+    stats.decoded = decoded.load();
+    stats.analysed = analysed.load();
+    stats.written = written;
+    stats.failed = failed.load();
+    stats.peakInFlightBytes = peakInFlightBytes.load();
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.decodeQueue = decodeDepth.stats(decodeQueue.capacity());
+    stats.outputQueue = outputDepth.stats(outputQueue.capacity());
+    return stats;
+}
+
+void AnalysisPipeline::printStats(const PipelineStats& stats) {
+    std::cout << "\nPipeline completed: " << stats.written << " written, " 
+              << stats.failed << " failed, ";
+    if (stats.cached > 0) {
+        std::cout << stats.cached << " from cache, ";
+    }
+    std::cout << std::fixed << std::setprecision(2) 
+              << stats.seconds << " s, " << std::setprecision(1)
+              << (stats.seconds > 0 ? stats.analysed / stats.seconds : 0.0) << " images/s" << std::endl;
+    std::cout << "   decode->analyse queue: max " << stats.decodeQueue.maxDepth << "/" 
+              << stats.decodeQueue.capacity << ", average " << std::setprecision(1) 
+              << stats.decodeQueue.averageDepth << std::endl;
+    std::cout << "   analyse->output queue: max " << stats.outputQueue.maxDepth << "/" 
+              << stats.outputQueue.capacity << ", average " << std::setprecision(1) 
+              << stats.outputQueue.averageDepth << std::endl;
+    std::cout << "   peak in-flight decoded memory: " 
+              << stats.peakInFlightBytes / (1024 * 1024) << " MB" << std::endl;
+}
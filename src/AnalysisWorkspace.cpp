@@ -0,0 +1,38 @@
+#include "AnalysisWorkspace.h"
+#include <memory>
+
+namespace {
+
+// Экземпляры потока живут до его завершения; depth - сколько из них сейчас заняты
+struct ThreadWorkspaces {
+    std::vector<std::unique_ptr<AnalysisWorkspace>> stack;
+    size_t depth = 0;
+};
+
+ThreadWorkspaces& threadWorkspaces() {
+    thread_local ThreadWorkspaces workspaces;
+    return workspaces;
+}
+
+}
+
+cv::Mat AnalysisWorkspace::reserve(cv::Mat& storage, int rows, int cols, int type) {
+    if (storage.type() != type || storage.rows < rows || storage.cols < cols) {
+        int storageRows = storage.type() == type ? std::max(rows, storage.rows) : rows;
+        int storageCols = storage.type() == type ? std::max(cols, storage.cols) : cols;
+        storage.create(storageRows, storageCols, type);
+    }
+    return storage(cv::Rect(0, 0, cols, rows));
+}
+
+AnalysisWorkspace::Lease::Lease() {
+    ThreadWorkspaces& workspaces = threadWorkspaces();
+    if (workspaces.depth == workspaces.stack.size()) {
+        workspaces.stack.emplace_back(new AnalysisWorkspace());
+    }
+    workspace_ = workspaces.stack[workspaces.depth++].get();
+}
+
+AnalysisWorkspace::Lease::~Lease() {
+    threadWorkspaces().depth--;
+}
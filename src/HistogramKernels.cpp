@@ -0,0 +1,516 @@
+#include "HistogramKernels.h"
+#include "AlignedBuffer.h"
+#include "Logger.h"
+#include <atomic>
+#include <cstring>
+
+// Только x86-64: scatter128 забирает индексы 64-битными _mm_cvtsi128_si64, которых нет в 32-битном режиме
+#if defined(__x86_64__) || defined(_M_X64)
+#define HISTOGRAM_KERNELS_X86 1
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+#endif
+
+namespace {
+
+std::atomic<int> g_isa(-1);
+
+int levelBitsFor(int levels) {
+    int bits = 0;
+    while ((1 << bits) < levels) {
+        bits++;
+    }
+    return bits;
+}
+
+// Соседние пиксели раскладываются по разным подгистограммам,
+// чтобы одинаковые значения не создавали зависимость store -> load
+void differenceRowScalar(const uchar* row, const uchar* neighbor, int count,
+                         int shift, int* sub, int bins) {
+    int* sub0 = sub;
+    int* sub1 = sub + bins;
+    int* sub2 = sub + 2 * bins;
+    int* sub3 = sub + 3 * bins;
+    int x = 0;
+    
+    for (; x + 4 <= count; x += 4) {
+        sub0[std::abs((row[x] >> shift) - (neighbor[x] >> shift))]++;
+        sub1[std::abs((row[x + 1] >> shift) - (neighbor[x + 1] >> shift))]++;
+        sub2[std::abs((row[x + 2] >> shift) - (neighbor[x + 2] >> shift))]++;
+        sub3[std::abs((row[x + 3] >> shift) - (neighbor[x + 3] >> shift))]++;
+    }
+    for (; x < count; x++) {
+        sub0[std::abs((row[x] >> shift) - (neighbor[x] >> shift))]++;
+    }
+}
+
+void cooccurrenceRowScalar(const uchar* row, const uchar* neighbor, int count,
+                           int shift, int levelBits, int* sub, int bins) {
+    int* sub0 = sub;
+    int* sub1 = sub + bins;
+    int* sub2 = sub + 2 * bins;
+    int* sub3 = sub + 3 * bins;
+    int x = 0;
+    
+    for (; x + 4 <= count; x += 4) {
+        sub0[((row[x] >> shift) << levelBits) | (neighbor[x] >> shift)]++;
+        sub1[((row[x + 1] >> shift) << levelBits) | (neighbor[x + 1] >> shift)]++;
+        sub2[((row[x + 2] >> shift) << levelBits) | (neighbor[x + 2] >> shift)]++;
+        sub3[((row[x + 3] >> shift) << levelBits) | (neighbor[x + 3] >> shift)]++;
+    }
+    for (; x < count; x++) {
+        sub0[((row[x] >> shift) << levelBits) | (neighbor[x] >> shift)]++;
+    }
+}
+
+#ifdef HISTOGRAM_KERNELS_X86
+
+// Индексы забираются из регистров общего назначения, без промежуточного буфера в памяти
+inline void scatterBytes(uint64_t packed, int* sub, int bins) {
+    int* sub0 = sub;
+    int* sub1 = sub + bins;
+    int* sub2 = sub + 2 * bins;
+    int* sub3 = sub + 3 * bins;
+    sub0[packed & 0xFF]++;
+    sub1[(packed >> 8) & 0xFF]++;
+    sub2[(packed >> 16) & 0xFF]++;
+    sub3[(packed >> 24) & 0xFF]++;
+    sub0[(packed >> 32) & 0xFF]++;
+    sub1[(packed >> 40) & 0xFF]++;
+    sub2[(packed >> 48) & 0xFF]++;
+    sub3[packed >> 56]++;
+}
+
+inline void scatterWords(uint64_t packed, int* sub, int bins) {
+    sub[packed & 0xFFFF]++;
+    sub[bins + ((packed >> 16) & 0xFFFF)]++;
+    sub[2 * bins + ((packed >> 32) & 0xFFFF)]++;
+    sub[3 * bins + (packed >> 48)]++;
+}
+
+inline void scatter128(__m128i packed, bool words, int* sub, int bins) {
+    uint64_t lo = static_cast<uint64_t>(_mm_cvtsi128_si64(packed));
+    uint64_t hi = static_cast<uint64_t>(_mm_cvtsi128_si64(_mm_unpackhi_epi64(packed, packed)));
+    if (words) {
+        scatterWords(lo, sub, bins);
+        scatterWords(hi, sub, bins);
+    } else {
+        scatterBytes(lo, sub, bins);
+        scatterBytes(hi, sub, bins);
+    }
+}
+
+void differenceRowSSE2(const uchar* row, const uchar* neighbor, int count,
+                       int shift, int* sub, int bins) {
+    const __m128i shiftCount = _mm_cvtsi32_si128(shift);
+    const __m128i mask = _mm_set1_epi8(static_cast<char>(0xFF >> shift));
+    int x = 0;
+    
+    for (; x + 16 <= count; x += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(neighbor + x));
+        a = _mm_and_si128(_mm_srl_epi16(a, shiftCount), mask);
+        b = _mm_and_si128(_mm_srl_epi16(b, shiftCount), mask);
+        __m128i d = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+        scatter128(d, false, sub, bins);
+    }
+    differenceRowScalar(row + x, neighbor + x, count - x, shift, sub, bins);
+}
+
+void cooccurrenceRowSSE2(const uchar* row, const uchar* neighbor, int count,
+                         int shift, int levelBits, int* sub, int bins) {
+    const __m128i shiftCount = _mm_cvtsi32_si128(shift);
+    const __m128i bitsCount = _mm_cvtsi32_si128(levelBits);
+    const __m128i mask = _mm_set1_epi8(static_cast<char>(0xFF >> shift));
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    
+    for (; x + 16 <= count; x += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(neighbor + x));
+        a = _mm_and_si128(_mm_srl_epi16(a, shiftCount), mask);
+        b = _mm_and_si128(_mm_srl_epi16(b, shiftCount), mask);
+        __m128i lo = _mm_or_si128(_mm_sll_epi16(_mm_unpacklo_epi8(a, zero), bitsCount),
+                                  _mm_unpacklo_epi8(b, zero));
+        __m128i hi = _mm_or_si128(_mm_sll_epi16(_mm_unpackhi_epi8(a, zero), bitsCount),
+                                  _mm_unpackhi_epi8(b, zero));
+        scatter128(lo, true, sub, bins);
+        scatter128(hi, true, sub, bins);
+    }
+    cooccurrenceRowScalar(row + x, neighbor + x, count - x, shift, levelBits, sub, bins);
+}
+
+TARGET_AVX2
+void differenceRowAVX2(const uchar* row, const uchar* neighbor, int count,
+                       int shift, int* sub, int bins) {
+    const __m128i shiftCount = _mm_cvtsi32_si128(shift);
+    const __m256i mask = _mm256_set1_epi8(static_cast<char>(0xFF >> shift));
+    int x = 0;
+    
+    for (; x + 32 <= count; x += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + x));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(neighbor + x));
+        a = _mm256_and_si256(_mm256_srl_epi16(a, shiftCount), mask);
+        b = _mm256_and_si256(_mm256_srl_epi16(b, shiftCount), mask);
+        __m256i d = _mm256_or_si256(_mm256_subs_epu8(a, b), _mm256_subs_epu8(b, a));
+        scatter128(_mm256_castsi256_si128(d), false, sub, bins);
+        scatter128(_mm256_extracti128_si256(d, 1), false, sub, bins);
+    }
+    differenceRowSSE2(row + x, neighbor + x, count - x, shift, sub, bins);
+}
+
+TARGET_AVX2
+void cooccurrenceRowAVX2(const uchar* row, const uchar* neighbor, int count,
+                         int shift, int levelBits, int* sub, int bins) {
+    const __m128i shiftCount = _mm_cvtsi32_si128(shift);
+    const __m128i bitsCount = _mm_cvtsi32_si128(levelBits);
+    int x = 0;
+    
+    for (; x + 16 <= count; x += 16) {
+        __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x)));
+        __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(neighbor + x)));
+        a = _mm256_srl_epi16(a, shiftCount);
+        b = _mm256_srl_epi16(b, shiftCount);
+        __m256i index = _mm256_or_si256(_mm256_sll_epi16(a, bitsCount), b);
+        scatter128(_mm256_castsi256_si128(index), true, sub, bins);
+        scatter128(_mm256_extracti128_si256(index, 1), true, sub, bins);
+    }
+    cooccurrenceRowScalar(row + x, neighbor + x, count - x, shift, levelBits, sub, bins);
+}
+
+#endif
+
+AlignedBuffer<int>& scratchBuffer(size_t size) {
+    thread_local AlignedBuffer<int> scratch;
+    scratch.resize(size);
+    scratch.zero();
+    return scratch;
+}
+
+// Строк цветного кадра на один вызов cvtColor в accumulateFrame: блок остаётся в L1/L2
+// до подсчёта гистограмм
+const int kBlockRows = 16;
+
+// Яркость без квантования, по подгистограммам как в differenceRowScalar
+void intensityRow(const uchar* row, int count, int* sub) {
+    int* sub0 = sub;
+    int* sub1 = sub + 256;
+    int* sub2 = sub + 2 * 256;
+    int* sub3 = sub + 3 * 256;
+    int x = 0;
+    
+    for (; x + 4 <= count; x += 4) {
+        sub0[row[x]]++;
+        sub1[row[x + 1]]++;
+        sub2[row[x + 2]]++;
+        sub3[row[x + 3]]++;
+    }
+    for (; x < count; x++) {
+        sub0[row[x]]++;
+    }
+}
+
+// Пары строки с соседями справа, снизу, снизу-справа и сверху-справа;
+// above и below равны nullptr за краем изображения
+void directionsRow(const uchar* row, const uchar* above, const uchar* below, int cols, int shift,
+                   int levels, int* sub, HistogramKernels::DifferenceRowFn kernel) {
+    const size_t directionSize = static_cast<size_t>(HistogramKernels::kSubHistograms) * levels;
+    
+    kernel(row, row + 1, cols - 1, shift, sub, levels);
+    if (below) {
+        kernel(row, below, cols, shift, sub + directionSize, levels);
+        kernel(row, below + 1, cols - 1, shift, sub + 2 * directionSize, levels);
+    }
+    if (above) {
+        kernel(row, above + 1, cols - 1, shift, sub + 3 * directionSize, levels);
+    }
+}
+
+}
+
+KernelIsa HistogramKernels::detectIsa() {
+#ifdef HISTOGRAM_KERNELS_X86
+    if (cv::checkHardwareSupport(CV_CPU_AVX2)) {
+        return KernelIsa::AVX2;
+    }
+    if (cv::checkHardwareSupport(CV_CPU_SSE2)) {
+        return KernelIsa::SSE2;
+    }
+#endif
+    return KernelIsa::Scalar;
+}
+
+KernelIsa HistogramKernels::activeIsa() {
+    int isa = g_isa.load(std::memory_order_relaxed);
+    if (isa < 0) {
+        isa = static_cast<int>(detectIsa());
+        g_isa.store(isa, std::memory_order_relaxed);
+    }
+    return static_cast<KernelIsa>(isa);
+}
+
+void HistogramKernels::setIsa(KernelIsa isa) {
+    if (isa != KernelIsa::Scalar && static_cast<int>(isa) > static_cast<int>(detectIsa())) {
+        LOG_WARNING(isaName(isa) << " is not supported on this CPU, using "
+                    << isaName(detectIsa()));
+        isa = detectIsa();
+    }
+    g_isa.store(static_cast<int>(isa), std::memory_order_relaxed);
+}
+
+const char* HistogramKernels::isaName(KernelIsa isa) {
+    switch (isa) {
+        case KernelIsa::AVX2: return "AVX2";
+        case KernelIsa::SSE2: return "SSE2";
+        default:              return "scalar";
+    }
+}
+
+HistogramKernels::DifferenceRowFn HistogramKernels::differenceRow(KernelIsa isa) {
+#ifdef HISTOGRAM_KERNELS_X86
+    if (isa == KernelIsa::AVX2) {
+        return differenceRowAVX2;
+    }
+    if (isa == KernelIsa::SSE2) {
+        return differenceRowSSE2;
+    }
+#endif
+    (void)isa;
+    return differenceRowScalar;
+}
+
+HistogramKernels::CooccurrenceRowFn HistogramKernels::cooccurrenceRow(KernelIsa isa) {
+#ifdef HISTOGRAM_KERNELS_X86
+    if (isa == KernelIsa::AVX2) {
+        return cooccurrenceRowAVX2;
+    }
+    if (isa == KernelIsa::SSE2) {
+        return cooccurrenceRowSSE2;
+    }
+#endif
+    (void)isa;
+    return cooccurrenceRowScalar;
+}
+
+void HistogramKernels::mergeSubHistograms(const int* subHistograms, int bins, int* output) {
+    for (int s = 0; s < kSubHistograms; s++) {
+        const int* source = subHistograms + static_cast<size_t>(s) * bins;
+        for (int k = 0; k < bins; k++) {
+            output[k] += source[k];
+        }
+    }
+}
+
+int HistogramKernels::accumulateDifferences(const cv::Mat& image, int dx, int dy, int levels,
+                                            int* histogram, KernelIsa isa) {
+    const int shift = 8 - levelBitsFor(levels);
+    const int minY = std::max(0, -dy);
+    const int maxY = image.rows - std::max(0, dy);
+    const int minX = std::max(0, -dx);
+    const int maxX = image.cols - std::max(0, dx);
+    if (maxY <= minY || maxX <= minX) {
+        return 0;
+    }
+    
+    AlignedBuffer<int>& sub = scratchBuffer(static_cast<size_t>(kSubHistograms) * levels);
+    DifferenceRowFn kernel = differenceRow(isa);
+    
+    for (int y = minY; y < maxY; y++) {
+        const uchar* row = image.ptr<uchar>(y) + minX;
+        const uchar* neighborRow = image.ptr<uchar>(y + dy) + minX + dx;
+        kernel(row, neighborRow, maxX - minX, shift, sub.data(), levels);
+    }
+    
+    mergeSubHistograms(sub.data(), levels, histogram);
+    return (maxY - minY) * (maxX - minX);
+}
+
+int HistogramKernels::accumulateCooccurrence(const cv::Mat& image, int dx, int dy, int levels,
+                                             int* glcm, KernelIsa isa) {
+    const int levelBits = levelBitsFor(levels);
+    const int shift = 8 - levelBits;
+    const int bins = levels * levels;
+    const int minY = std::max(0, -dy);
+    const int maxY = image.rows - std::max(0, dy);
+    const int minX = std::max(0, -dx);
+    const int maxX = image.cols - std::max(0, dx);
+    if (maxY <= minY || maxX <= minX) {
+        return 0;
+    }
+    
+    AlignedBuffer<int>& sub = scratchBuffer(static_cast<size_t>(kSubHistograms) * bins);
+    CooccurrenceRowFn kernel = cooccurrenceRow(isa);
+    
+    for (int y = minY; y < maxY; y++) {
+        const uchar* row = image.ptr<uchar>(y) + minX;
+        const uchar* neighborRow = image.ptr<uchar>(y + dy) + minX + dx;
+        kernel(row, neighborRow, maxX - minX, shift, levelBits, sub.data(), bins);
+    }
+    
+    mergeSubHistograms(sub.data(), bins, glcm);
+    return (maxY - minY) * (maxX - minX);
+}
+
+void HistogramKernels::accumulateDirections(const cv::Mat& image, int yStart, int yEnd, int levels,
+                                            int* histograms, KernelIsa isa) {
+    const int shift = 8 - levelBitsFor(levels);
+    const int rows = image.rows;
+    const size_t directionSize = static_cast<size_t>(kSubHistograms) * levels;
+    
+    AlignedBuffer<int>& sub = scratchBuffer(4 * directionSize);
+    DifferenceRowFn kernel = differenceRow(isa);
+    
+    for (int y = yStart; y < yEnd; y++) {
+        const uchar* above = y > 0 ? image.ptr<uchar>(y - 1) : nullptr;
+        const uchar* below = y + 1 < rows ? image.ptr<uchar>(y + 1) : nullptr;
+        directionsRow(image.ptr<uchar>(y), above, below, image.cols, shift, levels, sub.data(), kernel);
+    }
+    
+    for (int d = 0; d < 4; d++) {
+        mergeSubHistograms(sub.data() + d * directionSize, levels, histograms + d * levels);
+    }
+}
+
+void HistogramKernels::accumulateFrame(const cv::Mat& image, cv::Mat& gray, int yStart, int yEnd, int levels,
+                                       int* histograms, int* intensity, KernelIsa isa) {
+    const int shift = 8 - levelBitsFor(levels);
+    const int rows = image.rows;
+    const int cols = image.cols;
+    const size_t directionSize = static_cast<size_t>(kSubHistograms) * levels;
+    const bool color = image.channels() != 1;
+    const int code = image.channels() == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY;
+    
+    AlignedBuffer<int>& sub = scratchBuffer(4 * directionSize + kSubHistograms * 256);
+    int* intensitySub = sub.data() + 4 * directionSize;
+    DifferenceRowFn kernel = differenceRow(isa);
+    const cv::Mat& source = color ? gray : image;
+    
+    // Строки соседних полос над и под своей: их переводит и соседняя полоса, но в свой gray
+    // она может ещё не успеть записать, поэтому каждая полоса держит свою копию
+    thread_local AlignedBuffer<uchar> halo;
+    const uchar* haloAbove = nullptr;
+    const uchar* haloBelow = nullptr;
+    
+    auto convert = [&](int y0, int y1, uchar* target, size_t step) {
+        cv::Mat destination(y1 - y0, cols, CV_8UC1, target, step);
+        cv::cvtColor(image.rowRange(y0, y1), destination, code);
+    };
+    
+    if (color) {
+        halo.resize(2 * static_cast<size_t>(cols));
+        if (yStart > 0) {
+            convert(yStart - 1, yStart, halo.data(), cols);
+            haloAbove = halo.data();
+        }
+    }
+    
+    int next = yStart;
+    for (int block = yStart; block < yEnd; block += kBlockRows) {
+        const int blockEnd = std::min(yEnd, block + kBlockRows);
+        if (color) {
+            convert(block, blockEnd, gray.ptr<uchar>(block), gray.step);
+            if (blockEnd == yEnd && yEnd < rows) {
+                convert(yEnd, yEnd + 1, halo.data() + cols, cols);
+                haloBelow = halo.data() + cols;
+            }
+        }
+        
+        // Последней строке блока нужна первая строка следующего
+        const int ready = blockEnd == yEnd ? yEnd : blockEnd - 1;
+        for (; next < ready; next++) {
+            const uchar* row = source.ptr<uchar>(next);
+            const uchar* above = nullptr;
+            const uchar* below = nullptr;
+            if (next > 0) {
+                above = (next > yStart || !color) ? source.ptr<uchar>(next - 1) : haloAbove;
+            }
+            if (next + 1 < rows) {
+                below = (next + 1 < yEnd || !color) ? source.ptr<uchar>(next + 1) : haloBelow;
+            }
+            directionsRow(row, above, below, cols, shift, levels, sub.data(), kernel);
+            intensityRow(row, cols, intensitySub);
+        }
+    }
+    
+    for (int d = 0; d < 4; d++) {
+        mergeSubHistograms(sub.data() + d * directionSize, levels, histograms + d * levels);
+    }
+    mergeSubHistograms(intensitySub, 256, intensity);
+}
+
+void HistogramKernels::accumulateOffsets(const cv::Mat& image, int yStart, int yEnd, int distances, int levels,
+                                         int* histograms, KernelIsa isa) {
+    const int shift = 8 - levelBitsFor(levels);
+    const int cols = image.cols;
+    const size_t directionSize = static_cast<size_t>(kSubHistograms) * levels;
+    const size_t distanceSize = 4 * directionSize;
+    
+    AlignedBuffer<int>& sub = scratchBuffer(distances * distanceSize);
+    DifferenceRowFn kernel = differenceRow(isa);
+    
+    // Каждая строка квантуется один раз в кольцо из distances + 1 строк, а не заново в каждом
+    // из 4 * distances сравнений; ядрам квантованные строки передаются со сдвигом 0.
+    // При 256 уровнях квантовать нечего, и строки берутся прямо из изображения
+    thread_local AlignedBuffer<uchar> quantized;
+    const int ringRows = distances + 1;
+    if (shift > 0) {
+        quantized.resize(static_cast<size_t>(ringRows) * cols);
+    }
+    auto quantizedRow = [&](int y) -> const uchar* {
+        if (shift == 0) {
+            return image.ptr<uchar>(y);
+        }
+        return quantized.data() + static_cast<size_t>(y % ringRows) * cols;
+    };
+    auto quantize = [&](int y) {
+        if (shift > 0) {
+            const uchar* source = image.ptr<uchar>(y);
+            uchar* target = quantized.data() + static_cast<size_t>(y % ringRows) * cols;
+            // По 8 пикселей в 64-битном слове: маска убирает биты, перешедшие из соседнего байта
+            const uint64_t mask = 0x0101010101010101ull * (0xFFu >> shift);
+            int x = 0;
+            for (; x + 8 <= cols; x += 8) {
+                uint64_t packed;
+                std::memcpy(&packed, source + x, sizeof(packed));
+                packed = (packed >> shift) & mask;
+                std::memcpy(target + x, &packed, sizeof(packed));
+            }
+            for (; x < cols; x++) {
+                target[x] = static_cast<uchar>(source[x] >> shift);
+            }
+        }
+    };
+    
+    // Строки над полосой нужны её первым строкам
+    for (int y = std::max(0, yStart - distances); y < yStart; y++) {
+        quantize(y);
+    }
+    
+    for (int y = yStart; y < yEnd; y++) {
+        quantize(y);
+        const uchar* row = quantizedRow(y);
+        for (int d = 1; d <= distances; d++) {
+            int* distanceSub = sub.data() + (d - 1) * distanceSize;
+            const uchar* above = d <= y ? quantizedRow(y - d) : nullptr;
+            if (above) {
+                kernel(above, row, cols, 0, distanceSub + directionSize, levels);
+            }
+            if (d >= cols) {
+                continue;
+            }
+            kernel(row, row + d, cols - d, 0, distanceSub, levels);
+            if (above) {
+                kernel(above, row + d, cols - d, 0, distanceSub + 2 * directionSize, levels);
+                kernel(row, above + d, cols - d, 0, distanceSub + 3 * directionSize, levels);
+            }
+        }
+    }
+    
+    for (int h = 0; h < 4 * distances; h++) {
+        mergeSubHistograms(sub.data() + h * directionSize, levels, histograms + h * levels);
+    }
+}
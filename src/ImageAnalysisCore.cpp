@@ -0,0 +1,330 @@
+#include "ImageAnalysisCore.h"
+#include "AnalysisWorkspace.h"
+#include "ImageLoader.h"
+#include "TextureAnalyzer.h"
+#include "MorphologyAnalyzer.h"
+#include "TiledAnalyzer.h"
+#include "ResultCache.h"
+#include "VisualizationRenderer.h"
+#include "ThreadPool.h"
+#include "Logger.h"
+#include "StageProfiler.h"
+#include <atomic>
+#include <sstream>
+
+namespace {
+
+// Кадры анализа крупнее этого порога (после уменьшения до analysisSize) обходятся
+// несколькими задачами пула (полосы строк)
+const size_t kLargeImagePixels = 4 * 1024 * 1024;
+
+bool pyramidEnabled(const AnalysisOptions& options) {
+    return options.textureDistances > 1 || options.textureScales > 1;
+}
+
+// Основание пирамиды крупнее кадра анализа; 0 - пирамида строится от самого кадра анализа
+int pyramidBaseSize(const AnalysisOptions& options) {
+    if (!pyramidEnabled(options) || options.analysisSize <= 0 || options.textureBaseSize <= options.analysisSize) {
+        return 0;
+    }
+    return options.textureBaseSize;
+}
+
+void resetResults(AnalysisResults& results) {
+    results.idm_value = 0.0;
+    results.diameter_result = DiameterResult();
+    results.objects.clear();
+    results.texture_pyramid = TexturePyramid();
+    results.texture_interpretation.clear();
+    results.size_interpretation.clear();
+}
+
+// Кадр CV_8UC1, BGR или BGRA. Цветной кадр уменьшается до перевода в серый, а перевод,
+// гистограммы разностей и гистограмма яркости считаются одним проходом sweepFrame.
+// Порог Оцу берётся из этой гистограммы, и бинаризации остаётся один проход порога
+void analyzeFrame(const cv::Mat& image, const AnalysisOptions& options,
+                  AnalysisResults& results, ThreadPool* pool, AnalysisWorkspace& workspace) {
+    // Небольшие изображения анализируются на месте, без копии
+    cv::Mat small = ImageLoader::resizeImage(image, options.analysisSize,
+                                             image.channels() == 1 ? workspace.resized : workspace.resizedColor);
+
+    LOG_INFO("\nTexture analysis...");
+    cv::Mat gray;
+    ThreadPool* stripePool = small.total() >= kLargeImagePixels ? pool : nullptr;
+    results.idm_value = TextureAnalyzer::sweepFrame(small, options.levels, workspace, gray, stripePool);
+    if (gray.empty()) {
+        return;
+    }
+    results.texture_interpretation = ImageAnalysisCore::interpretIDM(results.idm_value);
+    if (pyramidEnabled(options)) {
+        cv::Mat base = gray;
+        if (pyramidBaseSize(options) > 0 && std::max(image.cols, image.rows) > std::max(gray.cols, gray.rows)) {
+            base = ImageLoader::resizeImage(image, options.textureBaseSize,
+                                            image.channels() == 1 ? workspace.pyramidBase : workspace.pyramidBaseColor);
+            if (base.channels() != 1) {
+                base = ImageLoader::convertToGrayscale(base, workspace.pyramidBase);
+            }
+        }
+        ThreadPool* pyramidPool = base.total() >= kLargeImagePixels ? pool : nullptr;
+        results.texture_pyramid = TextureAnalyzer::analyzePyramid(base, options.levels, options.textureDistances,
+                                                                  options.textureScales, workspace, pyramidPool);
+    }
+
+    int threshold;
+    {
+        StageProfiler::Scope timing(Stage::Otsu);
+        threshold = MorphologyAnalyzer::otsuThreshold(workspace.intensity);
+    }
+    cv::Mat binaryImage = MorphologyAnalyzer::binarizeImage(gray, threshold, workspace.binary);
+    ImageAnalysisCore::analyzeMask(binaryImage, gray, options, results, workspace);
+}
+
+void analyzeTiled(const std::string& path, const AnalysisOptions& options, AnalysisResults& results) {
+    std::unique_ptr<TileSource> source = TileSource::open(path, options.rawFrameSize);
+    if (!source) {
+        return;
+    }
+
+    TiledOptions tiledOptions;
+    tiledOptions.tileSize = options.tileSize;
+    tiledOptions.levels = options.levels;
+    TiledAnalyzer analyzer(tiledOptions);
+    TiledResults tiled;
+    if (!analyzer.analyze(*source, tiled)) {
+        return;
+    }
+
+    results.idm_value = tiled.idm;
+    results.texture_interpretation = ImageAnalysisCore::interpretIDM(results.idm_value);
+    results.diameter_result = tiled.diameter;
+    if (tiled.objectCount > 0) {
+        results.size_interpretation = ImageAnalysisCore::interpretSize(
+            results.diameter_result.maxDiameter, results.diameter_result.area);
+    } else {
+        results.size_interpretation = "No objects detected";
+    }
+}
+
+// Всё, от чего зависит результат при тех же байтах файла; входит в ключ кэша
+std::string cacheParameters(const AnalysisOptions& options) {
+    std::ostringstream parameters;
+    parameters << "levels=" << options.levels
+               << ";directions=4;threshold=otsu;resize=" << options.analysisSize
+               << ";tile=" << options.tileSize
+               << ";objects=" << (options.allObjects ? options.minObjectPixels : -1)
+               << ";raw=" << options.rawFrameSize.width << "x" << options.rawFrameSize.height;
+    // Точные режимы дают одинаковый диаметр и прежний ключ
+    if (options.diameterMode == DiameterMode::Approximate) {
+        parameters << ";diameter=approx" << options.diameterDirections;
+    }
+    if (pyramidEnabled(options)) {
+        parameters << ";pyramid=" << options.textureDistances << "x" << options.textureScales;
+        if (pyramidBaseSize(options) > 0) {
+            parameters << ";pyramid_base=" << pyramidBaseSize(options);
+        }
+    }
+    return parameters.str();
+}
+
+}
+
+std::string ImageAnalysisCore::interpretIDM(double idm) {
+    if (idm >= 0.8) {
+        return "Very homogeneous texture";
+    } else if (idm >= 0.6) {
+        return "Moderately homogeneous texture";
+    } else if (idm >= 0.4) {
+        return "Heterogeneous texture with variations";
+    } else if (idm >= 0.2) {
+        return "Highly heterogeneous texture";
+    } else {
+        return "Very complex, chaotic texture";
+    }
+}
+
+std::string ImageAnalysisCore::interpretSize(double diameter, double area) {
+    std::string result = "Object ";
+
+    if (diameter < 50) {
+        result += "small size";
+    } else if (diameter < 150) {
+        result += "medium size";
+    } else {
+        result += "large size";
+    }
+
+    result += " (diameter: " + std::to_string(static_cast<int>(diameter)) + " pixels)";
+    return result;
+}
+
+bool ImageAnalysisCore::succeeded(const AnalysisResults& results) {
+    return results.idm_value > 0 || results.diameter_result.maxDiameter > 0;
+}
+
+cv::Mat ImageAnalysisCore::loadGray(const std::string& path, const AnalysisOptions& options) {
+    // Несжатые кадры отображаются в память без копирования
+    cv::Mat grayImage = ImageLoader::mapImage(path, options.rawFrameSize);
+    if (!grayImage.empty()) {
+        return grayImage;
+    }
+
+    // Анализ всё равно идёт на analysisSize, поэтому декодирование сразу в сером и с уменьшением.
+    // Полноразмерный буфер декодера здесь не виден; конвейер резервирует его по заголовку файла
+    const int baseSize = pyramidBaseSize(options);
+    grayImage = ImageLoader::loadGrayscale(path, baseSize > 0 ? baseSize : options.analysisSize);
+    if (grayImage.empty()) {
+        LOG_ERROR("Failed to load image");
+    }
+    return grayImage;
+}
+
+void ImageAnalysisCore::analyzeMask(const cv::Mat& binaryImage, const cv::Mat& grayImage,
+                                    const AnalysisOptions& options, AnalysisResults& results,
+                                    AnalysisWorkspace& workspace) {
+    LOG_INFO("\nMorphological analysis...");
+
+    results.diameter_result = DiameterResult();
+    results.objects.clear();
+    results.size_interpretation.clear();
+
+    std::vector<std::vector<cv::Point>>& contours = workspace.contours;
+    MorphologyAnalyzer::findContours(binaryImage, contours);
+
+    if (!contours.empty()) {
+        int largestIndex = MorphologyAnalyzer::findLargestContour(contours);
+        if (largestIndex >= 0) {
+            results.diameter_result = MorphologyAnalyzer::calculateMaxDiameter(
+                contours[largestIndex], options.diameterMode, options.diameterDirections);
+            results.size_interpretation = interpretSize(results.diameter_result.maxDiameter,
+                                                        results.diameter_result.area);
+
+            if (options.visualizer) {
+                options.visualizer->submit(results.image_path, grayImage, contours[largestIndex],
+                                           results.diameter_result);
+            }
+        }
+    } else {
+        LOG_INFO("No objects found in image");
+        results.size_interpretation = "No objects detected";
+    }
+
+    if (options.allObjects) {
+        MorphologyAnalyzer::analyzeObjects(binaryImage, workspace, results.objects, options.minObjectPixels,
+                                           options.diameterMode, options.diameterDirections);
+    }
+}
+
+std::string ImageAnalysisCore::cacheKey(const std::string& path, const AnalysisOptions& options) {
+    return options.cache ? ResultCache::makeKey(path, cacheParameters(options)) : std::string();
+}
+
+bool ImageAnalysisCore::analyzeFile(const std::string& path, const AnalysisOptions& options,
+                                    AnalysisResults& results, ThreadPool* pool) {
+    LOG_INFO("\nStarting image analysis: " << path);
+    LOG_INFO(std::string(60, '-'));
+
+    resetResults(results);
+    results.image_path = path;
+
+    // При попадании изображение не декодируется вовсе: ключ строится по байтам файла
+    std::string key = cacheKey(path, options);
+    if (options.cache && options.cache->lookup(key, path, results)) {
+        LOG_INFO("Result taken from cache");
+        return true;
+    }
+
+    try {
+        if (options.tileSize > 0) {
+            analyzeTiled(path, options, results);
+        } else {
+            cv::Mat grayImage = loadGray(path, options);
+            if (grayImage.empty()) {
+                return false;
+            }
+            AnalysisWorkspace::Lease workspace;
+            analyzeFrame(grayImage, options, results, pool, *workspace);
+        }
+    } catch (const cv::Exception& e) {
+        LOG_ERROR("Error analysing " << path << ": " << e.what());
+        return false;
+    }
+
+    if (!succeeded(results)) {
+        return false;
+    }
+    if (options.cache) {
+        options.cache->store(key, results);
+    }
+    return true;
+}
+
+bool ImageAnalysisCore::analyzeImage(const cv::Mat& image, const AnalysisOptions& options,
+                                     AnalysisResults& results, ThreadPool* pool) {
+    resetResults(results);
+    if (image.empty() || image.depth() != CV_8U) {
+        LOG_ERROR("Error: Image must be 8-bit");
+        return false;
+    }
+
+    try {
+        AnalysisWorkspace::Lease workspace;
+        analyzeFrame(image, options, results, pool, *workspace);
+    } catch (const cv::Exception& e) {
+        LOG_ERROR("Error analysing image: " << e.what());
+        return false;
+    }
+
+    return succeeded(results);
+}
+
+bool ImageAnalysisCore::analyzeBuffer(const uint8_t* pixels, int width, int height, size_t stride,
+                                      int channels, const AnalysisOptions& options,
+                                      AnalysisResults& results, ThreadPool* pool) {
+    if (!pixels || width <= 0 || height <= 0 || (channels != 1 && channels != 3 && channels != 4) ||
+        stride < static_cast<size_t>(width) * channels) {
+        resetResults(results);
+        LOG_ERROR("Error: Invalid image buffer");
+        return false;
+    }
+
+    // Заголовок поверх чужой памяти: OpenCV только читает её и не освобождает
+    cv::Mat view(height, width, CV_8UC(channels), const_cast<uint8_t*>(pixels), stride);
+    return analyzeImage(view, options, results, pool);
+}
+
+size_t ImageAnalysisCore::analyzeBatch(const std::vector<std::string>& paths, const AnalysisOptions& options,
+                                       ThreadPool* pool, const BatchCallback& callback) {
+    std::atomic<size_t> succeededCount(0);
+
+    auto analyzeOne = [&](size_t index) {
+        AnalysisResults results{};
+        if (analyzeFile(paths[index], options, results, pool)) {
+            succeededCount++;
+        }
+        if (callback) {
+            callback(index, results);
+        }
+    };
+
+    if (pool) {
+        ThreadPool::TaskGroup group(*pool);
+        for (size_t i = 0; i < paths.size(); i++) {
+            group.run([&analyzeOne, i]() { analyzeOne(i); });
+        }
+        group.wait();
+    } else {
+        for (size_t i = 0; i < paths.size(); i++) {
+            analyzeOne(i);
+        }
+    }
+
+    return succeededCount.load();
+}
+
+size_t ImageAnalysisCore::analyzeBatch(const std::vector<std::string>& paths, const AnalysisOptions& options,
+                                       std::vector<AnalysisResults>& results, ThreadPool* pool) {
+    results.resize(paths.size());
+    return analyzeBatch(paths, options, pool, [&results](size_t index, AnalysisResults& result) {
+        results[index] = std::move(result);
+    });
+}
@@ -1,40 +1,452 @@
 #include "ImageLoader.h"
+#include "AnalysisWorkspace.h"
+#include "Logger.h"
+#include "StageProfiler.h"
+#include <cctype>
+#include <cstring>
+#include <climits>
+#include <fstream>
+#include <sstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+uint32_t bigEndian(const unsigned char* bytes, int count) {
+    uint32_t value = 0;
+    for (int i = 0; i < count; i++) {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+uint32_t littleEndian(const unsigned char* bytes, int count) {
+    uint32_t value = 0;
+    for (int i = count - 1; i >= 0; i--) {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+// Обход маркеров до первого SOFn; APPn (в том числе EXIF) пропускаются по длине
+bool readJpegSize(std::ifstream& file, cv::Size& size) {
+    file.clear();
+    file.seekg(2);
+    
+    while (file) {
+        if (file.get() != 0xFF) {
+            return false;
+        }
+        int marker = file.get();
+        while (marker == 0xFF) {
+            marker = file.get();
+        }
+        if (marker == EOF || marker == 0xD9 || marker == 0xDA) {
+            return false;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+            continue;
+        }
+        
+        unsigned char length[2];
+        if (!file.read(reinterpret_cast<char*>(length), 2)) {
+            return false;
+        }
+        int segmentLength = static_cast<int>(bigEndian(length, 2));
+        if (segmentLength < 2) {
+            return false;
+        }
+        
+        bool startOfFrame = marker >= 0xC0 && marker <= 0xCF && 
+                            marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if (startOfFrame) {
+            unsigned char frame[5];
+            if (!file.read(reinterpret_cast<char*>(frame), 5)) {
+                return false;
+            }
+            size = cv::Size(static_cast<int>(bigEndian(frame + 3, 2)), 
+                            static_cast<int>(bigEndian(frame + 1, 2)));
+            return true;
+        }
+        file.seekg(segmentLength - 2, std::ios::cur);
+    }
+    return false;
+}
+
+// Числа заголовка PNM после магической строки; поток остаётся сразу за
+// единственным пробельным символом после последнего числа
+bool readPnmHeader(std::ifstream& file, int* values, int count) {
+    file.clear();
+    file.seekg(2);
+    
+    for (int i = 0; i < count; i++) {
+        int c = file.get();
+        while (c == '#' || std::isspace(c)) {
+            if (c == '#') {
+                while (c != '\n' && c != EOF) {
+                    c = file.get();
+                }
+            }
+            c = file.get();
+        }
+        if (!std::isdigit(c)) {
+            return false;
+        }
+        values[i] = 0;
+        while (std::isdigit(c)) {
+            if (values[i] > (1 << 27)) {
+                return false;
+            }
+            values[i] = values[i] * 10 + (c - '0');
+            c = file.get();
+        }
+    }
+    return true;
+}
+
+bool readPnmSize(std::ifstream& file, cv::Size& size) {
+    int values[2];
+    if (!readPnmHeader(file, values, 2)) {
+        return false;
+    }
+    size = cv::Size(values[0], values[1]);
+    return true;
+}
+
+// Заголовок NPY: магическая строка, версия, длина и словарь Python в виде текста.
+// Поддерживаются только C-порядок, uint8 и форма (h, w) или (h, w, 1)
+bool readNpyHeader(std::ifstream& file, cv::Size& size, size_t& offset) {
+    unsigned char preamble[12];
+    file.clear();
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char*>(preamble), sizeof(preamble)) || 
+        std::memcmp(preamble, "\x93NUMPY", 6) != 0) {
+        return false;
+    }
+    
+    size_t headerLength = preamble[6] == 1 ? littleEndian(preamble + 8, 2) : littleEndian(preamble + 8, 4);
+    size_t headerStart = preamble[6] == 1 ? 10 : 12;
+    if (headerLength > 65536) {
+        return false;
+    }
+    
+    std::string header(headerLength, '\0');
+    file.seekg(headerStart);
+    if (!file.read(&header[0], headerLength)) {
+        return false;
+    }
+    
+    size_t descr = header.find("'descr'");
+    if (descr == std::string::npos) {
+        return false;
+    }
+    size_t quote = header.find('\'', header.find(':', descr));
+    if (quote == std::string::npos) {
+        return false;
+    }
+    std::string type = header.substr(quote + 1, header.find('\'', quote + 1) - quote - 1);
+    if (type != "|u1" && type != "<u1" && type != ">u1" && type != "u1") {
+        return false;
+    }
+    
+    size_t fortran = header.find("'fortran_order'");
+    size_t order = fortran == std::string::npos ? fortran : header.find_first_not_of(" :", fortran + 15);
+    if (order == std::string::npos || header.compare(order, 5, "False") != 0) {
+        return false;
+    }
+    
+    size_t shape = header.find("'shape'");
+    if (shape == std::string::npos) {
+        return false;
+    }
+    size_t open = header.find('(', shape);
+    size_t close = header.find(')', open);
+    if (open == std::string::npos || close == std::string::npos) {
+        return false;
+    }
+    
+    std::vector<long long> dims;
+    std::stringstream tuple(header.substr(open + 1, close - open - 1));
+    std::string item;
+    while (std::getline(tuple, item, ',')) {
+        if (item.find_first_not_of(" ") != std::string::npos) {
+            dims.push_back(std::atoll(item.c_str()));
+        }
+    }
+    if (!(dims.size() == 2 || (dims.size() == 3 && dims[2] == 1)) || 
+        dims[0] <= 0 || dims[1] <= 0 || dims[0] > INT_MAX || dims[1] > INT_MAX) {
+        return false;
+    }
+    
+    size = cv::Size(static_cast<int>(dims[1]), static_cast<int>(dims[0]));
+    offset = headerStart + headerLength;
+    return true;
+}
+
+#ifndef _WIN32
+
+struct MappedRegion {
+    void* base;
+    size_t length;
+};
+
+// Снимает отображение файла, когда исчезает последняя матрица, ссылающаяся на него.
+// Новые буферы (create() поверх такой матрицы) выделяет стандартный аллокатор
+class MappedFileAllocator : public cv::MatAllocator {
+public:
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override {
+        return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    }
+    
+    bool allocate(cv::UMatData* data, cv::AccessFlag accessFlags, 
+                  cv::UMatUsageFlags usageFlags) const override {
+        return cv::Mat::getStdAllocator()->allocate(data, accessFlags, usageFlags);
+    }
+    
+    void deallocate(cv::UMatData* data) const override {
+        if (!data) {
+            return;
+        }
+        MappedRegion* region = static_cast<MappedRegion*>(data->userdata);
+        munmap(region->base, region->length);
+        delete region;
+        delete data;
+    }
+};
+
+MappedFileAllocator& mappedFileAllocator() {
+    static MappedFileAllocator allocator;
+    return allocator;
+}
+
+// MAP_PRIVATE с правом записи: изменения пикселей уходят в копии страниц, а не в файл
+cv::Mat mapFrame(const std::string& filepath, const cv::Size& size, size_t offset) {
+    int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return cv::Mat();
+    }
+    
+    struct stat info;
+    size_t frameBytes = static_cast<size_t>(size.width) * size.height;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < offset + frameBytes) {
+        LOG_ERROR("Error: " << filepath << " is shorter than a " 
+                  << size.width << "x" << size.height << " frame");
+        close(fd);
+        return cv::Mat();
+    }
+    
+    size_t length = offset + frameBytes;
+    void* base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        LOG_ERROR("Error: Cannot map " << filepath);
+        return cv::Mat();
+    }
+    madvise(base, length, MADV_WILLNEED);
+    
+    uchar* pixels = static_cast<uchar*>(base) + offset;
+    cv::Mat image(size.height, size.width, CV_8UC1, pixels);
+    
+    cv::UMatData* u = new cv::UMatData(&mappedFileAllocator());
+    u->data = u->origdata = pixels;
+    u->size = frameBytes;
+    u->userdata = new MappedRegion{base, length};
+    u->refcount = 1;
+    image.u = u;
+    
+    return image;
+}
+
+#endif
+
+bool isJpeg(const std::string& filepath) {
+    std::ifstream file(filepath, std::ios::binary);
+    return file.get() == 0xFF && file.get() == 0xD8;
+}
+
+}
 
 cv::Mat ImageLoader::loadImage(const std::string& filepath) {
+    StageProfiler::Scope timing(Stage::Decode);
     cv::Mat image = cv::imread(filepath, cv::IMREAD_COLOR);
     
     if (image.empty()) {
-        std::cerr << "Error: Cannot load image " << filepath << std::endl;
+        LOG_ERROR("Error: Cannot load image " << filepath);
         return cv::Mat();
     }
     
-    std::cout << "Image loaded: " << image.cols << "x" << image.rows << " pixels" << std::endl;
+    LOG_INFO("Image loaded: " << image.cols << "x" << image.rows << " pixels");
     return image;
 }
 
-cv::Mat ImageLoader::convertToGrayscale(const cv::Mat& image) {
+bool ImageLoader::readImageSize(const std::string& filepath, cv::Size& size) {
+    std::ifstream file(filepath, std::ios::binary);
+    unsigned char header[26] = {};
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    std::streamsize bytes = file.gcount();
+    
+    bool found = false;
+    if (bytes >= 24 && std::memcmp(header, "\x89PNG\r\n\x1a\n", 8) == 0 && 
+        std::memcmp(header + 12, "IHDR", 4) == 0) {
+        size = cv::Size(static_cast<int>(bigEndian(header + 16, 4)), 
+                        static_cast<int>(bigEndian(header + 20, 4)));
+        found = true;
+    } else if (bytes >= 4 && header[0] == 0xFF && header[1] == 0xD8) {
+        found = readJpegSize(file, size);
+    } else if (bytes >= 26 && header[0] == 'B' && header[1] == 'M') {
+        if (littleEndian(header + 14, 4) == 12) {
+            size = cv::Size(static_cast<int>(littleEndian(header + 18, 2)), 
+                            static_cast<int>(littleEndian(header + 20, 2)));
+        } else {
+            // Отрицательная высота означает строки сверху вниз
+            int32_t height = static_cast<int32_t>(littleEndian(header + 22, 4));
+            size = cv::Size(static_cast<int>(littleEndian(header + 18, 4)), std::abs(height));
+        }
+        found = true;
+    } else if (bytes >= 3 && header[0] == 'P' && header[1] >= '1' && header[1] <= '6') {
+        found = readPnmSize(file, size);
+    }
+    
+    return found && size.width > 0 && size.height > 0;
+}
+
+cv::Mat ImageLoader::loadGrayscale(const std::string& filepath, int maxSize) {
+    int flags = cv::IMREAD_GRAYSCALE;
+    int scale = 1;
+    cv::Size fullSize;
+    
+    // Уменьшение при декодировании есть только у JPEG (масштабирование DCT);
+    // остальные форматы OpenCV декодирует целиком и прореживает без сглаживания
+    if (maxSize > 0 && readImageSize(filepath, fullSize) && isJpeg(filepath)) {
+        int largest = std::max(fullSize.width, fullSize.height);
+        for (int candidate : {8, 4, 2}) {
+            if (largest / candidate >= maxSize) {
+                scale = candidate;
+                break;
+            }
+        }
+        flags = scale == 8 ? cv::IMREAD_REDUCED_GRAYSCALE_8 :
+                scale == 4 ? cv::IMREAD_REDUCED_GRAYSCALE_4 :
+                scale == 2 ? cv::IMREAD_REDUCED_GRAYSCALE_2 : cv::IMREAD_GRAYSCALE;
+    }
+    
+    cv::Mat image;
+    {
+        StageProfiler::Scope timing(Stage::Decode);
+        image = cv::imread(filepath, flags);
+    }
+    
     if (image.empty()) {
-        std::cerr << "Error: Empty image for conversion" << std::endl;
+        LOG_ERROR("Error: Cannot load image " << filepath);
         return cv::Mat();
     }
     
-    cv::Mat grayImage;
+    LOG_INFO("Image loaded: " << image.cols << "x" << image.rows << " pixels, grayscale" 
+             << (scale > 1 ? ", decoded at 1/" + std::to_string(scale) : std::string()));
+    
+    if (maxSize > 0 && std::max(image.cols, image.rows) > maxSize) {
+        return resizeImage(image, maxSize);
+    }
+    return image;
+}
+
+bool ImageLoader::probeUncompressed(const std::string& filepath, const cv::Size& rawSize,
+                                    cv::Size& size, size_t& offset) {
+    std::ifstream file(filepath, std::ios::binary);
+    char magic[2] = {};
+    if (!file.read(magic, 2)) {
+        return false;
+    }
     
-    if (image.channels() == 3) {
-        cv::cvtColor(image, grayImage, cv::COLOR_BGR2GRAY);
-    } else if (image.channels() == 1) {
-        grayImage = image.clone();
+    offset = 0;
+    if (magic[0] == 'P' && magic[1] == '5') {
+        int values[3];
+        if (!readPnmHeader(file, values, 3) || values[2] > 255) {
+            return false;
+        }
+        size = cv::Size(values[0], values[1]);
+        offset = static_cast<size_t>(file.tellg());
+    } else if (static_cast<unsigned char>(magic[0]) == 0x93 && magic[1] == 'N') {
+        if (!readNpyHeader(file, size, offset)) {
+            LOG_WARNING("Unsupported NPY layout in " << filepath << " (expected 2-D C-order uint8)");
+            return false;
+        }
+    } else if (!rawSize.empty()) {
+        std::string extension = filepath.substr(filepath.find_last_of('.') + 1);
+        if (extension != "raw" && extension != "gray") {
+            return false;
+        }
+        size = rawSize;
     } else {
-        std::cerr << "Error: Unsupported number of channels: " << image.channels() << std::endl;
+        return false;
+    }
+    
+    return size.width > 0 && size.height > 0;
+}
+
+cv::Mat ImageLoader::mapImage(const std::string& filepath, const cv::Size& rawSize) {
+#ifdef _WIN32
+    (void)filepath;
+    (void)rawSize;
+    return cv::Mat();
+#else
+    cv::Size size;
+    size_t offset = 0;
+    if (!probeUncompressed(filepath, rawSize, size, offset)) {
         return cv::Mat();
     }
     
+    cv::Mat image;
+    {
+        StageProfiler::Scope timing(Stage::Decode);
+        image = mapFrame(filepath, size, offset);
+    }
+    
+    if (!image.empty()) {
+        LOG_INFO("Image mapped: " << image.cols << "x" << image.rows << " pixels");
+    }
+    return image;
+#endif
+}
+
+cv::Mat ImageLoader::convertToGrayscale(const cv::Mat& image) {
+    if (image.channels() == 1) {
+        return image.clone();
+    }
+    cv::Mat storage;
+    return convertToGrayscale(image, storage);
+}
+
+cv::Mat ImageLoader::convertToGrayscale(const cv::Mat& image, cv::Mat& storage) {
+    if (image.empty()) {
+        LOG_ERROR("Error: Empty image for conversion");
+        return cv::Mat();
+    }
+    
+    if (image.channels() == 1) {
+        return image;
+    }
+    if (image.channels() != 3 && image.channels() != 4) {
+        LOG_ERROR("Error: Unsupported number of channels: " << image.channels());
+        return cv::Mat();
+    }
+    
+    StageProfiler::Scope timing(Stage::Grayscale);
+    cv::Mat grayImage = AnalysisWorkspace::reserve(storage, image.rows, image.cols, CV_8UC1);
+    cv::cvtColor(image, grayImage, image.channels() == 3 ? cv::COLOR_BGR2GRAY : cv::COLOR_BGRA2GRAY);
+    
     return grayImage;
 }
 
 void ImageLoader::displayImage(const cv::Mat& image, const std::string& windowName) {
     if (image.empty()) {
-        std::cerr << "Error: Empty image for display" << std::endl;
+        LOG_ERROR("Error: Empty image for display");
         return;
     }
     
@@ -45,16 +457,21 @@ void ImageLoader::displayImage(const cv::Mat& image, const std::string& windowNa
 
 bool ImageLoader::saveImage(const cv::Mat& image, const std::string& filepath) {
     if (image.empty()) {
-        std::cerr << "Error: Empty image for saving" << std::endl;
+        LOG_ERROR("Error: Empty image for saving");
         return false;
     }
     
-    bool success = cv::imwrite(filepath, image);
+    cv::Mat output = image;
+    if (image.depth() == CV_32F || image.depth() == CV_64F) {
+        cv::normalize(image, output, 0, 255, cv::NORM_MINMAX, CV_8U);
+    }
+    
+    bool success = cv::imwrite(filepath, output);
     
     if (success) {
-        std::cout << "Image saved: " << filepath << std::endl;
+        LOG_INFO("Image saved: " << filepath);
     } else {
-        std::cerr << "Error saving image: " << filepath << std::endl;
+        LOG_ERROR("Error saving image: " << filepath);
     }
     
     return success;
@@ -62,17 +479,17 @@ bool ImageLoader::saveImage(const cv::Mat& image, const std::string& filepath) {
 
 bool ImageLoader::validateImage(const cv::Mat& image) {
     if (image.empty()) {
-        std::cerr << "Validation error: Image is empty" << std::endl;
+        LOG_ERROR("Validation error: Image is empty");
         return false;
     }
     
     if (image.cols < 10 || image.rows < 10) {
-        std::cerr << "Validation error: Image too small" << std::endl;
+        LOG_ERROR("Validation error: Image too small");
         return false;
     }
     
     if (image.type() != CV_8UC1 && image.type() != CV_8UC3) {
-        std::cerr << "Validation error: Unsupported image type" << std::endl;
+        LOG_ERROR("Validation error: Unsupported image type");
         return false;
     }
     
@@ -80,25 +497,34 @@ bool ImageLoader::validateImage(const cv::Mat& image) {
 }
 
 cv::Mat ImageLoader::resizeImage(const cv::Mat& image, int maxSize) {
+    if (image.empty() || maxSize <= 0 || std::max(image.cols, image.rows) <= maxSize) {
+        return image.clone();
+    }
+    cv::Mat storage;
+    return resizeImage(image, maxSize, storage);
+}
+
+cv::Mat ImageLoader::resizeImage(const cv::Mat& image, int maxSize, cv::Mat& storage) {
     if (image.empty()) {
         return cv::Mat();
     }
     
     int currentMax = std::max(image.cols, image.rows);
     
-    if (currentMax <= maxSize) {
-        return image.clone();
+    if (maxSize <= 0 || currentMax <= maxSize) {
+        return image;
     }
     
     double scale = static_cast<double>(maxSize) / currentMax;
     int newWidth = static_cast<int>(image.cols * scale);
     int newHeight = static_cast<int>(image.rows * scale);
     
-    cv::Mat resized;
-    cv::resize(image, resized, cv::Size(newWidth, newHeight));
+    StageProfiler::Scope timing(Stage::Resize);
+    cv::Mat resized = AnalysisWorkspace::reserve(storage, newHeight, newWidth, image.type());
+    cv::resize(image, resized, resized.size());
     
-    std::cout << "Image resized: " << image.cols << "x" << image.rows 
-              << " -> " << newWidth << "x" << newHeight << std::endl;
+    LOG_INFO("Image resized: " << image.cols << "x" << image.rows 
+             << " -> " << newWidth << "x" << newHeight);
     
     return resized;
 }
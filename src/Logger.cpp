@@ -0,0 +1,50 @@
+#include "Logger.h"
+#include <iostream>
+#include <mutex>
+
+namespace {
+
+std::mutex& logMutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+Logger::Sink& logSink() {
+    static Logger::Sink sink;
+    return sink;
+}
+
+}
+
+bool Logger::parseLevel(const std::string& name, LogLevel& level) {
+    if (name == "off") {
+        level = LogLevel::Off;
+    } else if (name == "error") {
+        level = LogLevel::Error;
+    } else if (name == "warning") {
+        level = LogLevel::Warning;
+    } else if (name == "info") {
+        level = LogLevel::Info;
+    } else if (name == "debug") {
+        level = LogLevel::Debug;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void Logger::write(LogLevel level, const std::string& message) {
+    std::lock_guard<std::mutex> lock(logMutex());
+    if (logSink()) {
+        logSink()(level, message);
+    } else if (level <= LogLevel::Warning) {
+        std::cerr << message << '\n';
+    } else {
+        std::cout << message << '\n';
+    }
+}
+
+void Logger::setSink(Sink sink) {
+    std::lock_guard<std::mutex> lock(logMutex());
+    logSink() = std::move(sink);
+}
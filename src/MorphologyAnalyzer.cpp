@@ -1,70 +1,307 @@
 #include "MorphologyAnalyzer.h"
+#include "AlignedBuffer.h"
+#include "Logger.h"
+#include "StageProfiler.h"
+#include <algorithm>
+#include <cfloat>
+
+namespace {
+
+// Рабочие массивы вращающихся калиперов: свои у каждого потока (объекты измеряются
+// параллельно), память растёт только вместе с оболочкой
+struct CaliperScratch {
+    std::vector<int> hull;
+    std::vector<std::pair<int64_t, int>> keys;
+    std::vector<int> vertex;
+};
+
+CaliperScratch& caliperScratch() {
+    thread_local CaliperScratch scratch;
+    return scratch;
+}
+
+// Приближённый диаметр: точки контура в виде двух массивов float (SoA)
+// и по минимуму и максимуму проекции на каждое направление
+struct ProjectionScratch {
+    AlignedBuffer<float> xs;
+    AlignedBuffer<float> ys;
+    AlignedBuffer<float> cosines;
+    AlignedBuffer<float> sines;
+    AlignedBuffer<float> low;
+    AlignedBuffer<float> high;
+};
+
+ProjectionScratch& projectionScratch() {
+    thread_local ProjectionScratch scratch;
+    return scratch;
+}
+
+// Маска одного объекта с полем в 1 пиксель и его контуры в analyzeObjects: объекты
+// измеряются задачами parallel_for_, поэтому буферы свои у каждого потока
+struct ObjectScratch {
+    cv::Mat mask;
+    std::vector<std::vector<cv::Point>> contours;
+};
+
+ObjectScratch& objectScratch() {
+    thread_local ObjectScratch scratch;
+    return scratch;
+}
+
+}
 
 cv::Mat MorphologyAnalyzer::binarizeImage(const cv::Mat& grayImage, int threshold) {
+    cv::Mat storage;
+    return binarizeImage(grayImage, threshold, storage);
+}
+
+cv::Mat MorphologyAnalyzer::binarizeImage(const cv::Mat& grayImage, int threshold, cv::Mat& storage) {
     if (grayImage.empty() || grayImage.type() != CV_8UC1) {
-        std::cerr << "Error: Image must be grayscale" << std::endl;
+        LOG_ERROR("Error: Image must be grayscale");
         return cv::Mat();
     }
     
-    cv::Mat binaryImage;
+    StageProfiler::Scope timing(Stage::Otsu);
+    cv::Mat binaryImage = AnalysisWorkspace::reserve(storage, grayImage.rows, grayImage.cols, CV_8UC1);
     cv::threshold(grayImage, binaryImage, threshold, 255, cv::THRESH_BINARY);
     
-    std::cout << "Binarization completed with threshold: " << threshold << std::endl;
+    LOG_INFO("Binarization completed with threshold: " << threshold);
     return binaryImage;
 }
 
 cv::Mat MorphologyAnalyzer::binarizeImageOtsu(const cv::Mat& grayImage) {
+    cv::Mat storage;
+    return binarizeImageOtsu(grayImage, storage);
+}
+
+cv::Mat MorphologyAnalyzer::binarizeImageOtsu(const cv::Mat& grayImage, cv::Mat& storage) {
     if (grayImage.empty() || grayImage.type() != CV_8UC1) {
-        std::cerr << "Error: Image must be grayscale" << std::endl;
+        LOG_ERROR("Error: Image must be grayscale");
         return cv::Mat();
     }
     
-    cv::Mat binaryImage;
+    StageProfiler::Scope timing(Stage::Otsu);
+    cv::Mat binaryImage = AnalysisWorkspace::reserve(storage, grayImage.rows, grayImage.cols, CV_8UC1);
     double otsuThreshold = cv::threshold(grayImage, binaryImage, 0, 255, 
                                         cv::THRESH_BINARY + cv::THRESH_OTSU);
     
-    std::cout << "Otsu binarization: threshold = " 
-              << std::fixed << std::setprecision(1) << otsuThreshold << std::endl;
+    LOG_INFO("Otsu binarization: threshold = " 
+             << std::fixed << std::setprecision(1) << otsuThreshold);
     
     return binaryImage;
 }
 
+int MorphologyAnalyzer::otsuThreshold(const std::vector<int64_t>& histogram) {
+    int64_t total = 0;
+    double sum = 0.0;
+    for (size_t i = 0; i < histogram.size(); i++) {
+        total += histogram[i];
+        sum += static_cast<double>(i) * histogram[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    
+    const double mu = sum / total;
+    double q1 = 0.0;
+    double mu1 = 0.0;
+    double maxSigma = 0.0;
+    int threshold = 0;
+    
+    for (size_t i = 0; i < histogram.size(); i++) {
+        double p_i = static_cast<double>(histogram[i]) / total;
+        mu1 *= q1;
+        q1 += p_i;
+        double q2 = 1.0 - q1;
+        
+        if (std::min(q1, q2) < FLT_EPSILON || std::max(q1, q2) > 1.0 - FLT_EPSILON) {
+            continue;
+        }
+        
+        mu1 = (mu1 + i * p_i) / q1;
+        double mu2 = (mu - q1 * mu1) / q2;
+        double sigma = q1 * q2 * (mu1 - mu2) * (mu1 - mu2);
+        if (sigma > maxSigma) {
+            maxSigma = sigma;
+            threshold = static_cast<int>(i);
+        }
+    }
+    
+    return threshold;
+}
+
 std::vector<std::vector<cv::Point>> MorphologyAnalyzer::findContours(const cv::Mat& binaryImage) {
+    std::vector<std::vector<cv::Point>> contours;
+    findContours(binaryImage, contours);
+    return contours;
+}
+
+void MorphologyAnalyzer::findContours(const cv::Mat& binaryImage,
+                                      std::vector<std::vector<cv::Point>>& contours) {
     if (binaryImage.empty() || binaryImage.type() != CV_8UC1) {
-        std::cerr << "Error: Image must be binary" << std::endl;
-        return std::vector<std::vector<cv::Point>>();
+        LOG_ERROR("Error: Image must be binary");
+        contours.clear();
+        return;
     }
     
-    std::vector<std::vector<cv::Point>> contours;
+    StageProfiler::Scope timing(Stage::Contours);
     cv::findContours(binaryImage, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE);
     
-    std::cout << "Found contours: " << contours.size() << std::endl;
+    LOG_INFO("Found contours: " << contours.size());
     
-    for (size_t i = 0; i < contours.size(); i++) {
-        double area = cv::contourArea(contours[i]);
-        std::cout << "Contour " << i << ": points = " << contours[i].size() 
-                  << ", area = " << std::fixed << std::setprecision(1) << area << std::endl;
+    if (Logger::enabled(LogLevel::Debug)) {
+        for (size_t i = 0; i < contours.size(); i++) {
+            LOG_DEBUG("Contour " << i << ": points = " << contours[i].size() 
+                      << ", area = " << std::fixed << std::setprecision(1) 
+                      << cv::contourArea(contours[i]));
+        }
     }
-    
-    return contours;
 }
 
-DiameterResult MorphologyAnalyzer::calculateMaxDiameter(const std::vector<cv::Point>& contour) {
+DiameterResult MorphologyAnalyzer::calculateMaxDiameter(const std::vector<cv::Point>& contour,
+                                                        DiameterMode mode, int directions) {
     DiameterResult result;
     result.maxDiameter = 0.0;
     result.area = 0.0;
     result.perimeter = 0.0;
     result.contourPoints = contour.size();
     result.circularity = 0.0;
+    result.label = 0;
+    result.relativeError = 0.0;
     
     if (contour.size() < 2) {
-        std::cerr << "Error: Contour has less than 2 points" << std::endl;
+        LOG_ERROR("Error: Contour has less than 2 points");
         return result;
     }
     
-    std::cout << "Calculating maximum diameter for contour with " 
-              << contour.size() << " points..." << std::endl;
+    StageProfiler::Scope timing(Stage::Diameter);
+    LOG_DEBUG("Calculating maximum diameter for contour with " 
+              << contour.size() << " points...");
+    
+    measureContour(contour, mode, directions, result);
+    
+    LOG_INFO("Maximum diameter: " << std::fixed << std::setprecision(2) 
+             << result.maxDiameter << " pixels");
+    if (mode == DiameterMode::Approximate) {
+        LOG_DEBUG("Approximate diameter over " << std::max(directions, 2) << " directions, error <= " 
+                  << std::setprecision(3) << 100.0 * result.relativeError << "%");
+    }
+    LOG_DEBUG("Diameter points: (" << result.point1.x << "," << result.point1.y 
+              << ") - (" << result.point2.x << "," << result.point2.y << ")");
+    LOG_DEBUG("Area: " << std::fixed << std::setprecision(1) << result.area);
+    LOG_DEBUG("Perimeter: " << std::fixed << std::setprecision(1) << result.perimeter);
+    LOG_DEBUG("Circularity: " << std::fixed << std::setprecision(3) << result.circularity);
+    
+    return result;
+}
+
+double MorphologyAnalyzer::approximationError(int directions) {
+    return 1.0 - std::cos(M_PI / (2.0 * std::max(directions, 2)));
+}
+
+void MorphologyAnalyzer::measureContour(const std::vector<cv::Point>& contour, DiameterMode mode,
+                                        int directions, DiameterResult& result) {
+    if (mode == DiameterMode::BruteForce) {
+        findDiameterBruteForce(contour, result);
+    } else if (mode == DiameterMode::Approximate) {
+        findDiameterApproximate(contour, directions, result);
+    } else {
+        findDiameterRotatingCalipers(contour, result);
+    }
+    
+    result.area = cv::contourArea(contour);
+    result.perimeter = cv::arcLength(contour, true);
     
+    if (result.perimeter > 0) {
+        result.circularity = (4.0 * M_PI * result.area) / (result.perimeter * result.perimeter);
+    }
+}
+
+std::vector<DiameterResult> MorphologyAnalyzer::analyzeObjects(const cv::Mat& binaryImage, int minPixels,
+                                                               DiameterMode mode, int directions) {
+    AnalysisWorkspace workspace;
+    return analyzeObjects(binaryImage, workspace, minPixels, mode, directions);
+}
+
+std::vector<DiameterResult> MorphologyAnalyzer::analyzeObjects(const cv::Mat& binaryImage,
+                                                               AnalysisWorkspace& workspace,
+                                                               int minPixels, DiameterMode mode,
+                                                               int directions) {
+    std::vector<DiameterResult> objects;
+    analyzeObjects(binaryImage, workspace, objects, minPixels, mode, directions);
+    return objects;
+}
+
+void MorphologyAnalyzer::analyzeObjects(const cv::Mat& binaryImage, AnalysisWorkspace& workspace,
+                                        std::vector<DiameterResult>& objects, int minPixels,
+                                        DiameterMode mode, int directions) {
+    objects.clear();
+    if (binaryImage.empty() || binaryImage.type() != CV_8UC1) {
+        LOG_ERROR("Error: Image must be binary");
+        return;
+    }
+    
+    // Размер stats и centroids зависит от числа меток, они перевыделяются при его смене
+    cv::Mat labels = AnalysisWorkspace::reserve(workspace.labels, binaryImage.rows, binaryImage.cols, CV_32S);
+    cv::Mat& stats = workspace.stats;
+    cv::Mat& centroids = workspace.centroids;
+    int labelCount;
+    {
+        StageProfiler::Scope timing(Stage::Contours);
+        labelCount = cv::connectedComponentsWithStats(binaryImage, labels, stats, centroids, 8, CV_32S);
+    }
+    
+    // Площадь в пикселях уже посчитана разметкой: мелкие объекты отсеиваются до трассировки контуров
+    std::vector<int>& kept = workspace.keptLabels;
+    kept.clear();
+    for (int label = 1; label < labelCount; label++) {
+        if (stats.at<int>(label, cv::CC_STAT_AREA) >= minPixels) {
+            kept.push_back(label);
+        }
+    }
+    
+    objects.resize(kept.size());
+    cv::parallel_for_(cv::Range(0, static_cast<int>(kept.size())), [&](const cv::Range& range) {
+        for (int k = range.start; k < range.end; k++) {
+            const int label = kept[k];
+            cv::Rect box(stats.at<int>(label, cv::CC_STAT_LEFT), stats.at<int>(label, cv::CC_STAT_TOP),
+                         stats.at<int>(label, cv::CC_STAT_WIDTH), stats.at<int>(label, cv::CC_STAT_HEIGHT));
+            
+            // Рамка с полем в 1 пиксель, чтобы контур не упирался в край маски
+            ObjectScratch& scratch = objectScratch();
+            cv::Mat mask = AnalysisWorkspace::reserve(scratch.mask, box.height + 2, box.width + 2, CV_8UC1);
+            mask.setTo(0);
+            cv::Mat inner = mask(cv::Rect(1, 1, box.width, box.height));
+            cv::compare(labels(box), label, inner, cv::CMP_EQ);
+            
+            std::vector<std::vector<cv::Point>>& contours = scratch.contours;
+            cv::findContours(mask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE,
+                             box.tl() - cv::Point(1, 1));
+            
+            DiameterResult& result = objects[k];
+            result = DiameterResult();
+            result.label = label;
+            if (contours.empty()) {
+                continue;
+            }
+            
+            // При 8-связности у компоненты ровно один внешний контур
+            const std::vector<cv::Point>& contour = contours.front();
+            result.contourPoints = static_cast<int>(contour.size());
+            if (contour.size() >= 2) {
+                measureContour(contour, mode, directions, result);
+            } else {
+                result.point1 = result.point2 = cv::Point2f(contour.front());
+            }
+        }
+    });
+    
+    LOG_INFO("Objects: " << labelCount - 1 << " labelled, " << objects.size() 
+             << " with at least " << minPixels << " pixels");
+}
+
+void MorphologyAnalyzer::findDiameterBruteForce(const std::vector<cv::Point>& contour,
+                                                DiameterResult& result) {
     for (size_t i = 0; i < contour.size(); i++) {
         for (size_t j = i + 1; j < contour.size(); j++) {
             double distance = euclideanDistance(
@@ -79,23 +316,182 @@ DiameterResult MorphologyAnalyzer::calculateMaxDiameter(const std::vector<cv::Po
             }
         }
     }
+}
+
+// Протяжённость проекции на любое направление не больше диаметра D, а направление диаметра
+// отстоит от ближайшего из K направлений (шаг pi/K) не больше чем на pi/2K, поэтому
+// наибольшая протяжённость не меньше D cos(pi/2K). Расстояние между двумя точками,
+// давшими её, лежит между протяжённостью и D
+void MorphologyAnalyzer::findDiameterApproximate(const std::vector<cv::Point>& contour, int directions,
+                                                 DiameterResult& result) {
+    const int count = static_cast<int>(contour.size());
+    directions = std::max(directions, 2);
+    ProjectionScratch& scratch = projectionScratch();
     
-    result.area = cv::contourArea(contour);
-    result.perimeter = cv::arcLength(contour, true);
+    // Координаты от первой точки: float без потери точности и на очень больших масках
+    const cv::Point origin = contour[0];
+    scratch.xs.resize(count);
+    scratch.ys.resize(count);
+    float* xs = scratch.xs.data();
+    float* ys = scratch.ys.data();
+    for (int i = 0; i < count; i++) {
+        xs[i] = static_cast<float>(contour[i].x - origin.x);
+        ys[i] = static_cast<float>(contour[i].y - origin.y);
+    }
     
-    if (result.perimeter > 0) {
-        result.circularity = (4.0 * M_PI * result.area) / (result.perimeter * result.perimeter);
+    scratch.cosines.resize(directions);
+    scratch.sines.resize(directions);
+    scratch.low.resize(directions);
+    scratch.high.resize(directions);
+    float* cosines = scratch.cosines.data();
+    float* sines = scratch.sines.data();
+    float* low = scratch.low.data();
+    float* high = scratch.high.data();
+    for (int k = 0; k < directions; k++) {
+        double angle = M_PI * k / directions;
+        cosines[k] = static_cast<float>(std::cos(angle));
+        sines[k] = static_cast<float>(std::sin(angle));
     }
+    // Проекция первой точки - ноль
+    scratch.low.zero();
+    scratch.high.zero();
     
-    std::cout << "Maximum diameter: " << std::fixed << std::setprecision(2) 
-              << result.maxDiameter << " pixels" << std::endl;
-    std::cout << "Diameter points: (" << result.point1.x << "," << result.point1.y 
-              << ") - (" << result.point2.x << "," << result.point2.y << ")" << std::endl;
-    std::cout << "Area: " << std::fixed << std::setprecision(1) << result.area << std::endl;
-    std::cout << "Perimeter: " << std::fixed << std::setprecision(1) << result.perimeter << std::endl;
-    std::cout << "Circularity: " << std::fixed << std::setprecision(3) << result.circularity << std::endl;
+    // Внутренний цикл идёт по направлениям: поэлементные min/max без редукции
+    // векторизуются компилятором без -ffast-math
+    for (int i = 1; i < count; i++) {
+        const float x = xs[i];
+        const float y = ys[i];
+        for (int k = 0; k < directions; k++) {
+            float projection = x * cosines[k] + y * sines[k];
+            low[k] = projection < low[k] ? projection : low[k];
+            high[k] = projection > high[k] ? projection : high[k];
+        }
+    }
     
-    return result;
+    int best = 0;
+    for (int k = 1; k < directions; k++) {
+        if (high[k] - low[k] > high[best] - low[best]) {
+            best = k;
+        }
+    }
+    
+    // Концы - по второму проходу в double только вдоль выбранного направления
+    const double angle = M_PI * best / directions;
+    const double c = std::cos(angle);
+    const double s = std::sin(angle);
+    int lowIndex = 0;
+    int highIndex = 0;
+    double lowValue = 0.0;
+    double highValue = 0.0;
+    for (int i = 1; i < count; i++) {
+        double projection = (contour[i].x - origin.x) * c + (contour[i].y - origin.y) * s;
+        if (projection < lowValue) {
+            lowValue = projection;
+            lowIndex = i;
+        }
+        if (projection > highValue) {
+            highValue = projection;
+            highIndex = i;
+        }
+    }
+    
+    result.point1 = cv::Point2f(contour[std::min(lowIndex, highIndex)]);
+    result.point2 = cv::Point2f(contour[std::max(lowIndex, highIndex)]);
+    result.maxDiameter = euclideanDistance(result.point1, result.point2);
+    result.relativeError = approximationError(directions);
+}
+
+void MorphologyAnalyzer::findDiameterRotatingCalipers(const std::vector<cv::Point>& contour,
+                                                      DiameterResult& result) {
+    CaliperScratch& scratch = caliperScratch();
+    std::vector<int>& hull = scratch.hull;
+    cv::convexHull(contour, hull, false, false);
+    
+    const int hullSize = static_cast<int>(hull.size());
+    if (hullSize < 2) {
+        return;
+    }
+    
+    // Контур из CHAIN_APPROX_NONE может проходить одну точку дважды.
+    // Для совпадения с полным перебором берём первое вхождение каждой вершины оболочки.
+    auto pointKey = [](const cv::Point& p) {
+        return (static_cast<int64_t>(p.x) << 32) ^ static_cast<uint32_t>(p.y);
+    };
+    std::vector<std::pair<int64_t, int>>& keys = scratch.keys;
+    keys.clear();
+    for (int k = 0; k < hullSize; k++) {
+        keys.emplace_back(pointKey(contour[hull[k]]), k);
+    }
+    std::sort(keys.begin(), keys.end());
+    
+    std::vector<int>& vertex = scratch.vertex;
+    vertex.assign(hullSize, -1);
+    for (size_t i = 0; i < contour.size(); i++) {
+        int64_t key = pointKey(contour[i]);
+        auto it = std::lower_bound(keys.begin(), keys.end(), std::make_pair(key, -1));
+        if (it != keys.end() && it->first == key && vertex[it->second] < 0) {
+            vertex[it->second] = static_cast<int>(i);
+        }
+    }
+    
+    auto distance2 = [&](int a, int b) {
+        int64_t dx = contour[vertex[a]].x - contour[vertex[b]].x;
+        int64_t dy = contour[vertex[a]].y - contour[vertex[b]].y;
+        return dx * dx + dy * dy;
+    };
+    auto area2 = [&](int a, int b, int c) {
+        const cv::Point& pa = contour[vertex[a]];
+        const cv::Point& pb = contour[vertex[b]];
+        const cv::Point& pc = contour[vertex[c]];
+        int64_t cross = static_cast<int64_t>(pb.x - pa.x) * (pc.y - pa.y) -
+                        static_cast<int64_t>(pb.y - pa.y) * (pc.x - pa.x);
+        return cross < 0 ? -cross : cross;
+    };
+    
+    int64_t best = 0;
+    int bestI = -1;
+    int bestJ = -1;
+    auto consider = [&](int a, int b) {
+        int64_t d = distance2(a, b);
+        int i = std::min(vertex[a], vertex[b]);
+        int j = std::max(vertex[a], vertex[b]);
+        // При равных расстояниях выбираем пару, которую первой нашёл бы полный перебор
+        if (d > best || (d == best && d > 0 && (i < bestI || (i == bestI && j < bestJ)))) {
+            best = d;
+            bestI = i;
+            bestJ = j;
+        }
+    };
+    
+    if (hullSize <= 3) {
+        for (int a = 0; a < hullSize; a++) {
+            for (int b = a + 1; b < hullSize; b++) {
+                consider(a, b);
+            }
+        }
+    } else {
+        int j = 1;
+        for (int i = 0; i < hullSize; i++) {
+            int next = (i + 1) % hullSize;
+            while (area2(i, next, (j + 1) % hullSize) > area2(i, next, j)) {
+                j = (j + 1) % hullSize;
+            }
+            consider(i, j);
+            consider(next, j);
+            
+            int afterJ = (j + 1) % hullSize;
+            if (area2(i, next, afterJ) == area2(i, next, j)) {
+                consider(i, afterJ);
+                consider(next, afterJ);
+            }
+        }
+    }
+    
+    if (bestI >= 0) {
+        result.point1 = cv::Point2f(contour[bestI]);
+        result.point2 = cv::Point2f(contour[bestJ]);
+        result.maxDiameter = euclideanDistance(result.point1, result.point2);
+    }
 }
 
 double MorphologyAnalyzer::euclideanDistance(const cv::Point2f& p1, const cv::Point2f& p2) {
@@ -120,8 +516,8 @@ int MorphologyAnalyzer::findLargestContour(const std::vector<std::vector<cv::Poi
         }
     }
     
-    std::cout << "Largest contour: index " << largestIndex 
-              << ", area " << std::fixed << std::setprecision(1) << largestArea << std::endl;
+    LOG_INFO("Largest contour: index " << largestIndex 
+             << ", area " << std::fixed << std::setprecision(1) << largestArea);
     
     return largestIndex;
 }
@@ -129,16 +525,24 @@ int MorphologyAnalyzer::findLargestContour(const std::vector<std::vector<cv::Poi
 cv::Mat MorphologyAnalyzer::visualizeResults(const cv::Mat& image, 
                                            const std::vector<cv::Point>& contour,
                                            const DiameterResult& result) {
-    cv::Mat visualization;
+    cv::Mat storage;
+    return visualizeResults(image, contour, result, storage);
+}
+
+cv::Mat MorphologyAnalyzer::visualizeResults(const cv::Mat& image,
+                                           const std::vector<cv::Point>& contour,
+                                           const DiameterResult& result, cv::Mat& storage) {
+    cv::Mat visualization = AnalysisWorkspace::reserve(storage, image.rows, image.cols,
+                                                       image.channels() == 1 ? CV_8UC3 : image.type());
     
     if (image.channels() == 1) {
         cv::cvtColor(image, visualization, cv::COLOR_GRAY2BGR);
     } else {
-        visualization = image.clone();
+        image.copyTo(visualization);
     }
     
-    std::vector<std::vector<cv::Point>> contours = {contour};
-    cv::drawContours(visualization, contours, -1, cv::Scalar(0, 255, 0), 2);
+    // Замкнутая ломаная рисуется так же, как drawContours, но без копии контура
+    cv::polylines(visualization, contour, true, cv::Scalar(0, 255, 0), 2);
     
     cv::line(visualization, result.point1, result.point2, cv::Scalar(0, 0, 255), 3);
     
@@ -0,0 +1,512 @@
+#include "ResultCache.h"
+#include "Logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <unistd.h>
+
+namespace {
+
+const char* const kEntryExtension = ".iac";
+const char* const kTempMarker = ".tmp.";
+// Очистка оставляет запас, чтобы не сканировать каталог после каждой записи
+const double kEvictTargetRatio = 0.9;
+// Временные файлы старше этого возраста остались от упавших процессов
+const auto kStaleTempAge = std::chrono::hours(1);
+
+// Потоковый 64-битный хеш по схеме XXH64: четыре независимые полосы по 8 байт
+// дают несколько ГБ/с, так что ключ на порядки дешевле декодирования
+class StreamHasher {
+public:
+    explicit StreamHasher(uint64_t seed = 0)
+        : length_(0), pending_(0) {
+        lanes_[0] = seed + kPrime1 + kPrime2;
+        lanes_[1] = seed + kPrime2;
+        lanes_[2] = seed;
+        lanes_[3] = seed - kPrime1;
+        seed_ = seed;
+    }
+
+    void update(const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        length_ += size;
+
+        if (pending_ > 0) {
+            size_t take = std::min(size, sizeof(buffer_) - pending_);
+            std::memcpy(buffer_ + pending_, bytes, take);
+            pending_ += take;
+            bytes += take;
+            size -= take;
+            if (pending_ < sizeof(buffer_)) {
+                return;
+            }
+            consumeStripe(buffer_);
+            pending_ = 0;
+        }
+
+        while (size >= sizeof(buffer_)) {
+            consumeStripe(bytes);
+            bytes += sizeof(buffer_);
+            size -= sizeof(buffer_);
+        }
+
+        std::memcpy(buffer_, bytes, size);
+        pending_ = size;
+    }
+
+    uint64_t finish() const {
+        uint64_t hash;
+        if (length_ >= sizeof(buffer_)) {
+            hash = rotl(lanes_[0], 1) + rotl(lanes_[1], 7) + rotl(lanes_[2], 12) + rotl(lanes_[3], 18);
+            for (uint64_t lane : lanes_) {
+                hash ^= round(0, lane);
+                hash = hash * kPrime1 + kPrime4;
+            }
+        } else {
+            hash = seed_ + kPrime5;
+        }
+        hash += length_;
+
+        const unsigned char* tail = buffer_;
+        size_t remaining = pending_;
+        while (remaining >= 8) {
+            hash ^= round(0, read64(tail));
+            hash = rotl(hash, 27) * kPrime1 + kPrime4;
+            tail += 8;
+            remaining -= 8;
+        }
+        if (remaining >= 4) {
+            uint32_t word;
+            std::memcpy(&word, tail, sizeof(word));
+            hash ^= static_cast<uint64_t>(word) * kPrime1;
+            hash = rotl(hash, 23) * kPrime2 + kPrime3;
+            tail += 4;
+            remaining -= 4;
+        }
+        while (remaining > 0) {
+            hash ^= (*tail) * kPrime5;
+            hash = rotl(hash, 11) * kPrime1;
+            tail++;
+            remaining--;
+        }
+
+        hash ^= hash >> 33;
+        hash *= kPrime2;
+        hash ^= hash >> 29;
+        hash *= kPrime3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+private:
+    static constexpr uint64_t kPrime1 = 11400714785074694791ULL;
+    static constexpr uint64_t kPrime2 = 14029467366897019727ULL;
+    static constexpr uint64_t kPrime3 = 1609587929392839161ULL;
+    static constexpr uint64_t kPrime4 = 9650029242287828579ULL;
+    static constexpr uint64_t kPrime5 = 2870177450012600261ULL;
+
+    uint64_t lanes_[4];
+    uint64_t seed_;
+    uint64_t length_;
+    unsigned char buffer_[32];
+    size_t pending_;
+
+    static uint64_t rotl(uint64_t value, int bits) {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    static uint64_t read64(const unsigned char* bytes) {
+        uint64_t value;
+        std::memcpy(&value, bytes, sizeof(value));
+        return value;
+    }
+
+    static uint64_t round(uint64_t accumulator, uint64_t input) {
+        accumulator += input * kPrime2;
+        return rotl(accumulator, 31) * kPrime1;
+    }
+
+    void consumeStripe(const unsigned char* stripe) {
+        for (int lane = 0; lane < 4; lane++) {
+            lanes_[lane] = round(lanes_[lane], read64(stripe + lane * 8));
+        }
+    }
+};
+
+std::string toHex(uint64_t value) {
+    char text[17];
+    std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(value));
+    return std::string(text, 16);
+}
+
+#pragma pack(push, 1)
+struct EntryHeader {
+    uint32_t magic;
+    uint32_t version;
+    char key[32];
+    double idm;
+    double maxDiameter;
+    double area;
+    double perimeter;
+    double circularity;
+    double relativeError;
+    float point1X;
+    float point1Y;
+    float point2X;
+    float point2Y;
+    int32_t contourPoints;
+    uint32_t textureBytes;
+    uint32_t sizeBytes;
+    uint32_t objectCount;
+    uint32_t pyramidDistances;
+    uint32_t pyramidScales;
+};
+
+struct ObjectRecord {
+    int32_t label;
+    int32_t contourPoints;
+    double maxDiameter;
+    double area;
+    double perimeter;
+    double circularity;
+    double relativeError;
+    float point1X;
+    float point1Y;
+    float point2X;
+    float point2Y;
+};
+#pragma pack(pop)
+
+// Запись: EntryHeader, две строки интерпретаций, objectCount записей ObjectRecord,
+// IDM пирамиды текстуры (pyramidScales * pyramidDistances * 4 double) и контрольный хеш
+// всего предыдущего.
+// Хеш ловит файлы, недописанные до сбоя питания (rename атомарен, но без fsync)
+std::string encodeEntry(const std::string& key, const AnalysisResults& results) {
+    EntryHeader header{};
+    header.magic = ResultCache::kMagic;
+    header.version = ResultCache::kVersion;
+    std::memcpy(header.key, key.data(), std::min(key.size(), sizeof(header.key)));
+    header.idm = results.idm_value;
+    header.maxDiameter = results.diameter_result.maxDiameter;
+    header.area = results.diameter_result.area;
+    header.perimeter = results.diameter_result.perimeter;
+    header.circularity = results.diameter_result.circularity;
+    header.relativeError = results.diameter_result.relativeError;
+    header.point1X = results.diameter_result.point1.x;
+    header.point1Y = results.diameter_result.point1.y;
+    header.point2X = results.diameter_result.point2.x;
+    header.point2Y = results.diameter_result.point2.y;
+    header.contourPoints = results.diameter_result.contourPoints;
+    header.textureBytes = static_cast<uint32_t>(results.texture_interpretation.size());
+    header.sizeBytes = static_cast<uint32_t>(results.size_interpretation.size());
+    header.objectCount = static_cast<uint32_t>(results.objects.size());
+    header.pyramidDistances = static_cast<uint32_t>(results.texture_pyramid.distances);
+    header.pyramidScales = static_cast<uint32_t>(results.texture_pyramid.scales);
+
+    std::string buffer(reinterpret_cast<const char*>(&header), sizeof(header));
+    buffer += results.texture_interpretation;
+    buffer += results.size_interpretation;
+    for (const DiameterResult& object : results.objects) {
+        ObjectRecord record{};
+        record.label = object.label;
+        record.contourPoints = object.contourPoints;
+        record.maxDiameter = object.maxDiameter;
+        record.area = object.area;
+        record.perimeter = object.perimeter;
+        record.circularity = object.circularity;
+        record.relativeError = object.relativeError;
+        record.point1X = object.point1.x;
+        record.point1Y = object.point1.y;
+        record.point2X = object.point2.x;
+        record.point2Y = object.point2.y;
+        buffer.append(reinterpret_cast<const char*>(&record), sizeof(record));
+    }
+    const std::vector<double>& pyramid = results.texture_pyramid.idm;
+    buffer.append(reinterpret_cast<const char*>(pyramid.data()), pyramid.size() * sizeof(double));
+
+    StreamHasher hasher;
+    hasher.update(buffer.data(), buffer.size());
+    uint64_t checksum = hasher.finish();
+    buffer.append(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+    return buffer;
+}
+
+bool decodeEntry(const std::string& buffer, const std::string& key, AnalysisResults& results) {
+    if (buffer.size() < sizeof(EntryHeader) + sizeof(uint64_t)) {
+        return false;
+    }
+
+    EntryHeader header;
+    std::memcpy(&header, buffer.data(), sizeof(header));
+    if (header.magic != ResultCache::kMagic || header.version != ResultCache::kVersion ||
+        key.size() != sizeof(header.key) || key.compare(0, key.size(), header.key, sizeof(header.key)) != 0) {
+        return false;
+    }
+
+    size_t strings = sizeof(header) + static_cast<size_t>(header.textureBytes) + header.sizeBytes;
+    size_t objects = strings + static_cast<size_t>(header.objectCount) * sizeof(ObjectRecord);
+    size_t pyramidValues = static_cast<size_t>(header.pyramidScales) * header.pyramidDistances * 4;
+    size_t payload = objects + pyramidValues * sizeof(double);
+    if (buffer.size() != payload + sizeof(uint64_t)) {
+        return false;
+    }
+
+    uint64_t checksum;
+    std::memcpy(&checksum, buffer.data() + payload, sizeof(checksum));
+    StreamHasher hasher;
+    hasher.update(buffer.data(), payload);
+    if (hasher.finish() != checksum) {
+        return false;
+    }
+
+    results.idm_value = header.idm;
+    results.diameter_result.maxDiameter = header.maxDiameter;
+    results.diameter_result.area = header.area;
+    results.diameter_result.perimeter = header.perimeter;
+    results.diameter_result.circularity = header.circularity;
+    results.diameter_result.relativeError = header.relativeError;
+    results.diameter_result.point1 = cv::Point2f(header.point1X, header.point1Y);
+    results.diameter_result.point2 = cv::Point2f(header.point2X, header.point2Y);
+    results.diameter_result.contourPoints = header.contourPoints;
+    results.texture_interpretation.assign(buffer, sizeof(header), header.textureBytes);
+    results.size_interpretation.assign(buffer, sizeof(header) + header.textureBytes, header.sizeBytes);
+
+    results.objects.resize(header.objectCount);
+    for (uint32_t i = 0; i < header.objectCount; i++) {
+        ObjectRecord record;
+        std::memcpy(&record, buffer.data() + strings + i * sizeof(record), sizeof(record));
+        DiameterResult& object = results.objects[i];
+        object.label = record.label;
+        object.contourPoints = record.contourPoints;
+        object.maxDiameter = record.maxDiameter;
+        object.area = record.area;
+        object.perimeter = record.perimeter;
+        object.circularity = record.circularity;
+        object.relativeError = record.relativeError;
+        object.point1 = cv::Point2f(record.point1X, record.point1Y);
+        object.point2 = cv::Point2f(record.point2X, record.point2Y);
+    }
+
+    results.texture_pyramid.distances = static_cast<int>(header.pyramidDistances);
+    results.texture_pyramid.scales = static_cast<int>(header.pyramidScales);
+    results.texture_pyramid.idm.resize(pyramidValues);
+    std::memcpy(results.texture_pyramid.idm.data(), buffer.data() + objects, pyramidValues * sizeof(double));
+    return true;
+}
+
+bool isEntryFile(const std::filesystem::path& path) {
+    return path.extension() == kEntryExtension;
+}
+
+bool isTempFile(const std::filesystem::path& path) {
+    return path.filename().string().find(kTempMarker) != std::string::npos;
+}
+
+}
+
+ResultCache::ResultCache(const std::string& directory, uint64_t maxBytes)
+    : directory_(directory), maxBytes_(maxBytes), open_(false),
+      usedBytes_(0), hits_(0), misses_(0), stores_(0), evictions_(0) {
+    std::error_code error;
+    std::filesystem::create_directories(directory_, error);
+    open_ = std::filesystem::is_directory(directory_, error);
+    if (!open_) {
+        LOG_ERROR("Cannot create cache directory: " << directory_);
+        return;
+    }
+
+    usedBytes_ = scanUsedBytes();
+    if (maxBytes_ > 0 && usedBytes_.load() > maxBytes_) {
+        evict();
+    }
+}
+
+bool ResultCache::hashFile(const std::string& path, uint64_t& hash) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+
+    StreamHasher hasher;
+    std::vector<char> chunk(1 << 20);
+    size_t bytesRead;
+    while ((bytesRead = std::fread(chunk.data(), 1, chunk.size(), file)) > 0) {
+        hasher.update(chunk.data(), bytesRead);
+    }
+    bool ok = !std::ferror(file);
+    std::fclose(file);
+
+    hash = hasher.finish();
+    return ok;
+}
+
+std::string ResultCache::makeKey(const std::string& imagePath, const std::string& parameters) {
+    uint64_t contentHash;
+    if (!hashFile(imagePath, contentHash)) {
+        return std::string();
+    }
+
+    // Версия формата входит в ключ: записи старой версии просто перестают находиться
+    StreamHasher hasher(kVersion);
+    hasher.update(parameters.data(), parameters.size());
+    return toHex(contentHash) + toHex(hasher.finish());
+}
+
+std::string ResultCache::entryPath(const std::string& key) const {
+    return (std::filesystem::path(directory_) / (key + kEntryExtension)).string();
+}
+
+bool ResultCache::lookup(const std::string& key, const std::string& imagePath, AnalysisResults& results) {
+    if (!open_ || key.empty()) {
+        return false;
+    }
+
+    std::string path = entryPath(key);
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        misses_++;
+        return false;
+    }
+    std::string buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+
+    AnalysisResults cached{};
+    if (!decodeEntry(buffer, key, cached)) {
+        LOG_WARNING("Discarding corrupt cache entry: " << path);
+        std::error_code error;
+        std::filesystem::remove(path, error);
+        misses_++;
+        return false;
+    }
+
+    // Время изменения служит меткой последнего использования для вытеснения (LRU)
+    std::error_code error;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+
+    cached.image_path = imagePath;
+    results = std::move(cached);
+    hits_++;
+    return true;
+}
+
+void ResultCache::store(const std::string& key, const AnalysisResults& results) {
+    if (!open_ || key.empty()) {
+        return;
+    }
+
+    static std::atomic<uint64_t> tempCounter(0);
+    std::string path = entryPath(key);
+    std::string tempPath = path + kTempMarker + std::to_string(::getpid()) + "." +
+                           std::to_string(tempCounter++);
+
+    std::string buffer = encodeEntry(key, results);
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        file.write(buffer.data(), buffer.size());
+        if (!file.good()) {
+            LOG_WARNING("Cannot write cache entry: " << tempPath);
+            file.close();
+            std::error_code error;
+            std::filesystem::remove(tempPath, error);
+            return;
+        }
+    }
+
+    // rename() атомарно заменяет запись, если тот же ключ посчитал другой процесс
+    std::error_code error;
+    std::filesystem::rename(tempPath, path, error);
+    if (error) {
+        LOG_WARNING("Cannot publish cache entry " << path << ": " << error.message());
+        std::filesystem::remove(tempPath, error);
+        return;
+    }
+
+    stores_++;
+    uint64_t used = usedBytes_.fetch_add(buffer.size()) + buffer.size();
+    if (maxBytes_ > 0 && used > maxBytes_) {
+        evict();
+    }
+}
+
+uint64_t ResultCache::scanUsedBytes() const {
+    uint64_t total = 0;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(directory_, error)) {
+        if (isEntryFile(entry.path())) {
+            uint64_t size = entry.file_size(error);
+            total += error ? 0 : size;
+        }
+    }
+    return total;
+}
+
+void ResultCache::evict() {
+    // Одновременно чистит один поток; остальные продолжают работу
+    std::unique_lock<std::mutex> lock(evictMutex_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return;
+    }
+
+    struct Entry {
+        std::filesystem::path path;
+        std::filesystem::file_time_type lastUsed;
+        uint64_t size;
+    };
+
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    auto now = std::filesystem::file_time_type::clock::now();
+    std::error_code error;
+    for (const auto& item : std::filesystem::directory_iterator(directory_, error)) {
+        std::error_code itemError;
+        auto lastUsed = item.last_write_time(itemError);
+        uint64_t size = item.file_size(itemError);
+        if (itemError) {
+            // Файл удалён другим процессом во время обхода
+            continue;
+        }
+
+        if (isTempFile(item.path())) {
+            if (now - lastUsed > kStaleTempAge) {
+                std::filesystem::remove(item.path(), itemError);
+            }
+        } else if (isEntryFile(item.path())) {
+            entries.push_back({item.path(), lastUsed, size});
+            total += size;
+        }
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.lastUsed < b.lastUsed;
+    });
+
+    uint64_t target = static_cast<uint64_t>(maxBytes_ * kEvictTargetRatio);
+    for (const Entry& entry : entries) {
+        if (total <= target) {
+            break;
+        }
+        // Ошибку удаления игнорируем: запись мог уже вытеснить соседний процесс
+        std::error_code removeError;
+        if (std::filesystem::remove(entry.path, removeError)) {
+            evictions_++;
+        }
+        total -= entry.size;
+    }
+
+    usedBytes_ = total;
+    LOG_DEBUG("Cache eviction: " << total / 1024 << " KB kept in " << directory_);
+}
+
+CacheStats ResultCache::stats() const {
+    CacheStats stats;
+    stats.hits = hits_.load();
+    stats.misses = misses_.load();
+    stats.stores = stores_.load();
+    stats.evictions = evictions_.load();
+    return stats;
+}
@@ -0,0 +1,373 @@
+#include "ResultSink.h"
+#include "Logger.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+void appendNumber(std::string& buffer, double value) {
+    char text[32];
+    int length = std::snprintf(text, sizeof(text), "%.9g", value);
+    buffer.append(text, length);
+}
+
+void appendJsonString(std::string& buffer, const std::string& value) {
+    buffer += '"';
+    for (char c : value) {
+        switch (c) {
+            case '"':  buffer += "\\\""; break;
+            case '\\': buffer += "\\\\"; break;
+            case '\n': buffer += "\\n"; break;
+            case '\r': buffer += "\\r"; break;
+            case '\t': buffer += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    buffer += escaped;
+                } else {
+                    buffer += c;
+                }
+        }
+    }
+    buffer += '"';
+}
+
+void appendCsvString(std::string& buffer, const std::string& value) {
+    if (value.find_first_of(",\"\n\r") == std::string::npos) {
+        buffer += value;
+        return;
+    }
+    buffer += '"';
+    for (char c : value) {
+        if (c == '"') {
+            buffer += '"';
+        }
+        buffer += c;
+    }
+    buffer += '"';
+}
+
+template <typename T>
+void appendColumn(std::string& buffer, std::vector<T>& column) {
+    buffer.append(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(T));
+    column.clear();
+}
+
+}
+
+ResultSink::ResultSink(size_t batchSize) 
+    : open_(false), pending_(0), batchSize_(batchSize > 0 ? batchSize : 1), written_(0) {}
+
+ResultSink::~ResultSink() {
+    flush();
+}
+
+bool ResultSink::openFile(const std::string& path, bool binary) {
+    std::ios::openmode mode = std::ios::out | std::ios::app;
+    if (binary) {
+        mode = std::ios::out | std::ios::in | std::ios::binary;
+        file_.open(path, mode);
+        if (!file_.is_open()) {
+            file_.clear();
+            file_.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        }
+    } else {
+        file_.open(path, mode);
+    }
+    
+    open_ = file_.is_open();
+    if (!open_) {
+        LOG_ERROR("Error creating results file: " << path);
+    }
+    return open_;
+}
+
+void ResultSink::write(const AnalysisResults& results) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    encode(results, buffer_);
+    pending_++;
+    if (pending_ >= batchSize_) {
+        flushLocked();
+    }
+}
+
+void ResultSink::flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    flushLocked();
+}
+
+void ResultSink::flushLocked() {
+    if (pending_ == 0) {
+        return;
+    }
+    
+    finishBatch(buffer_);
+    if (open_) {
+        file_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+        batchWritten();
+        file_.flush();
+    }
+    written_ += pending_;
+    pending_ = 0;
+    buffer_.clear();
+}
+
+size_t ResultSink::recordsWritten() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return written_;
+}
+
+bool ResultSink::parseFormat(const std::string& name, ResultFormat& format) {
+    if (name == "jsonl" || name == "json") {
+        format = ResultFormat::JsonLines;
+    } else if (name == "csv") {
+        format = ResultFormat::Csv;
+    } else if (name == "bin" || name == "binary") {
+        format = ResultFormat::Binary;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<ResultSink> ResultSink::create(ResultFormat format, const std::string& path) {
+    switch (format) {
+        case ResultFormat::Csv:
+            return std::unique_ptr<ResultSink>(new CsvSink(path));
+        case ResultFormat::Binary:
+            return std::unique_ptr<ResultSink>(new BinarySink(path));
+        default:
+            return std::unique_ptr<ResultSink>(new JsonLinesSink(path));
+    }
+}
+
+JsonLinesSink::JsonLinesSink(const std::string& path) {
+    openFile(path, false);
+}
+
+void JsonLinesSink::encode(const AnalysisResults& results, std::string& buffer) {
+    encodeObject(results, buffer);
+    buffer += '\n';
+}
+
+void JsonLinesSink::encodeObject(const AnalysisResults& results, std::string& buffer) {
+    const DiameterResult& d = results.diameter_result;
+    
+    buffer += "{\"image_path\":";
+    appendJsonString(buffer, results.image_path);
+    buffer += ",\"idm\":";
+    appendNumber(buffer, results.idm_value);
+    buffer += ",\"idm_interpretation\":";
+    appendJsonString(buffer, results.texture_interpretation);
+    buffer += ",\"max_diameter\":";
+    appendNumber(buffer, d.maxDiameter);
+    buffer += ",\"area\":";
+    appendNumber(buffer, d.area);
+    buffer += ",\"perimeter\":";
+    appendNumber(buffer, d.perimeter);
+    buffer += ",\"circularity\":";
+    appendNumber(buffer, d.circularity);
+    if (d.relativeError > 0) {
+        buffer += ",\"diameter_error\":";
+        appendNumber(buffer, d.relativeError);
+    }
+    buffer += ",\"contour_points\":";
+    buffer += std::to_string(d.contourPoints);
+    buffer += ",\"size_interpretation\":";
+    appendJsonString(buffer, results.size_interpretation);
+    buffer += ",\"point1\":[";
+    appendNumber(buffer, d.point1.x);
+    buffer += ',';
+    appendNumber(buffer, d.point1.y);
+    buffer += "],\"point2\":[";
+    appendNumber(buffer, d.point2.x);
+    buffer += ',';
+    appendNumber(buffer, d.point2.y);
+    buffer += ']';
+    
+    const TexturePyramid& pyramid = results.texture_pyramid;
+    if (pyramid.scales > 0) {
+        buffer += ",\"texture_pyramid\":{\"distances\":";
+        buffer += std::to_string(pyramid.distances);
+        buffer += ",\"scales\":";
+        buffer += std::to_string(pyramid.scales);
+        buffer += ",\"idm\":[";
+        for (size_t i = 0; i < pyramid.idm.size(); i++) {
+            if (i > 0) {
+                buffer += ',';
+            }
+            appendNumber(buffer, pyramid.idm[i]);
+        }
+        buffer += "]}";
+    }
+    
+    if (!results.objects.empty()) {
+        buffer += ",\"objects\":[";
+        for (size_t i = 0; i < results.objects.size(); i++) {
+            const DiameterResult& object = results.objects[i];
+            buffer += i > 0 ? ",{\"label\":" : "{\"label\":";
+            buffer += std::to_string(object.label);
+            buffer += ",\"max_diameter\":";
+            appendNumber(buffer, object.maxDiameter);
+            buffer += ",\"area\":";
+            appendNumber(buffer, object.area);
+            buffer += ",\"perimeter\":";
+            appendNumber(buffer, object.perimeter);
+            buffer += ",\"circularity\":";
+            appendNumber(buffer, object.circularity);
+            if (object.relativeError > 0) {
+                buffer += ",\"diameter_error\":";
+                appendNumber(buffer, object.relativeError);
+            }
+            buffer += ",\"point1\":[";
+            appendNumber(buffer, object.point1.x);
+            buffer += ',';
+            appendNumber(buffer, object.point1.y);
+            buffer += "],\"point2\":[";
+            appendNumber(buffer, object.point2.x);
+            buffer += ',';
+            appendNumber(buffer, object.point2.y);
+            buffer += "]}";
+        }
+        buffer += ']';
+    }
+    buffer += '}';
+}
+
+CsvSink::CsvSink(const std::string& path) {
+    if (openFile(path, false)) {
+        file_.seekp(0, std::ios::end);
+        if (file_.tellp() == 0) {
+            file_ << "image_path,idm,idm_interpretation,max_diameter,area,perimeter,circularity,"
+                     "contour_points,size_interpretation,point1_x,point1_y,point2_x,point2_y\n";
+        }
+    }
+}
+
+void CsvSink::encode(const AnalysisResults& results, std::string& buffer) {
+    const DiameterResult& d = results.diameter_result;
+    
+    appendCsvString(buffer, results.image_path);
+    buffer += ',';
+    appendNumber(buffer, results.idm_value);
+    buffer += ',';
+    appendCsvString(buffer, results.texture_interpretation);
+    buffer += ',';
+    appendNumber(buffer, d.maxDiameter);
+    buffer += ',';
+    appendNumber(buffer, d.area);
+    buffer += ',';
+    appendNumber(buffer, d.perimeter);
+    buffer += ',';
+    appendNumber(buffer, d.circularity);
+    buffer += ',';
+    buffer += std::to_string(d.contourPoints);
+    buffer += ',';
+    appendCsvString(buffer, results.size_interpretation);
+    buffer += ',';
+    appendNumber(buffer, d.point1.x);
+    buffer += ',';
+    appendNumber(buffer, d.point1.y);
+    buffer += ',';
+    appendNumber(buffer, d.point2.x);
+    buffer += ',';
+    appendNumber(buffer, d.point2.y);
+    buffer += '\n';
+}
+
+BinarySink::BinarySink(const std::string& path) : records_(0), blocks_(0) {
+    if (!openFile(path, true)) {
+        return;
+    }
+    
+    // Дописываем к существующему файлу того же формата; пустой файл начинаем заново,
+    // а чужие данные не трогаем
+    file_.seekg(0, std::ios::end);
+    std::streamoff size = file_.tellg();
+    FileHeader header;
+    file_.seekg(0, std::ios::beg);
+    if (size > 0) {
+        if (!file_.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            header.magic != kMagic || header.version != kVersion) {
+            LOG_ERROR("Results file is not a binary results file of version " << kVersion << ": " << path);
+            file_.close();
+            open_ = false;
+            return;
+        }
+        records_ = header.recordCount;
+        blocks_ = header.blockCount;
+    } else {
+        file_.clear();
+        writeHeader();
+    }
+    file_.seekp(0, std::ios::end);
+}
+
+BinarySink::~BinarySink() {
+    flush();
+}
+
+void BinarySink::writeHeader() {
+    FileHeader header;
+    header.magic = kMagic;
+    header.version = kVersion;
+    header.recordCount = records_;
+    header.blockCount = blocks_;
+    header.reserved = 0;
+    file_.seekp(0, std::ios::beg);
+    file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+void BinarySink::batchWritten() {
+    // Блок уже записан: при обрыве заголовок отстаёт от данных, но не опережает их
+    writeHeader();
+    file_.seekp(0, std::ios::end);
+}
+
+void BinarySink::encode(const AnalysisResults& results, std::string& buffer) {
+    (void)buffer;
+    const DiameterResult& d = results.diameter_result;
+    
+    idm_.push_back(results.idm_value);
+    maxDiameter_.push_back(d.maxDiameter);
+    area_.push_back(d.area);
+    perimeter_.push_back(d.perimeter);
+    circularity_.push_back(d.circularity);
+    point1X_.push_back(d.point1.x);
+    point1Y_.push_back(d.point1.y);
+    point2X_.push_back(d.point2.x);
+    point2Y_.push_back(d.point2.y);
+    contourPoints_.push_back(d.contourPoints);
+    pathLengths_.push_back(static_cast<uint32_t>(results.image_path.size()));
+    paths_ += results.image_path;
+}
+
+void BinarySink::finishBatch(std::string& buffer) {
+    BlockHeader block;
+    block.recordCount = static_cast<uint32_t>(idm_.size());
+    block.pathBytes = static_cast<uint32_t>(paths_.size());
+    if (block.recordCount == 0) {
+        return;
+    }
+    
+    buffer.append(reinterpret_cast<const char*>(&block), sizeof(block));
+    appendColumn(buffer, idm_);
+    appendColumn(buffer, maxDiameter_);
+    appendColumn(buffer, area_);
+    appendColumn(buffer, perimeter_);
+    appendColumn(buffer, circularity_);
+    appendColumn(buffer, point1X_);
+    appendColumn(buffer, point1Y_);
+    appendColumn(buffer, point2X_);
+    appendColumn(buffer, point2Y_);
+    appendColumn(buffer, contourPoints_);
+    appendColumn(buffer, pathLengths_);
+    buffer += paths_;
+    paths_.clear();
+    buffer.append((8 - buffer.size() % 8) % 8, '\0');
+    
+    records_ += block.recordCount;
+    blocks_++;
+}
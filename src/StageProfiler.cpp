@@ -0,0 +1,210 @@
+#include "StageProfiler.h"
+#include "Logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct StageEvent {
+    Stage stage;
+    int64_t startNs;
+    int64_t durationNs;
+};
+
+// Столько последних событий каждой стадии хранит поток. Демон и потоковый режим
+// профилируются без конца, поэтому старые события вытесняются по кольцу; число вызовов
+// и суммарное время стадии считаются по всем событиям, перцентили и трасса - по хранимым
+const size_t kEventsPerStage = 8192;
+
+struct StageRing {
+    std::vector<StageEvent> events;
+    size_t next = 0;
+    uint64_t count = 0;
+    int64_t totalNs = 0;
+};
+
+// Буфер событий одного потока. Мьютекс почти никогда не конкурирует:
+// его берёт только отчёт, который читает буферы всех потоков.
+struct ThreadEvents {
+    int threadId;
+    std::mutex mutex;
+    StageRing stages[static_cast<int>(Stage::Count)];
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadEvents>> threads;
+    const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+// Буферы живут в реестре и переживают завершение своих потоков
+ThreadEvents& localEvents() {
+    thread_local std::shared_ptr<ThreadEvents> local;
+    if (!local) {
+        local = std::make_shared<ThreadEvents>();
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        local->threadId = static_cast<int>(reg.threads.size()) + 1;
+        reg.threads.push_back(local);
+    }
+    return *local;
+}
+
+std::vector<std::pair<int, StageEvent>> snapshot() {
+    std::vector<std::pair<int, StageEvent>> all;
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (const auto& thread : reg.threads) {
+        std::lock_guard<std::mutex> threadLock(thread->mutex);
+        for (const StageRing& ring : thread->stages) {
+            for (const StageEvent& event : ring.events) {
+                all.emplace_back(thread->threadId, event);
+            }
+        }
+    }
+    return all;
+}
+
+// Ближайший ранг по отсортированной выборке
+double percentileMs(const std::vector<int64_t>& sorted, double p) {
+    size_t rank = static_cast<size_t>(p / 100.0 * sorted.size() + 0.999999);
+    rank = std::min(std::max<size_t>(rank, 1), sorted.size());
+    return sorted[rank - 1] / 1e6;
+}
+
+}
+
+int64_t StageProfiler::nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - registry().origin).count();
+}
+
+const char* StageProfiler::stageName(Stage stage) {
+    switch (stage) {
+        case Stage::Decode: return "decode";
+        case Stage::Grayscale: return "grayscale";
+        case Stage::Resize: return "resize";
+        case Stage::GLCM: return "glcm";
+        case Stage::IDM: return "idm";
+        case Stage::Otsu: return "otsu";
+        case Stage::Contours: return "contours";
+        case Stage::Diameter: return "diameter";
+        default: return "unknown";
+    }
+}
+
+void StageProfiler::record(Stage stage, int64_t startNs, int64_t durationNs) {
+    ThreadEvents& local = localEvents();
+    std::lock_guard<std::mutex> lock(local.mutex);
+    StageRing& ring = local.stages[static_cast<int>(stage)];
+    ring.count++;
+    ring.totalNs += durationNs;
+    if (ring.events.size() < kEventsPerStage) {
+        ring.events.push_back({stage, startNs, durationNs});
+    } else {
+        ring.events[ring.next] = {stage, startNs, durationNs};
+        ring.next = (ring.next + 1) % kEventsPerStage;
+    }
+}
+
+void StageProfiler::reset() {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (const auto& thread : reg.threads) {
+        std::lock_guard<std::mutex> threadLock(thread->mutex);
+        for (StageRing& ring : thread->stages) {
+            ring = StageRing();
+        }
+    }
+}
+
+void StageProfiler::printReport(std::ostream& out) {
+    const int stageCount = static_cast<int>(Stage::Count);
+    std::vector<std::vector<int64_t>> durations(stageCount);
+    std::vector<uint64_t> counts(stageCount, 0);
+    std::vector<int64_t> totals(stageCount, 0);
+    {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        for (const auto& thread : reg.threads) {
+            std::lock_guard<std::mutex> threadLock(thread->mutex);
+            for (int s = 0; s < stageCount; s++) {
+                const StageRing& ring = thread->stages[s];
+                counts[s] += ring.count;
+                totals[s] += ring.totalNs;
+                for (const StageEvent& event : ring.events) {
+                    durations[s].push_back(event.durationNs);
+                }
+            }
+        }
+    }
+    bool truncated = false;
+
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+
+    out << "\nStage timings (ms):" << std::endl;
+    out << std::left << std::setw(12) << "stage" << std::right << std::setw(8) << "count"
+        << std::setw(12) << "total" << std::setw(10) << "p50" << std::setw(10) << "p95"
+        << std::setw(10) << "p99" << std::setw(10) << "max" << std::endl;
+
+    for (int s = 0; s < stageCount; s++) {
+        std::vector<int64_t>& samples = durations[s];
+        if (samples.empty()) {
+            continue;
+        }
+        std::sort(samples.begin(), samples.end());
+        truncated = truncated || counts[s] > samples.size();
+
+        out << std::left << std::setw(12) << stageName(static_cast<Stage>(s)) << std::right
+            << std::setw(8) << counts[s] << std::fixed << std::setprecision(3)
+            << std::setw(12) << totals[s] / 1e6
+            << std::setw(10) << percentileMs(samples, 50)
+            << std::setw(10) << percentileMs(samples, 95)
+            << std::setw(10) << percentileMs(samples, 99)
+            << std::setw(10) << samples.back() / 1e6 << std::endl;
+    }
+    if (truncated) {
+        out << "(percentiles and max over the last " << kEventsPerStage
+            << " calls of each stage per thread)" << std::endl;
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
+
+bool StageProfiler::writeChromeTrace(const std::string& path) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        LOG_ERROR("Error creating trace file: " << path);
+        return false;
+    }
+
+    std::vector<std::pair<int, StageEvent>> events = snapshot();
+    std::string buffer = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    char line[160];
+    for (size_t i = 0; i < events.size(); i++) {
+        const StageEvent& event = events[i].second;
+        std::snprintf(line, sizeof(line),
+                      "{\"name\":\"%s\",\"cat\":\"analysis\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                      "\"ts\":%.3f,\"dur\":%.3f}%s\n",
+                      stageName(event.stage), events[i].first, event.startNs / 1e3,
+                      event.durationNs / 1e3, i + 1 < events.size() ? "," : "");
+        buffer += line;
+    }
+    buffer += "]}\n";
+
+    file << buffer;
+    return static_cast<bool>(file);
+}
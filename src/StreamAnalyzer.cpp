@@ -0,0 +1,335 @@
+#include "StreamAnalyzer.h"
+#include "ImageLoader.h"
+#include "TextureAnalyzer.h"
+#include "MorphologyAnalyzer.h"
+#include "HistogramKernels.h"
+#include "ThreadPool.h"
+#include "Logger.h"
+#include "StageProfiler.h"
+#include <cstring>
+
+namespace {
+
+// Меньше тайлов пересчитывается в вызывающем потоке: задачи пула дороже
+const size_t kParallelTiles = 16;
+
+}
+
+StreamAnalyzer::StreamAnalyzer(const StreamOptions& options)
+    : options_(options), threshold_(-1), columns_(0), rows_(0) {
+    if (!TextureAnalyzer::isSupportedLevels(options_.analysis.levels)) {
+        LOG_ERROR("Error: Unsupported number of grey levels: " << options_.analysis.levels << ", using 256");
+        options_.analysis.levels = 256;
+    }
+    options_.tileSize = std::max(options_.tileSize, 8);
+    options_.tolerance = std::max(options_.tolerance, 0);
+}
+
+void StreamAnalyzer::reset() {
+    reference_.release();
+    threshold_ = -1;
+}
+
+cv::Rect StreamAnalyzer::tileRect(int tile) const {
+    const int tileSize = options_.tileSize;
+    const int x = (tile % columns_) * tileSize;
+    const int y = (tile / columns_) * tileSize;
+    return cv::Rect(x, y, std::min(tileSize, reference_.cols - x), std::min(tileSize, reference_.rows - y));
+}
+
+// Опорный кадр с нуля: все тайлы изменились, их прежний вклад нулевой
+void StreamAnalyzer::start(const cv::Mat& gray) {
+    const int levels = options_.analysis.levels;
+    gray.copyTo(reference_);
+    binary_.create(reference_.size(), CV_8UC1);
+    threshold_ = -1;
+
+    columns_ = (reference_.cols + options_.tileSize - 1) / options_.tileSize;
+    rows_ = (reference_.rows + options_.tileSize - 1) / options_.tileSize;
+    const size_t tiles = static_cast<size_t>(columns_) * rows_;
+
+    tileDifferences_.assign(tiles * 4 * levels, 0);
+    tileIntensity_.assign(tiles * 256, 0);
+    differences_.assign(4, std::vector<int64_t>(levels, 0));
+    intensity_.assign(256, 0);
+    changed_.assign(tiles, 1);
+    textureDirty_.assign(tiles, 0);
+    dirtyTiles_.reserve(tiles);
+}
+
+// Сравнение с опорным кадром; изменившиеся тайлы переносятся в него целиком
+bool StreamAnalyzer::detectChanges(const cv::Mat& gray) {
+    const int tolerance = options_.tolerance;
+    bool any = false;
+
+    for (size_t tile = 0; tile < changed_.size(); tile++) {
+        const cv::Rect rect = tileRect(static_cast<int>(tile));
+        bool changed = false;
+        for (int y = rect.y; y < rect.y + rect.height && !changed; y++) {
+            const uchar* current = gray.ptr<uchar>(y) + rect.x;
+            const uchar* previous = reference_.ptr<uchar>(y) + rect.x;
+            int maxDifference = 0;
+            for (int x = 0; x < rect.width; x++) {
+                maxDifference = std::max(maxDifference, std::abs(current[x] - previous[x]));
+            }
+            changed = maxDifference > tolerance;
+        }
+
+        changed_[tile] = changed;
+        if (changed) {
+            for (int y = rect.y; y < rect.y + rect.height; y++) {
+                std::memcpy(reference_.ptr<uchar>(y) + rect.x, gray.ptr<uchar>(y) + rect.x, rect.width);
+            }
+            any = true;
+        }
+    }
+    return any;
+}
+
+// Вклад тайла: пары, первый пиксель которых лежит в тайле, как в TiledAnalyzer.
+// Вид берётся с каймой в 1 пиксель справа, сверху и снизу
+void StreamAnalyzer::accumulateTile(int tile) {
+    const int levels = options_.analysis.levels;
+    const int shift = 8 - static_cast<int>(std::log2(levels));
+    const cv::Rect core = tileRect(tile);
+
+    cv::Rect region(core.x, std::max(0, core.y - 1), 0, 0);
+    region.width = std::min(reference_.cols, core.x + core.width + 1) - region.x;
+    region.height = std::min(reference_.rows, core.y + core.height + 1) - region.y;
+    const cv::Mat view = reference_(region);
+    const int yStart = core.y - region.y;
+
+    int* histograms = tileDifferences_.data() + static_cast<size_t>(tile) * 4 * levels;
+    std::fill(histograms, histograms + 4 * levels, 0);
+    HistogramKernels::accumulateDirections(view, yStart, yStart + core.height, levels, histograms,
+                                           HistogramKernels::activeIsa());
+
+    // Вертикальные пары правой каймы принадлежат тайлу справа
+    if (region.width > core.width) {
+        const int haloColumn = view.cols - 1;
+        for (int y = yStart; y < yStart + core.height && y + 1 < view.rows; y++) {
+            int a = view.at<uchar>(y, haloColumn) >> shift;
+            int b = view.at<uchar>(y + 1, haloColumn) >> shift;
+            histograms[levels + std::abs(a - b)]--;
+        }
+    }
+
+    if (changed_[tile]) {
+        int* intensity = tileIntensity_.data() + static_cast<size_t>(tile) * 256;
+        std::fill(intensity, intensity + 256, 0);
+        for (int y = core.y; y < core.y + core.height; y++) {
+            const uchar* row = reference_.ptr<uchar>(y) + core.x;
+            for (int x = 0; x < core.width; x++) {
+                intensity[row[x]]++;
+            }
+        }
+    }
+}
+
+void StreamAnalyzer::updateTexture(ThreadPool* pool) {
+    const int levels = options_.analysis.levels;
+
+    // Пара (p, p + d) при d = (1,0), (0,1), (1,1), (1,-1) принадлежит тайлу p: изменение
+    // тайла задевает пары тайлов слева, сверху, слева сверху, а через (1,-1) -
+    // тайлов снизу и слева снизу (их первая строка смотрит в нижнюю строку тайла)
+    std::fill(textureDirty_.begin(), textureDirty_.end(), 0);
+    for (int row = 0; row < rows_; row++) {
+        for (int column = 0; column < columns_; column++) {
+            if (!changed_[row * columns_ + column]) {
+                continue;
+            }
+            const int neighbours[6][2] = {{0, 0}, {-1, 0}, {0, -1}, {-1, -1}, {-1, 1}, {0, 1}};
+            for (const auto& offset : neighbours) {
+                int c = column + offset[0];
+                int r = row + offset[1];
+                if (c >= 0 && r >= 0 && r < rows_) {
+                    textureDirty_[r * columns_ + c] = 1;
+                }
+            }
+        }
+    }
+
+    dirtyTiles_.clear();
+    for (size_t tile = 0; tile < textureDirty_.size(); tile++) {
+        if (textureDirty_[tile]) {
+            dirtyTiles_.push_back(static_cast<int>(tile));
+        }
+    }
+
+    auto apply = [&](int sign) {
+        for (int tile : dirtyTiles_) {
+            const int* histograms = tileDifferences_.data() + static_cast<size_t>(tile) * 4 * levels;
+            for (int d = 0; d < 4; d++) {
+                for (int k = 0; k < levels; k++) {
+                    differences_[d][k] += sign * histograms[d * levels + k];
+                }
+            }
+            if (changed_[tile]) {
+                const int* intensity = tileIntensity_.data() + static_cast<size_t>(tile) * 256;
+                for (int k = 0; k < 256; k++) {
+                    intensity_[k] += sign * intensity[k];
+                }
+            }
+        }
+    };
+
+    StageProfiler::Scope timing(Stage::GLCM);
+    apply(-1);
+    if (pool && dirtyTiles_.size() >= kParallelTiles) {
+        const size_t chunk = std::max<size_t>(1, dirtyTiles_.size() / (4 * pool->threadCount()));
+        ThreadPool::TaskGroup group(*pool);
+        for (size_t begin = 0; begin < dirtyTiles_.size(); begin += chunk) {
+            const size_t end = std::min(dirtyTiles_.size(), begin + chunk);
+            group.run([this, begin, end]() {
+                for (size_t i = begin; i < end; i++) {
+                    accumulateTile(dirtyTiles_[i]);
+                }
+            });
+        }
+        group.wait();
+    } else {
+        for (int tile : dirtyTiles_) {
+            accumulateTile(tile);
+        }
+    }
+    apply(1);
+
+    stats_.textureTiles += dirtyTiles_.size();
+}
+
+// Перебинаризация области по текущему порогу; true, если маска в ней изменилась
+bool StreamAnalyzer::updateMask(const cv::Rect& region) {
+    bool changed = false;
+    for (int y = region.y; y < region.y + region.height; y++) {
+        const uchar* gray = reference_.ptr<uchar>(y) + region.x;
+        uchar* mask = binary_.ptr<uchar>(y) + region.x;
+        for (int x = 0; x < region.width; x++) {
+            uchar value = gray[x] > threshold_ ? 255 : 0;
+            changed |= mask[x] != value;
+            mask[x] = value;
+        }
+    }
+    return changed;
+}
+
+double StreamAnalyzer::idm() const {
+    const int64_t width = reference_.cols;
+    const int64_t height = reference_.rows;
+    const int64_t totals[4] = {
+        (width - 1) * height,
+        width * (height - 1),
+        (width - 1) * (height - 1),
+        (width - 1) * (height - 1)
+    };
+
+    StageProfiler::Scope timing(Stage::IDM);
+    double totalIDM = 0.0;
+    int validDirections = 0;
+    for (int d = 0; d < 4; d++) {
+        double idm = totals[d] > 0 ? TextureAnalyzer::idmFromCounts(differences_[d], totals[d]) : 0.0;
+        if (idm > 0) {
+            totalIDM += idm;
+            validDirections++;
+        }
+    }
+    return validDirections > 0 ? totalIDM / validDirections : 0.0;
+}
+
+bool StreamAnalyzer::process(const cv::Mat& frame, AnalysisResults& results, ThreadPool* pool) {
+    if (frame.empty() || frame.depth() != CV_8U) {
+        LOG_ERROR("Error: Frame must be 8-bit");
+        return false;
+    }
+
+    try {
+        // Как в analyzeImage: цветной кадр уменьшается до перевода в серый
+        const int analysisSize = options_.analysis.analysisSize;
+        cv::Mat gray;
+        if (frame.channels() == 1) {
+            gray = ImageLoader::resizeImage(frame, analysisSize, workspace_.resized);
+        } else {
+            cv::Mat small = ImageLoader::resizeImage(frame, analysisSize, workspace_.resizedColor);
+            gray = ImageLoader::convertToGrayscale(small, workspace_.gray);
+            if (gray.empty()) {
+                return false;
+            }
+        }
+
+        const bool keyframe = reference_.empty() || gray.size() != reference_.size() ||
+                              (options_.keyframeInterval > 0 &&
+                               stats_.frames % static_cast<uint64_t>(options_.keyframeInterval) == 0);
+        bool changed = true;
+        if (keyframe) {
+            start(gray);
+            stats_.keyframes++;
+        } else {
+            changed = detectChanges(gray);
+        }
+
+        const size_t tiles = changed_.size();
+        size_t changedTiles = 0;
+        bool maskChanged = keyframe;
+        if (changed) {
+            updateTexture(pool);
+
+            int threshold;
+            {
+                StageProfiler::Scope timing(Stage::Otsu);
+                threshold = MorphologyAnalyzer::otsuThreshold(intensity_);
+            }
+            // Новый порог меняет маску везде, старый - только в изменившихся тайлах
+            const bool thresholdChanged = threshold != threshold_;
+            threshold_ = threshold;
+            if (thresholdChanged) {
+                maskChanged |= updateMask(cv::Rect(0, 0, reference_.cols, reference_.rows));
+            }
+            for (size_t tile = 0; tile < tiles; tile++) {
+                if (changed_[tile]) {
+                    changedTiles++;
+                    if (!thresholdChanged) {
+                        maskChanged |= updateMask(tileRect(static_cast<int>(tile)));
+                    }
+                }
+            }
+        }
+
+        results.idm_value = idm();
+        results.texture_interpretation = ImageAnalysisCore::interpretIDM(results.idm_value);
+
+        if (maskChanged) {
+            ImageAnalysisCore::analyzeMask(binary_, reference_, options_.analysis, results, workspace_);
+            diameter_ = results.diameter_result;
+            objects_ = results.objects;
+            sizeInterpretation_ = results.size_interpretation;
+            stats_.morphologyRuns++;
+        } else {
+            results.diameter_result = diameter_;
+            results.objects = objects_;
+            results.size_interpretation = sizeInterpretation_;
+        }
+
+        LOG_DEBUG("Frame " << stats_.frames << ": " << changedTiles << " of " << tiles
+                  << " tiles changed, " << (changed ? dirtyTiles_.size() : 0) << " re-analysed, morphology "
+                  << (maskChanged ? "recomputed" : "reused"));
+
+        stats_.frames++;
+        stats_.changedTiles += changedTiles;
+        stats_.totalTiles += tiles;
+    } catch (const cv::Exception& e) {
+        LOG_ERROR("Error analysing frame: " << e.what());
+        reset();
+        return false;
+    }
+
+    return ImageAnalysisCore::succeeded(results);
+}
+
+void StreamAnalyzer::printStats(const StreamStats& stats) {
+    std::cout << "\nStream completed: " << stats.frames << " frames, " << stats.keyframes
+              << " keyframes, morphology recomputed " << stats.morphologyRuns << " times" << std::endl;
+    if (stats.totalTiles > 0) {
+        std::cout << "   Tiles changed: " << std::fixed << std::setprecision(1)
+                  << 100.0 * stats.changedTiles / stats.totalTiles << "%, re-analysed: "
+                  << 100.0 * stats.textureTiles / stats.totalTiles << "%" << std::endl;
+    }
+}
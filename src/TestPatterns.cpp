@@ -0,0 +1,58 @@
+#include "TestPatterns.h"
+
+cv::Mat TestPatterns::uniform(int size) {
+    return cv::Mat(size, size, CV_8UC1, cv::Scalar(128));
+}
+
+cv::Mat TestPatterns::circle(int size) {
+    cv::Mat circle = cv::Mat::zeros(size, size, CV_8UC1);
+    cv::circle(circle, cv::Point(size / 2, size / 2), size / 4, 255, -1);
+    return circle;
+}
+
+cv::Mat TestPatterns::chessboard(int size) {
+    cv::Mat chess = cv::Mat::zeros(size, size, CV_8UC1);
+    int cell = std::max(1, size / 8);
+    for (int i = 0; i < size; i += cell) {
+        for (int j = 0; j < size; j += cell) {
+            if (((i / cell) + (j / cell)) % 2 == 0) {
+                cv::rectangle(chess, cv::Point(j, i), cv::Point(j + cell, i + cell), 255, -1);
+            }
+        }
+    }
+    return chess;
+}
+
+cv::Mat TestPatterns::square(int size) {
+    cv::Mat square = cv::Mat::zeros(size, size, CV_8UC1);
+    cv::rectangle(square, cv::Point(size / 4, size / 4), cv::Point(3 * size / 4, 3 * size / 4), 255, -1);
+    return square;
+}
+
+cv::Mat TestPatterns::noise(int size) {
+    cv::Mat noise = cv::Mat::zeros(size, size, CV_8UC1);
+    cv::randu(noise, 0, 255);
+    return noise;
+}
+
+const std::vector<std::string>& TestPatterns::names() {
+    static const std::vector<std::string> patterns = {
+        "uniform", "circle", "chessboard", "square", "noise"
+    };
+    return patterns;
+}
+
+cv::Mat TestPatterns::make(const std::string& name, int size) {
+    if (name == "uniform") {
+        return uniform(size);
+    } else if (name == "circle") {
+        return circle(size);
+    } else if (name == "chessboard") {
+        return chessboard(size);
+    } else if (name == "square") {
+        return square(size);
+    } else if (name == "noise") {
+        return noise(size);
+    }
+    return cv::Mat();
+}
@@ -1,66 +1,372 @@
 #include "TextureAnalyzer.h"
+#include "HistogramKernels.h"
+#include "Logger.h"
+#include "StageProfiler.h"
+#include "ThreadPool.h"
+#include <limits>
 
-TextureAnalyzer::TextureAnalyzer(int levels) : levels_(levels), totalPairs_(0) {
-    glcm_.assign(levels_, std::vector<int>(levels_, 0));
+namespace {
+
+// Признаки, которым не хватает гистограммы разностей
+const unsigned kGLCMFeatures = FeatureEnergy | FeatureEntropy | FeatureCorrelation;
+
+constexpr int levelShift(int levels) {
+    return levels == 256 ? 0 : levels == 128 ? 1 : levels == 64 ? 2 :
+           levels == 32 ? 3 : levels == 16 ? 4 : 5;
+}
+
+template <int DX, int DY>
+struct FixedOffset {
+    static constexpr int dx = DX;
+    static constexpr int dy = DY;
+};
+
+struct RuntimeOffset {
+    int dx;
+    int dy;
+};
+
+template <typename Offset>
+int pairCount(const cv::Mat& image, Offset offset) {
+    int height = image.rows - std::abs(offset.dy);
+    int width = image.cols - std::abs(offset.dx);
+    return (height > 0 && width > 0) ? height * width : 0;
+}
+
+// Число пар, счётчики гистограмм (и слитые по полосам) - int. Кадр больше INT_MAX пикселей
+// их переполнил бы; целиком такие кадры не анализируются, для них есть тайловый режим
+bool fitsCounters(const cv::Mat& image) {
+    if (image.total() <= static_cast<size_t>(std::numeric_limits<int>::max())) {
+        return true;
+    }
+    LOG_ERROR("Error: " << image.cols << "x" << image.rows
+              << " frame is too large for whole-frame analysis, use --tiled");
+    return false;
+}
+
+// Веса по |i - j| для любого числа уровней: таблица строится один раз на процесс,
+// а не в каждом вызове evaluateFeatures
+struct FeatureWeights {
+    double contrast[256];
+    double homogeneity[256];
+    double idm[256];
+};
+
+const FeatureWeights& featureWeights() {
+    static const FeatureWeights weights = [] {
+        FeatureWeights table;
+        for (int k = 0; k < 256; k++) {
+            table.contrast[k] = static_cast<double>(k) * k;
+            table.homogeneity[k] = 1.0 / (1.0 + k);
+            table.idm[k] = 1.0 / (1.0 + static_cast<double>(k) * k);
+        }
+        return table;
+    }();
+    return weights;
+}
+
+struct DifferenceKernel {
+    template <int Levels, typename Offset>
+    static int run(const cv::Mat& image, Offset offset, int* histogram) {
+        constexpr int shift = levelShift(Levels);
+        const int minY = std::max(0, -offset.dy);
+        const int maxY = image.rows - std::max(0, offset.dy);
+        const int minX = std::max(0, -offset.dx);
+        const int maxX = image.cols - std::max(0, offset.dx);
+        
+        for (int y = minY; y < maxY; y++) {
+            const uchar* row = image.ptr<uchar>(y);
+            const uchar* neighborRow = image.ptr<uchar>(y + offset.dy) + offset.dx;
+            
+            for (int x = minX; x < maxX; x++) {
+                int current = row[x] >> shift;
+                int neighbor = neighborRow[x] >> shift;
+                histogram[std::abs(current - neighbor)]++;
+            }
+        }
+        
+        return pairCount(image, offset);
+    }
+};
+
+struct CooccurrenceKernel {
+    template <int Levels, typename Offset>
+    static int run(const cv::Mat& image, Offset offset, int* glcm) {
+        constexpr int shift = levelShift(Levels);
+        const int minY = std::max(0, -offset.dy);
+        const int maxY = image.rows - std::max(0, offset.dy);
+        const int minX = std::max(0, -offset.dx);
+        const int maxX = image.cols - std::max(0, offset.dx);
+        
+        for (int y = minY; y < maxY; y++) {
+            const uchar* row = image.ptr<uchar>(y);
+            const uchar* neighborRow = image.ptr<uchar>(y + offset.dy) + offset.dx;
+            
+            for (int x = minX; x < maxX; x++) {
+                int current = row[x] >> shift;
+                int neighbor = neighborRow[x] >> shift;
+                glcm[current * Levels + neighbor]++;
+            }
+        }
+        
+        return pairCount(image, offset);
+    }
+};
+
+template <typename Kernel, int Levels>
+int dispatchOffset(const cv::Mat& image, int dx, int dy, int* output) {
+    if (dx == 1 && dy == 0) {
+        return Kernel::template run<Levels>(image, FixedOffset<1, 0>(), output);
+    } else if (dx == 0 && dy == 1) {
+        return Kernel::template run<Levels>(image, FixedOffset<0, 1>(), output);
+    } else if (dx == 1 && dy == 1) {
+        return Kernel::template run<Levels>(image, FixedOffset<1, 1>(), output);
+    } else if (dx == 1 && dy == -1) {
+        return Kernel::template run<Levels>(image, FixedOffset<1, -1>(), output);
+    }
+    return Kernel::template run<Levels>(image, RuntimeOffset{dx, dy}, output);
+}
+
+template <typename Kernel>
+int dispatchKernel(int levels, const cv::Mat& image, int dx, int dy, int* output) {
+    switch (levels) {
+        case 8:   return dispatchOffset<Kernel, 8>(image, dx, dy, output);
+        case 16:  return dispatchOffset<Kernel, 16>(image, dx, dy, output);
+        case 32:  return dispatchOffset<Kernel, 32>(image, dx, dy, output);
+        case 64:  return dispatchOffset<Kernel, 64>(image, dx, dy, output);
+        case 128: return dispatchOffset<Kernel, 128>(image, dx, dy, output);
+        default:  return dispatchOffset<Kernel, 256>(image, dx, dy, output);
+    }
+}
+
+template <int Levels>
+void sweepDirections(const cv::Mat& image, int yStart, int yEnd, int* histograms) {
+    constexpr int shift = levelShift(Levels);
+    const int rows = image.rows;
+    const int cols = image.cols;
+    int* horizontal = histograms;
+    int* vertical = horizontal + Levels;
+    int* diagonal = vertical + Levels;
+    int* antiDiagonal = diagonal + Levels;
+    
+    for (int y = yStart; y < yEnd; y++) {
+        const uchar* row = image.ptr<uchar>(y);
+        const uchar* above = (y > 0) ? image.ptr<uchar>(y - 1) : nullptr;
+        const uchar* below = (y + 1 < rows) ? image.ptr<uchar>(y + 1) : nullptr;
+        
+        for (int x = 0; x + 1 < cols; x++) {
+            int current = row[x] >> shift;
+            horizontal[std::abs(current - (row[x + 1] >> shift))]++;
+            if (below) {
+                vertical[std::abs(current - (below[x] >> shift))]++;
+                diagonal[std::abs(current - (below[x + 1] >> shift))]++;
+            }
+            if (above) {
+                antiDiagonal[std::abs(current - (above[x + 1] >> shift))]++;
+            }
+        }
+        if (below && cols > 0) {
+            vertical[std::abs((row[cols - 1] >> shift) - (below[cols - 1] >> shift))]++;
+        }
+    }
+}
+
+void dispatchSweep(int levels, const cv::Mat& image, int yStart, int yEnd, int* histograms) {
+    switch (levels) {
+        case 8:   sweepDirections<8>(image, yStart, yEnd, histograms); break;
+        case 16:  sweepDirections<16>(image, yStart, yEnd, histograms); break;
+        case 32:  sweepDirections<32>(image, yStart, yEnd, histograms); break;
+        case 64:  sweepDirections<64>(image, yStart, yEnd, histograms); break;
+        case 128: sweepDirections<128>(image, yStart, yEnd, histograms); break;
+        default:  sweepDirections<256>(image, yStart, yEnd, histograms); break;
+    }
+}
+
+// Строки делятся на полосы; у каждой полосы свои гистограммы, слияние в первую полосу
+int stripeCount(int rows, ThreadPool* pool) {
+    const int threads = pool ? pool->threadCount() : cv::getNumThreads();
+    return std::max(1, std::min(threads, rows / 64));
+}
+
+// С pool полосы - задачи пула, без него - cv::parallel_for_
+template <typename SweepStripe>
+void runStripes(int stripes, ThreadPool* pool, const SweepStripe& sweepStripe) {
+    if (pool && stripes > 1) {
+        ThreadPool::TaskGroup group(*pool);
+        for (int s = 0; s < stripes; s++) {
+            group.run([&sweepStripe, s]() { sweepStripe(s); });
+        }
+        group.wait();
+    } else {
+        cv::parallel_for_(cv::Range(0, stripes), [&](const cv::Range& range) {
+            for (int s = range.start; s < range.end; s++) {
+                sweepStripe(s);
+            }
+        });
+    }
+}
+
+void mergeStripes(int* histograms, int stripes, size_t stripeSize) {
+    for (int s = 1; s < stripes; s++) {
+        const int* source = histograms + s * stripeSize;
+        for (size_t k = 0; k < stripeSize; k++) {
+            histograms[k] += source[k];
+        }
+    }
+}
+
+}
+
+bool TextureAnalyzer::isSupportedLevels(int levels) {
+    return levels == 8 || levels == 16 || levels == 32 || 
+           levels == 64 || levels == 128 || levels == 256;
+}
+
+TextureAnalyzer::TextureAnalyzer(int levels) 
+    : glcmBuilt_(false), dx_(0), dy_(0), levels_(levels), totalPairs_(0) {
+    if (!isSupportedLevels(levels_)) {
+        LOG_ERROR("Error: Unsupported number of grey levels: " << levels_ 
+                  << ", using 256");
+        levels_ = 256;
+    }
+    diffHistogram_.assign(levels_, 0);
 }
 
 void TextureAnalyzer::buildGLCM(const cv::Mat& image, int dx, int dy) {
     if (image.empty() || image.type() != CV_8UC1) {
-        std::cerr << "Error: Image must be grayscale" << std::endl;
+        LOG_ERROR("Error: Image must be grayscale");
+        return;
+    }
+    
+    buildDifferenceHistogram(image, dx, dy);
+    materializeGLCM();
+}
+
+void TextureAnalyzer::buildDifferenceHistogram(const cv::Mat& image, int dx, int dy) {
+    if (image.empty() || image.type() != CV_8UC1) {
+        LOG_ERROR("Error: Image must be grayscale");
+        return;
+    }
+    if (!fitsCounters(image)) {
+        clear();
         return;
     }
     
+    StageProfiler::Scope timing(Stage::GLCM);
     clear();
+    source_ = image;
+    dx_ = dx;
+    dy_ = dy;
     
-    int maxY = image.rows - std::abs(dy);
-    int maxX = image.cols - std::abs(dx);
+    totalPairs_ = accumulateDifferences(image, dx, dy, levels_, diffHistogram_.data());
     
-    for (int y = 0; y < maxY; y++) {
-        for (int x = 0; x < maxX; x++) {
-            int currentPixel = image.at<uchar>(y, x);
-            int neighborPixel = image.at<uchar>(y + dy, x + dx);
-            
-            if (currentPixel >= 0 && currentPixel < levels_ && 
-                neighborPixel >= 0 && neighborPixel < levels_) {
-                glcm_[currentPixel][neighborPixel]++;
-                totalPairs_++;
+    LOG_DEBUG("Difference histogram built: direction (" << dx << "," << dy 
+              << "), total pairs: " << totalPairs_);
+}
+
+int TextureAnalyzer::accumulateDifferences(const cv::Mat& image, int dx, int dy, int levels, int* histogram) {
+    KernelIsa isa = HistogramKernels::activeIsa();
+    if (isa == KernelIsa::Scalar) {
+        return dispatchKernel<DifferenceKernel>(levels, image, dx, dy, histogram);
+    }
+    return HistogramKernels::accumulateDifferences(image, dx, dy, levels, histogram, isa);
+}
+
+void TextureAnalyzer::buildCooccurrence(const cv::Mat& image, int dx, int dy, int levels,
+                                        AnalysisWorkspace& workspace) {
+    StageProfiler::Scope timing(Stage::GLCM);
+    AlignedBuffer<int>& glcm = workspace.glcm;
+    glcm.resize(static_cast<size_t>(levels) * levels);
+    glcm.zero();
+    KernelIsa isa = HistogramKernels::activeIsa();
+    if (isa == KernelIsa::Scalar) {
+        dispatchKernel<CooccurrenceKernel>(levels, image, dx, dy, glcm.data());
+    } else {
+        HistogramKernels::accumulateCooccurrence(image, dx, dy, levels, glcm.data(), isa);
+    }
+    
+    // Один проход по плотной матрице сразу после накопления; дальше она нужна
+    // только getNormalizedGLCM, а признаки читают список ненулевых ячеек
+    workspace.glcmCells.clear();
+    workspace.rowMarginal.assign(levels, 0);
+    workspace.colMarginal.assign(levels, 0);
+    
+    for (int i = 0; i < levels; i++) {
+        const int* row = glcm.data() + static_cast<size_t>(i) * levels;
+        int64_t rowSum = 0;
+        for (int j = 0; j < levels; j++) {
+            if (row[j] != 0) {
+                workspace.glcmCells.push_back({static_cast<uint16_t>(i), static_cast<uint16_t>(j), row[j]});
+                rowSum += row[j];
+                workspace.colMarginal[j] += row[j];
             }
         }
+        workspace.rowMarginal[i] = rowSum;
+    }
+    
+    LOG_DEBUG("GLCM built: direction (" << dx << "," << dy 
+              << "), non-zero cells: " << workspace.glcmCells.size());
+}
+
+void TextureAnalyzer::materializeGLCM() {
+    if (glcmBuilt_ || source_.empty()) {
+        return;
     }
     
-    std::cout << "GLCM built: direction (" << dx << "," << dy 
-              << "), total pairs: " << totalPairs_ << std::endl;
+    buildCooccurrence(source_, dx_, dy_, levels_, workspace_);
+    glcmBuilt_ = true;
 }
 
 double TextureAnalyzer::calculateIDM() {
     if (totalPairs_ == 0) {
-        std::cerr << "Error: GLCM not built or empty" << std::endl;
+        LOG_ERROR("Error: GLCM not built or empty");
         return 0.0;
     }
     
+    StageProfiler::Scope timing(Stage::IDM);
+    double idm = idmFromHistogram(diffHistogram_.data(), levels_, totalPairs_);
+    
+    LOG_DEBUG("IDM calculated: " << std::fixed << std::setprecision(6) << idm);
+    return idm;
+}
+
+double TextureAnalyzer::idmFromHistogram(const int* histogram, int levels, int64_t totalPairs) {
     double idm = 0.0;
     
-    for (int i = 0; i < levels_; i++) {
-        for (int j = 0; j < levels_; j++) {
-            if (glcm_[i][j] > 0) {
-                double p_ij = static_cast<double>(glcm_[i][j]) / totalPairs_;
-                double denominator = 1.0 + (i - j) * (i - j);
-                idm += p_ij / denominator;
-            }
+    for (int k = 0; k < levels; k++) {
+        if (histogram[k] > 0) {
+            double p_k = static_cast<double>(histogram[k]) / totalPairs;
+            double denominator = 1.0 + static_cast<double>(k) * k;
+            idm += p_k / denominator;
         }
     }
     
-    std::cout << "IDM calculated: " << std::fixed << std::setprecision(6) << idm << std::endl;
     return idm;
 }
 
-std::vector<std::vector<double>> TextureAnalyzer::getNormalizedGLCM() const {
+double TextureAnalyzer::idmFromCounts(const std::vector<int64_t>& histogram, int64_t totalPairs) {
+    double idm = 0.0;
+    
+    for (size_t k = 0; k < histogram.size(); k++) {
+        if (histogram[k] > 0) {
+            double p_k = static_cast<double>(histogram[k]) / totalPairs;
+            double denominator = 1.0 + static_cast<double>(k * k);
+            idm += p_k / denominator;
+        }
+    }
+    
+    return idm;
+}
+
+std::vector<std::vector<double>> TextureAnalyzer::getNormalizedGLCM() {
     std::vector<std::vector<double>> normalized(levels_, std::vector<double>(levels_, 0.0));
     
     if (totalPairs_ > 0) {
+        materializeGLCM();
         for (int i = 0; i < levels_; i++) {
+            const int* row = workspace_.glcm.data() + static_cast<size_t>(i) * levels_;
             for (int j = 0; j < levels_; j++) {
-                normalized[i][j] = static_cast<double>(glcm_[i][j]) / totalPairs_;
+                normalized[i][j] = static_cast<double>(row[j]) / totalPairs_;
             }
         }
     }
@@ -68,24 +374,19 @@ std::vector<std::vector<double>> TextureAnalyzer::getNormalizedGLCM() const {
     return normalized;
 }
 
-void TextureAnalyzer::printGLCMStats() const {
+void TextureAnalyzer::printGLCMStats() {
     if (totalPairs_ == 0) {
         std::cout << "GLCM not built" << std::endl;
         return;
     }
     
+    materializeGLCM();
+    
     int maxValue = 0;
-    int nonZeroElements = 0;
+    int nonZeroElements = static_cast<int>(workspace_.glcmCells.size());
     
-    for (int i = 0; i < levels_; i++) {
-        for (int j = 0; j < levels_; j++) {
-            if (glcm_[i][j] > maxValue) {
-                maxValue = glcm_[i][j];
-            }
-            if (glcm_[i][j] > 0) {
-                nonZeroElements++;
-            }
-        }
+    for (const GLCMCell& cell : workspace_.glcmCells) {
+        maxValue = std::max(maxValue, cell.count);
     }
     
     std::cout << "GLCM Statistics:" << std::endl;
@@ -97,10 +398,387 @@ void TextureAnalyzer::printGLCMStats() const {
               << "%" << std::endl;
 }
 
-double TextureAnalyzer::analyzeMultiDirectional(const cv::Mat& image) {
+HaralickFeatures TextureAnalyzer::computeFeatures(unsigned features) {
+    if (totalPairs_ == 0) {
+        LOG_ERROR("Error: GLCM not built or empty");
+        return HaralickFeatures{};
+    }
+    
+    if ((features & kGLCMFeatures) != 0) {
+        materializeGLCM();
+    }
+    return evaluateFeatures(diffHistogram_.data(), workspace_, levels_, totalPairs_, features);
+}
+
+HaralickFeatures TextureAnalyzer::computeFeatures(const cv::Mat& image, int dx, int dy, int levels,
+                                                  unsigned features, AnalysisWorkspace& workspace) {
+    if (image.empty() || image.type() != CV_8UC1) {
+        LOG_ERROR("Error: Image must be grayscale");
+        return HaralickFeatures{};
+    }
+    if (!fitsCounters(image)) {
+        return HaralickFeatures{};
+    }
+    if (!isSupportedLevels(levels)) {
+        LOG_ERROR("Error: Unsupported number of grey levels: " << levels << ", using 256");
+        levels = 256;
+    }
+    
+    int totalPairs;
+    if ((features & kGLCMFeatures) != 0) {
+        buildCooccurrence(image, dx, dy, levels, workspace);
+        totalPairs = pairCount(image, RuntimeOffset{dx, dy});
+    } else {
+        StageProfiler::Scope timing(Stage::GLCM);
+        workspace.differenceHistogram.assign(levels, 0);
+        totalPairs = accumulateDifferences(image, dx, dy, levels, workspace.differenceHistogram.data());
+    }
+    if (totalPairs == 0) {
+        LOG_ERROR("Error: GLCM not built or empty");
+        return HaralickFeatures{};
+    }
+    return evaluateFeatures(workspace.differenceHistogram.data(), workspace, levels, totalPairs, features);
+}
+
+HaralickFeatures TextureAnalyzer::evaluateFeatures(const int* differenceHistogram, const AnalysisWorkspace& workspace,
+                                                   int levels, int totalPairs, unsigned features) {
+    HaralickFeatures result{};
+    StageProfiler::Scope timing(Stage::IDM);
+    features &= FeatureAll;
+    const double total = static_cast<double>(totalPairs);
+    double contrast = 0.0;
+    double homogeneity = 0.0;
+    double idm = 0.0;
+    
+    const FeatureWeights& weights = featureWeights();
+    const double* contrastWeight = weights.contrast;
+    const double* homogeneityWeight = weights.homogeneity;
+    const double* idmWeight = weights.idm;
+    
+    if ((features & kGLCMFeatures) == 0) {
+        for (int k = 0; k < levels; k++) {
+            double count = differenceHistogram[k];
+            contrast += contrastWeight[k] * count;
+            homogeneity += homogeneityWeight[k] * count;
+            idm += idmWeight[k] * count;
+        }
+    } else {
+        // Суммы ведутся по целым счётчикам, нормировка на число пар — в конце
+        const bool wantEntropy = (features & FeatureEntropy) != 0;
+        double squares = 0.0;
+        double countLogCount = 0.0;
+        double cross = 0.0;
+        for (const GLCMCell& cell : workspace.glcmCells) {
+            const double count = cell.count;
+            const int difference = std::abs(static_cast<int>(cell.i) - static_cast<int>(cell.j));
+            contrast += contrastWeight[difference] * count;
+            homogeneity += homogeneityWeight[difference] * count;
+            idm += idmWeight[difference] * count;
+            squares += count * count;
+            cross += static_cast<double>(cell.i * cell.j) * count;
+            if (wantEntropy) {
+                countLogCount += count * std::log(count);
+            }
+        }
+        
+        result.energy = squares / (total * total);
+        // -sum p log p при p = c / N равно log N - sum c log c / N
+        result.entropy = wantEntropy ? std::log(total) - countLogCount / total : 0.0;
+        
+        double meanX = 0.0, meanY = 0.0, squareX = 0.0, squareY = 0.0;
+        for (int k = 0; k < levels; k++) {
+            meanX += static_cast<double>(k) * workspace.rowMarginal[k];
+            meanY += static_cast<double>(k) * workspace.colMarginal[k];
+            squareX += static_cast<double>(k) * k * workspace.rowMarginal[k];
+            squareY += static_cast<double>(k) * k * workspace.colMarginal[k];
+        }
+        meanX /= total;
+        meanY /= total;
+        double deviation = std::sqrt(std::max(0.0, squareX / total - meanX * meanX) *
+                                     std::max(0.0, squareY / total - meanY * meanY));
+        // Для постоянного изображения корреляция вырождена; принято считать её равной 1
+        result.correlation = deviation > 1e-12 ? (cross / total - meanX * meanY) / deviation : 1.0;
+    }
+    
+    result.contrast = contrast / total;
+    result.homogeneity = homogeneity / total;
+    result.idm = idm / total;
+    result.computed = features;
+    
+    LOG_DEBUG("Haralick features: contrast " << result.contrast << ", energy " << result.energy
+              << ", entropy " << result.entropy << ", correlation " << result.correlation
+              << ", homogeneity " << result.homogeneity << ", IDM " << result.idm);
+    return result;
+}
+
+HaralickFeatures TextureAnalyzer::analyzeFeatures(const cv::Mat& image, unsigned features) {
+    HaralickFeatures average{};
+    if (image.empty() || image.type() != CV_8UC1) {
+        LOG_ERROR("Error: Image must be grayscale");
+        return average;
+    }
+    
+    const int directions[4][2] = {{1, 0}, {0, 1}, {1, 1}, {1, -1}};
+    int validDirections = 0;
+    
+    for (const auto& dir : directions) {
+        buildDifferenceHistogram(image, dir[0], dir[1]);
+        if (totalPairs_ == 0) {
+            continue;
+        }
+        
+        HaralickFeatures current = computeFeatures(features);
+        average.contrast += current.contrast;
+        average.energy += current.energy;
+        average.entropy += current.entropy;
+        average.correlation += current.correlation;
+        average.homogeneity += current.homogeneity;
+        average.idm += current.idm;
+        validDirections++;
+    }
+    
+    if (validDirections > 0) {
+        average.contrast /= validDirections;
+        average.energy /= validDirections;
+        average.entropy /= validDirections;
+        average.correlation /= validDirections;
+        average.homogeneity /= validDirections;
+        average.idm /= validDirections;
+        average.computed = features & FeatureAll;
+    }
+    
+    return average;
+}
+
+void TextureAnalyzer::buildDirectionalHistograms(const cv::Mat& image, int levels,
+                                                 AlignedBuffer<int>& histograms, int totals[4],
+                                                 cv::Mat* frameGray, ThreadPool* pool) {
+    StageProfiler::Scope timing(Stage::GLCM);
+    const int rows = image.rows;
+    const size_t stripeSize = 4 * static_cast<size_t>(levels) + (frameGray ? 256 : 0);
+    const int stripes = stripeCount(rows, pool);
+    histograms.resize(stripes * stripeSize);
+    const KernelIsa isa = HistogramKernels::activeIsa();
+    
+    auto sweepStripe = [&](int s) {
+        int* stripe = histograms.data() + s * stripeSize;
+        std::fill(stripe, stripe + stripeSize, 0);
+        
+        int yStart = static_cast<int>(static_cast<int64_t>(rows) * s / stripes);
+        int yEnd = static_cast<int>(static_cast<int64_t>(rows) * (s + 1) / stripes);
+        if (frameGray) {
+            HistogramKernels::accumulateFrame(image, *frameGray, yStart, yEnd, levels, stripe,
+                                              stripe + 4 * levels, isa);
+        } else if (isa == KernelIsa::Scalar) {
+            dispatchSweep(levels, image, yStart, yEnd, stripe);
+        } else {
+            HistogramKernels::accumulateDirections(image, yStart, yEnd, levels, stripe, isa);
+        }
+    };
+    
+    runStripes(stripes, pool, sweepStripe);
+    mergeStripes(histograms.data(), stripes, stripeSize);
+    
+    totals[0] = pairCount(image, FixedOffset<1, 0>());
+    totals[1] = pairCount(image, FixedOffset<0, 1>());
+    totals[2] = pairCount(image, FixedOffset<1, 1>());
+    totals[3] = pairCount(image, FixedOffset<1, -1>());
+}
+
+void TextureAnalyzer::buildOffsetHistograms(const cv::Mat& image, int levels, int distances,
+                                            AlignedBuffer<int>& histograms, ThreadPool* pool) {
+    StageProfiler::Scope timing(Stage::GLCM);
+    const int rows = image.rows;
+    const size_t stripeSize = 4 * static_cast<size_t>(distances) * levels;
+    const int stripes = stripeCount(rows, pool);
+    histograms.resize(stripes * stripeSize);
+    const KernelIsa isa = HistogramKernels::activeIsa();
+    
+    runStripes(stripes, pool, [&](int s) {
+        int* stripe = histograms.data() + s * stripeSize;
+        std::fill(stripe, stripe + stripeSize, 0);
+        
+        int yStart = static_cast<int>(static_cast<int64_t>(rows) * s / stripes);
+        int yEnd = static_cast<int>(static_cast<int64_t>(rows) * (s + 1) / stripes);
+        HistogramKernels::accumulateOffsets(image, yStart, yEnd, distances, levels, stripe, isa);
+    });
+    mergeStripes(histograms.data(), stripes, stripeSize);
+}
+
+double TextureAnalyzer::averageDirectionalIDM(const int* histograms, int levels, const int totals[4]) {
+    const int directions[4][2] = {
+        {1, 0},   // Horizontal
+        {0, 1},   // Vertical
+        {1, 1},   // Diagonal
+        {1, -1}   // Anti-diagonal
+    };
+    
+    StageProfiler::Scope timing(Stage::IDM);
+    double totalIDM = 0.0;
+    int validDirections = 0;
+    for (int d = 0; d < 4; d++) {
+        const int* histogram = histograms + d * levels;
+        double idm = (totals[d] > 0) ? idmFromHistogram(histogram, levels, totals[d]) : 0.0;
+        
+        if (idm > 0) {
+            totalIDM += idm;
+            validDirections++;
+            
+            LOG_DEBUG("Direction (" << directions[d][0] << "," << directions[d][1] 
+                      << "): IDM = " << std::fixed << std::setprecision(4) << idm);
+        }
+    }
+    
+    double averageIDM = (validDirections > 0) ? totalIDM / validDirections : 0.0;
+    LOG_INFO("Average IDM: " << std::fixed << std::setprecision(4) 
+             << averageIDM);
+    
+    return averageIDM;
+}
+
+double TextureAnalyzer::multiDirectionalIDM(const cv::Mat& image, int levels, AnalysisWorkspace& workspace) {
     if (image.empty()) {
         return 0.0;
     }
+    if (image.type() != CV_8UC1) {
+        LOG_ERROR("Error: Image must be grayscale");
+        return 0.0;
+    }
+    if (!fitsCounters(image)) {
+        return 0.0;
+    }
+    if (!isSupportedLevels(levels)) {
+        LOG_ERROR("Error: Unsupported number of grey levels: " << levels << ", using 256");
+        levels = 256;
+    }
+    
+    LOG_INFO("Multi-directional texture analysis");
+    
+    int totals[4];
+    buildDirectionalHistograms(image, levels, workspace.directionHistograms, totals);
+    LOG_DEBUG("Directional histograms built in one pass");
+    
+    return averageDirectionalIDM(workspace.directionHistograms.data(), levels, totals);
+}
+
+double TextureAnalyzer::sweepFrame(const cv::Mat& image, int levels, AnalysisWorkspace& workspace,
+                                   cv::Mat& gray, ThreadPool* pool) {
+    gray = cv::Mat();
+    if (image.empty() || image.depth() != CV_8U ||
+        (image.channels() != 1 && image.channels() != 3 && image.channels() != 4)) {
+        LOG_ERROR("Error: Frame must be 8-bit grayscale, BGR or BGRA");
+        return 0.0;
+    }
+    if (!fitsCounters(image)) {
+        return 0.0;
+    }
+    if (!isSupportedLevels(levels)) {
+        LOG_ERROR("Error: Unsupported number of grey levels: " << levels << ", using 256");
+        levels = 256;
+    }
+    
+    LOG_INFO("Multi-directional texture analysis");
+    
+    gray = image.channels() == 1 ? image :
+           AnalysisWorkspace::reserve(workspace.gray, image.rows, image.cols, CV_8UC1);
+    
+    int totals[4];
+    buildDirectionalHistograms(image, levels, workspace.directionHistograms, totals, &gray, pool);
+    LOG_DEBUG("Grayscale, intensity and directional histograms built in one pass");
+    
+    const int* intensity = workspace.directionHistograms.data() + 4 * levels;
+    workspace.intensity.assign(intensity, intensity + 256);
+    
+    return averageDirectionalIDM(workspace.directionHistograms.data(), levels, totals);
+}
+
+std::vector<double> TexturePyramid::averageOverDirections() const {
+    std::vector<double> average(static_cast<size_t>(scales) * distances, 0.0);
+    for (size_t i = 0; i < average.size(); i++) {
+        average[i] = (idm[4 * i] + idm[4 * i + 1] + idm[4 * i + 2] + idm[4 * i + 3]) / 4;
+    }
+    return average;
+}
+
+TexturePyramid TextureAnalyzer::analyzePyramid(const cv::Mat& image, int levels, int distances, int scales,
+                                               AnalysisWorkspace& workspace, ThreadPool* pool) {
+    TexturePyramid pyramid;
+    if (image.empty() || image.type() != CV_8UC1) {
+        LOG_ERROR("Error: Image must be grayscale");
+        return pyramid;
+    }
+    if (!fitsCounters(image)) {
+        return pyramid;
+    }
+    if (!isSupportedLevels(levels)) {
+        LOG_ERROR("Error: Unsupported number of grey levels: " << levels << ", using 256");
+        levels = 256;
+    }
+    pyramid.distances = std::max(1, distances);
+    scales = std::max(1, scales);
+    
+    LOG_INFO("Texture pyramid: distances 1.." << pyramid.distances << ", up to " << scales << " scales");
+    
+    if (workspace.pyramid.size() + 1 < static_cast<size_t>(scales)) {
+        workspace.pyramid.resize(scales - 1);
+    }
+    pyramid.idm.reserve(static_cast<size_t>(scales) * pyramid.distances * 4);
+    
+    cv::Mat level = image;
+    while (pyramid.scales < scales && std::min(level.rows, level.cols) > pyramid.distances) {
+        buildOffsetHistograms(level, levels, pyramid.distances, workspace.offsetHistograms, pool);
+        
+        {
+            StageProfiler::Scope timing(Stage::IDM);
+            const int* histogram = workspace.offsetHistograms.data();
+            for (int d = 1; d <= pyramid.distances; d++) {
+                const int64_t totals[4] = {
+                    pairCount(level, RuntimeOffset{d, 0}),
+                    pairCount(level, RuntimeOffset{0, d}),
+                    pairCount(level, RuntimeOffset{d, d}),
+                    pairCount(level, RuntimeOffset{d, -d})
+                };
+                for (int direction = 0; direction < 4; direction++, histogram += levels) {
+                    pyramid.idm.push_back(idmFromHistogram(histogram, levels, totals[direction]));
+                }
+            }
+        }
+        
+        LOG_DEBUG("Scale " << pyramid.scales << " (" << level.cols << "x" << level.rows
+                  << "): IDM at distance 1 = " << std::fixed << std::setprecision(4)
+                  << pyramid.at(pyramid.scales, 1, 0));
+        
+        pyramid.scales++;
+        if (pyramid.scales < scales) {
+            cv::Mat next = AnalysisWorkspace::reserve(workspace.pyramid[pyramid.scales - 1],
+                                                      (level.rows + 1) / 2, (level.cols + 1) / 2, CV_8UC1);
+            cv::pyrDown(level, next, next.size());
+            level = next;
+        }
+    }
+    
+    return pyramid;
+}
+
+double TextureAnalyzer::analyzeMultiDirectional(const cv::Mat& image, TextureSweepMode mode) {
+    if (image.empty() || !fitsCounters(image)) {
+        return 0.0;
+    }
+    
+    if (mode == TextureSweepMode::SinglePassParallel && image.type() == CV_8UC1) {
+        // Буферы объекта переиспользуются от кадра к кадру
+        double averageIDM = multiDirectionalIDM(image, levels_, workspace_);
+        
+        // Состояние как после последнего направления в покомпонентном режиме
+        clear();
+        source_ = image;
+        dx_ = 1;
+        dy_ = -1;
+        const int* last = workspace_.directionHistograms.data() + 3 * levels_;
+        std::copy(last, last + levels_, diffHistogram_.begin());
+        totalPairs_ = pairCount(image, FixedOffset<1, -1>());
+        return averageIDM;
+    }
     
     std::vector<std::pair<int, int>> directions = {
         {1, 0},   // Horizontal
@@ -112,32 +790,161 @@ double TextureAnalyzer::analyzeMultiDirectional(const cv::Mat& image) {
     double totalIDM = 0.0;
     int validDirections = 0;
     
-    std::cout << "Multi-directional texture analysis" << std::endl;
+    LOG_INFO("Multi-directional texture analysis");
     
     for (const auto& dir : directions) {
-        buildGLCM(image, dir.first, dir.second);
+        buildDifferenceHistogram(image, dir.first, dir.second);
         double idm = calculateIDM();
         
         if (idm > 0) {
             totalIDM += idm;
             validDirections++;
             
-            std::cout << "Direction (" << dir.first << "," << dir.second 
-                      << "): IDM = " << std::fixed << std::setprecision(4) << idm << std::endl;
+            LOG_DEBUG("Direction (" << dir.first << "," << dir.second 
+                      << "): IDM = " << std::fixed << std::setprecision(4) << idm);
         }
     }
     
     double averageIDM = (validDirections > 0) ? totalIDM / validDirections : 0.0;
-    std::cout << "Average IDM: " << std::fixed << std::setprecision(4) 
-              << averageIDM << std::endl;
+    LOG_INFO("Average IDM: " << std::fixed << std::setprecision(4) 
+             << averageIDM);
     
     return averageIDM;
 }
 
-void TextureAnalyzer::clear() {
-    for (auto& row : glcm_) {
-        std::fill(row.begin(), row.end(), 0);
+namespace {
+
+// IDM окна = сумма весов 1/(1+k^2) по парам окна, делённая на число пар.
+// Веса хранятся в фиксированной точке, чтобы добавление и удаление пар не накапливало ошибку.
+constexpr int kIdmWeightBits = 32;
+
+struct WindowDirection {
+    int dx;
+    int dy;
+    int64_t weightSum;
+    int pairs;
+};
+
+class IDMWindow {
+private:
+    const cv::Mat& image_;
+    const std::vector<int64_t>& weights_;
+    int shift_;
+    int y0_;
+    int y1_;
+    WindowDirection directions_[4];
+    
+    // Пары направления, у которых левый пиксель в столбце left, а правый в столбце left + dx
+    void updateColumn(WindowDirection& dir, int left, int sign) {
+        int yStart = std::max(y0_, y0_ - dir.dy);
+        int yEnd = std::min(y1_, y1_ - dir.dy);
+        int right = left + dir.dx;
+        for (int y = yStart; y < yEnd; y++) {
+            int current = image_.ptr<uchar>(y)[left] >> shift_;
+            int neighbor = image_.ptr<uchar>(y + dir.dy)[right] >> shift_;
+            dir.weightSum += sign * weights_[std::abs(current - neighbor)];
+            dir.pairs += sign;
+        }
     }
-    totalPairs_ = 0;
+    
+public:
+    IDMWindow(const cv::Mat& image, const std::vector<int64_t>& weights, int shift, int y0, int y1)
+        : image_(image), weights_(weights), shift_(shift), y0_(y0), y1_(y1),
+          directions_{{1, 0, 0, 0}, {0, 1, 0, 0}, {1, 1, 0, 0}, {1, -1, 0, 0}} {}
+    
+    // Окно [x0, column) расширяется столбцом column
+    void addColumn(int column, int x0) {
+        for (WindowDirection& dir : directions_) {
+            if (column - dir.dx >= x0) {
+                updateColumn(dir, column - dir.dx, 1);
+            }
+        }
+    }
+    
+    // Окно [column, x1) теряет левый столбец column
+    void removeColumn(int column, int x1) {
+        for (WindowDirection& dir : directions_) {
+            if (column + dir.dx < x1) {
+                updateColumn(dir, column, -1);
+            }
+        }
+    }
+    
+    float idm() const {
+        double total = 0.0;
+        int valid = 0;
+        for (const WindowDirection& dir : directions_) {
+            if (dir.pairs > 0 && dir.weightSum > 0) {
+                total += std::ldexp(static_cast<double>(dir.weightSum), -kIdmWeightBits) / dir.pairs;
+                valid++;
+            }
+        }
+        return valid > 0 ? static_cast<float>(total / valid) : 0.0f;
+    }
+};
+
 }
 
+cv::Mat TextureAnalyzer::computeIDMMap(const cv::Mat& image, int windowSize) const {
+    if (image.empty() || image.type() != CV_8UC1) {
+        LOG_ERROR("Error: Image must be grayscale");
+        return cv::Mat();
+    }
+    if (windowSize < 3 || windowSize % 2 == 0) {
+        LOG_ERROR("Error: IDM window must be odd and at least 3 pixels, got " << windowSize);
+        return cv::Mat();
+    }
+    
+    StageProfiler::Scope timing(Stage::IDM);
+    const int radius = windowSize / 2;
+    const int rows = image.rows;
+    const int cols = image.cols;
+    const int shift = levelShift(levels_);
+    
+    std::vector<int64_t> weights(levels_);
+    for (int k = 0; k < levels_; k++) {
+        weights[k] = std::llround(std::ldexp(1.0 / (1.0 + static_cast<double>(k) * k), kIdmWeightBits));
+    }
+    
+    cv::Mat idmMap(rows, cols, CV_32F);
+    
+    cv::parallel_for_(cv::Range(0, rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; y++) {
+            IDMWindow window(image, weights, shift,
+                             std::max(0, y - radius), std::min(rows, y + radius + 1));
+            float* output = idmMap.ptr<float>(y);
+            
+            int x1 = std::min(cols, radius + 1);
+            for (int column = 0; column < x1; column++) {
+                window.addColumn(column, 0);
+            }
+            
+            for (int x = 0; x < cols; x++) {
+                output[x] = window.idm();
+                
+                int leaving = x - radius;
+                int entering = x + radius + 1;
+                if (leaving >= 0) {
+                    window.removeColumn(leaving, x1);
+                }
+                if (entering < cols) {
+                    window.addColumn(entering, leaving + 1 > 0 ? leaving + 1 : 0);
+                    x1 = entering + 1;
+                }
+            }
+        }
+    });
+    
+    LOG_INFO("IDM map computed: window " << windowSize << "x" << windowSize 
+             << ", " << cols << "x" << rows << " pixels");
+    
+    return idmMap;
+}
+
+void TextureAnalyzer::clear() {
+    std::fill(diffHistogram_.begin(), diffHistogram_.end(), 0);
+    glcmBuilt_ = false;
+    workspace_.glcmCells.clear();
+    source_.release();
+    totalPairs_ = 0;
+}
@@ -0,0 +1,181 @@
+#include "ThreadPool.h"
+#include "Logger.h"
+
+int& ThreadPool::currentWorker() {
+    thread_local int index = -1;
+    return index;
+}
+
+ThreadPool::ThreadPool(int threads) 
+    : pending_(0), queued_(0), nextQueue_(0), stopping_(false) {
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    
+    for (int i = 0; i < threads; i++) {
+        queues_.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+    }
+    for (int i = 0; i < threads; i++) {
+        workers_.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    waitAll();
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        stopping_ = true;
+    }
+    wakeUp_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(Task task) {
+    int worker = currentWorker();
+    int target = (worker >= 0) ? worker 
+                               : static_cast<int>(nextQueue_.fetch_add(1) % queues_.size());
+    
+    pending_.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(queues_[target]->mutex);
+        queues_[target]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        queued_.fetch_add(1);
+    }
+    wakeUp_.notify_one();
+}
+
+bool ThreadPool::popLocal(int index, Task& task) {
+    WorkerQueue& queue = *queues_[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::steal(int thief, Task& task) {
+    const int count = static_cast<int>(queues_.size());
+    for (int offset = 1; offset <= count; offset++) {
+        int victim = (thief + offset) % count;
+        WorkerQueue& queue = *queues_[victim];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::tryRunOne(int preferredQueue) {
+    Task task;
+    bool found = (preferredQueue >= 0 && popLocal(preferredQueue, task)) ||
+                 steal(preferredQueue >= 0 ? preferredQueue : 0, task);
+    if (!found) {
+        return false;
+    }
+    
+    queued_.fetch_sub(1);
+    try {
+        task();
+    } catch (const std::exception& e) {
+        LOG_ERROR("Unhandled exception in thread pool task: " << e.what());
+    } catch (...) {
+        LOG_ERROR("Unhandled exception in thread pool task");
+    }
+    
+    if (pending_.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        idle_.notify_all();
+    }
+    return true;
+}
+
+void ThreadPool::workerLoop(int index) {
+    currentWorker() = index;
+    
+    while (true) {
+        if (tryRunOne(index)) {
+            continue;
+        }
+        
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        wakeUp_.wait(lock, [this]() { return stopping_ || queued_.load() > 0; });
+        if (stopping_ && queued_.load() == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::waitAll() {
+    std::unique_lock<std::mutex> lock(sleepMutex_);
+    idle_.wait(lock, [this]() { return pending_.load() == 0; });
+}
+
+void ThreadPool::notifyGroupDone() {
+    // Под мьютексом: ожидающий проверяет условие под ним же и не пропустит уведомление
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+    }
+    wakeUp_.notify_all();
+}
+
+ThreadPool::TaskGroup::TaskGroup(ThreadPool& pool) 
+    : pool_(pool), state_(std::make_shared<State>()) {}
+
+ThreadPool::TaskGroup::~TaskGroup() {
+    join();
+}
+
+void ThreadPool::TaskGroup::run(Task task) {
+    state_->pending.fetch_add(1);
+    std::shared_ptr<State> state = state_;
+    ThreadPool* pool = &pool_;
+    pool_.submit([state, pool, task]() {
+        try {
+            task();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (!state->error) {
+                state->error = std::current_exception();
+            }
+        }
+        if (state->pending.fetch_sub(1) == 1) {
+            pool->notifyGroupDone();
+        }
+    });
+}
+
+void ThreadPool::TaskGroup::join() {
+    while (state_->pending.load() > 0) {
+        if (pool_.tryRunOne(currentWorker())) {
+            continue;
+        }
+        
+        std::unique_lock<std::mutex> lock(pool_.sleepMutex_);
+        pool_.wakeUp_.wait(lock, [this]() {
+            return state_->pending.load() == 0 || pool_.queued_.load() > 0;
+        });
+    }
+}
+
+void ThreadPool::TaskGroup::wait() {
+    join();
+    
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        std::swap(error, state_->error);
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
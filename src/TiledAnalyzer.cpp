@@ -0,0 +1,434 @@
+#include "TiledAnalyzer.h"
+#include "ImageLoader.h"
+#include "TextureAnalyzer.h"
+#include "HistogramKernels.h"
+#include "Logger.h"
+#include "StageProfiler.h"
+#include <fstream>
+
+namespace {
+
+class UncompressedTileSource : public TileSource {
+public:
+    UncompressedTileSource(const std::string& path, const cv::Size& size, size_t offset)
+        : file_(path, std::ios::binary), size_(size), offset_(offset) {}
+
+    bool isOpen() const { return file_.is_open(); }
+    cv::Size size() const override { return size_; }
+
+    bool read(const cv::Rect& region, cv::Mat& tile) override {
+        tile.create(region.height, region.width, CV_8UC1);
+        for (int r = 0; r < region.height; r++) {
+            file_.seekg(static_cast<std::streamoff>(offset_ +
+                        static_cast<size_t>(region.y + r) * size_.width + region.x));
+            file_.read(reinterpret_cast<char*>(tile.ptr<uchar>(r)), region.width);
+        }
+        return static_cast<bool>(file_);
+    }
+
+private:
+    std::ifstream file_;
+    cv::Size size_;
+    size_t offset_;
+};
+
+class DecodedTileSource : public TileSource {
+public:
+    explicit DecodedTileSource(const cv::Mat& image) : image_(image) {}
+
+    cv::Size size() const override { return image_.size(); }
+
+    bool read(const cv::Rect& region, cv::Mat& tile) override {
+        tile = image_(region);
+        return true;
+    }
+
+private:
+    cv::Mat image_;
+};
+
+struct ObjectStats {
+    int64_t pixels = 0;
+    int64_t crackEdges = 0;
+    // Выпуклая оболочка граничных пикселей; у объединённого объекта —
+    // оболочка объединения оболочек частей
+    std::vector<cv::Point> hull;
+};
+
+void mergeHull(std::vector<cv::Point>& hull, const std::vector<cv::Point>& other) {
+    hull.insert(hull.end(), other.begin(), other.end());
+    if (hull.size() > 2) {
+        std::vector<cv::Point> merged;
+        cv::convexHull(hull, merged);
+        hull.swap(merged);
+    }
+}
+
+// Разметка объектов (8-связность) тайл за тайлом. Части объекта из соседних тайлов
+// объединяются системой непересекающихся множеств. После каждого ряда тайлов
+// объекты, не достающие до его нижнего края, завершены: они сравниваются
+// с наибольшим и удаляются, остальные перенумеровываются с нуля
+class ObjectMerger {
+public:
+    explicit ObjectMerger(int width) : above_(width, -1), nextAbove_(width, -1), objectCount_(0) {}
+
+    void processTile(const cv::Mat& binary, const cv::Point& coreOffset, const cv::Rect& core) {
+        cv::Mat labels;
+        cv::Mat stats;
+        cv::Mat centroids;
+        int count = cv::connectedComponentsWithStats(binary(cv::Rect(coreOffset, core.size())),
+                                                     labels, stats, centroids, 8, CV_32S);
+
+        const int base = static_cast<int>(parent_.size()) - 1;
+        std::vector<std::vector<cv::Point>> boundary(count);
+        for (int l = 1; l < count; l++) {
+            parent_.push_back(base + l);
+            stats_.emplace_back();
+            stats_.back().pixels = stats.at<int>(l, cv::CC_STAT_AREA);
+        }
+
+        // Рёбра между пикселем объекта и фоном; за краем изображения — фон
+        for (int y = 0; y < core.height; y++) {
+            const int* labelRow = labels.ptr<int>(y);
+            const int ty = coreOffset.y + y;
+            const uchar* row = binary.ptr<uchar>(ty);
+            const uchar* up = ty > 0 ? binary.ptr<uchar>(ty - 1) : nullptr;
+            const uchar* down = ty + 1 < binary.rows ? binary.ptr<uchar>(ty + 1) : nullptr;
+
+            for (int x = 0; x < core.width; x++) {
+                int label = labelRow[x];
+                if (label == 0) {
+                    continue;
+                }
+                const int tx = coreOffset.x + x;
+                int edges = (tx == 0 || !row[tx - 1]) + (tx + 1 == binary.cols || !row[tx + 1]) +
+                            (!up || !up[tx]) + (!down || !down[tx]);
+                if (edges > 0) {
+                    stats_[base + label].crackEdges += edges;
+                    boundary[label].emplace_back(core.x + x, core.y + y);
+                }
+            }
+        }
+
+        for (int l = 1; l < count; l++) {
+            if (boundary[l].size() > 2) {
+                cv::convexHull(boundary[l], stats_[base + l].hull);
+            } else {
+                stats_[base + l].hull = boundary[l];
+            }
+        }
+
+        // Соседи сверху (включая диагональные) из предыдущего ряда тайлов
+        if (core.y > 0) {
+            const int* labelRow = labels.ptr<int>(0);
+            for (int x = 0; x < core.width; x++) {
+                if (labelRow[x] == 0) {
+                    continue;
+                }
+                int gx = core.x + x;
+                for (int nx = std::max(0, gx - 1); nx <= std::min(static_cast<int>(above_.size()) - 1, gx + 1); nx++) {
+                    if (above_[nx] >= 0) {
+                        unite(base + labelRow[x], above_[nx]);
+                    }
+                }
+            }
+        }
+
+        // Соседи слева из предыдущего тайла того же ряда
+        if (core.x > 0) {
+            for (int y = 0; y < core.height; y++) {
+                int label = labels.at<int>(y, 0);
+                if (label == 0) {
+                    continue;
+                }
+                for (int ny = std::max(0, y - 1); ny <= std::min(core.height - 1, y + 1); ny++) {
+                    if (left_[ny] >= 0) {
+                        unite(base + label, left_[ny]);
+                    }
+                }
+            }
+        }
+
+        left_.assign(core.height, -1);
+        for (int y = 0; y < core.height; y++) {
+            int label = labels.at<int>(y, core.width - 1);
+            left_[y] = label > 0 ? base + label : -1;
+        }
+        const int* lastRow = labels.ptr<int>(core.height - 1);
+        for (int x = 0; x < core.width; x++) {
+            nextAbove_[core.x + x] = lastRow[x] > 0 ? base + lastRow[x] : -1;
+        }
+    }
+
+    void finishTileRow(bool lastRow) {
+        std::vector<char> onFrontier(parent_.size(), 0);
+        if (!lastRow) {
+            for (int& id : nextAbove_) {
+                if (id >= 0) {
+                    id = find(id);
+                    onFrontier[id] = 1;
+                }
+            }
+        }
+
+        std::vector<int> renumbered(parent_.size(), -1);
+        std::vector<int> parent;
+        std::vector<ObjectStats> stats;
+        for (size_t i = 0; i < parent_.size(); i++) {
+            if (parent_[i] != static_cast<int>(i)) {
+                continue;
+            }
+            if (onFrontier[i]) {
+                renumbered[i] = static_cast<int>(parent.size());
+                parent.push_back(static_cast<int>(parent.size()));
+                stats.push_back(std::move(stats_[i]));
+            } else {
+                finalize(stats_[i]);
+            }
+        }
+
+        for (int& id : nextAbove_) {
+            if (id >= 0) {
+                id = renumbered[id];
+            }
+        }
+        parent_.swap(parent);
+        stats_.swap(stats);
+        above_.swap(nextAbove_);
+        std::fill(nextAbove_.begin(), nextAbove_.end(), -1);
+        left_.clear();
+    }
+
+    int64_t objectCount() const { return objectCount_; }
+    const ObjectStats& largest() const { return largest_; }
+
+private:
+    std::vector<int> parent_;
+    std::vector<ObjectStats> stats_;
+    std::vector<int> above_;
+    std::vector<int> nextAbove_;
+    std::vector<int> left_;
+    int64_t objectCount_;
+    ObjectStats largest_;
+
+    int find(int id) {
+        while (parent_[id] != id) {
+            parent_[id] = parent_[parent_[id]];
+            id = parent_[id];
+        }
+        return id;
+    }
+
+    void unite(int a, int b) {
+        a = find(a);
+        b = find(b);
+        if (a == b) {
+            return;
+        }
+        if (stats_[a].pixels < stats_[b].pixels) {
+            std::swap(a, b);
+        }
+        parent_[b] = a;
+        stats_[a].pixels += stats_[b].pixels;
+        stats_[a].crackEdges += stats_[b].crackEdges;
+        mergeHull(stats_[a].hull, stats_[b].hull);
+        stats_[b] = ObjectStats();
+    }
+
+    void finalize(ObjectStats& object) {
+        objectCount_++;
+        if (object.pixels > largest_.pixels) {
+            largest_ = std::move(object);
+        }
+    }
+};
+
+}
+
+std::unique_ptr<TileSource> TileSource::open(const std::string& path, const cv::Size& rawSize) {
+    cv::Size size;
+    size_t offset = 0;
+    if (ImageLoader::probeUncompressed(path, rawSize, size, offset)) {
+        std::unique_ptr<UncompressedTileSource> source(new UncompressedTileSource(path, size, offset));
+        if (source->isOpen()) {
+            return source;
+        }
+    }
+
+    LOG_WARNING(path << " is not an uncompressed frame; decoding the whole image for tiled analysis");
+    cv::Mat image;
+    {
+        StageProfiler::Scope timing(Stage::Decode);
+        image = cv::imread(path, cv::IMREAD_GRAYSCALE);
+    }
+    if (image.empty()) {
+        LOG_ERROR("Error: Cannot load image " << path);
+        return nullptr;
+    }
+    return std::unique_ptr<TileSource>(new DecodedTileSource(image));
+}
+
+TiledAnalyzer::TiledAnalyzer(const TiledOptions& options) : options_(options) {
+    if (!TextureAnalyzer::isSupportedLevels(options_.levels)) {
+        LOG_ERROR("Error: Unsupported number of grey levels: " << options_.levels << ", using 256");
+        options_.levels = 256;
+    }
+    options_.tileSize = std::max(options_.tileSize, 16);
+}
+
+// Тайлы по рядам; каждый читается с каймой в 1 пиксель (в пределах изображения),
+// чтобы пары пикселей и соседство на границах тайлов учитывались без пропусков
+template <typename Fn>
+bool TiledAnalyzer::forEachTile(TileSource& source, Fn fn) {
+    const cv::Size size = source.size();
+    const int tileSize = options_.tileSize;
+    cv::Mat tile;
+
+    for (int y0 = 0; y0 < size.height; y0 += tileSize) {
+        for (int x0 = 0; x0 < size.width; x0 += tileSize) {
+            cv::Rect core(x0, y0, std::min(tileSize, size.width - x0), std::min(tileSize, size.height - y0));
+            cv::Rect region(std::max(0, x0 - 1), std::max(0, y0 - 1), 0, 0);
+            region.width = std::min(size.width, core.x + core.width + 1) - region.x;
+            region.height = std::min(size.height, core.y + core.height + 1) - region.y;
+
+            bool ok;
+            {
+                StageProfiler::Scope timing(Stage::Decode);
+                ok = source.read(region, tile);
+            }
+            if (!ok) {
+                LOG_ERROR("Error: Cannot read tile at (" << x0 << "," << y0 << ")");
+                return false;
+            }
+
+            fn(tile, core, core.tl() - region.tl(), y0 + tileSize >= size.height,
+               x0 + tileSize >= size.width);
+        }
+    }
+    return true;
+}
+
+bool TiledAnalyzer::analyze(TileSource& source, TiledResults& results) {
+    const cv::Size size = source.size();
+    const int levels = options_.levels;
+    const KernelIsa isa = HistogramKernels::activeIsa();
+    const int shift = 8 - static_cast<int>(std::log2(levels));
+
+    results = TiledResults();
+    results.imageSize = size;
+    results.tiles = 0;
+
+    // Проход 1: гистограммы разностей по четырём направлениям и гистограмма яркости.
+    // Пара относится к тайлу, в ядре которого лежит её первый пиксель
+    std::vector<std::vector<int64_t>> differences(4, std::vector<int64_t>(levels, 0));
+    std::vector<int64_t> intensity(256, 0);
+    std::vector<int> tileHistograms(4 * static_cast<size_t>(levels));
+
+    bool ok = forEachTile(source, [&](const cv::Mat& tile, const cv::Rect& core, const cv::Point& offset,
+                                      bool, bool lastColumn) {
+        results.tiles++;
+
+        StageProfiler::Scope timing(Stage::GLCM);
+        // Без левой каймы: пары, начинающиеся в ней, принадлежат соседнему тайлу
+        cv::Mat view = tile.colRange(offset.x, tile.cols);
+        std::fill(tileHistograms.begin(), tileHistograms.end(), 0);
+        HistogramKernels::accumulateDirections(view, offset.y, offset.y + core.height, levels,
+                                               tileHistograms.data(), isa);
+
+        // Вертикальные пары правой каймы посчитаны лишними: они принадлежат тайлу справа
+        if (!lastColumn) {
+            const int haloColumn = view.cols - 1;
+            for (int y = offset.y; y < offset.y + core.height && y + 1 < view.rows; y++) {
+                int a = view.at<uchar>(y, haloColumn) >> shift;
+                int b = view.at<uchar>(y + 1, haloColumn) >> shift;
+                tileHistograms[levels + std::abs(a - b)]--;
+            }
+        }
+
+        for (int d = 0; d < 4; d++) {
+            for (int k = 0; k < levels; k++) {
+                differences[d][k] += tileHistograms[d * levels + k];
+            }
+        }
+
+        for (int y = 0; y < core.height; y++) {
+            const uchar* row = tile.ptr<uchar>(offset.y + y) + offset.x;
+            for (int x = 0; x < core.width; x++) {
+                intensity[row[x]]++;
+            }
+        }
+    });
+    if (!ok) {
+        return false;
+    }
+
+    const int64_t width = size.width;
+    const int64_t height = size.height;
+    results.totalPairs = {
+        (width - 1) * height,
+        width * (height - 1),
+        (width - 1) * (height - 1),
+        (width - 1) * (height - 1)
+    };
+
+    double totalIDM = 0.0;
+    int validDirections = 0;
+    {
+        StageProfiler::Scope timing(Stage::IDM);
+        for (int d = 0; d < 4; d++) {
+            double idm = results.totalPairs[d] > 0 ?
+                         TextureAnalyzer::idmFromCounts(differences[d], results.totalPairs[d]) : 0.0;
+            results.directionalIDM[d] = idm;
+            if (idm > 0) {
+                totalIDM += idm;
+                validDirections++;
+            }
+        }
+    }
+    results.idm = validDirections > 0 ? totalIDM / validDirections : 0.0;
+    LOG_INFO("Tiled texture: " << size.width << "x" << size.height << ", " << results.tiles
+             << " tiles, IDM = " << std::fixed << std::setprecision(4) << results.idm);
+
+    {
+        StageProfiler::Scope timing(Stage::Otsu);
+        results.otsuThreshold = MorphologyAnalyzer::otsuThreshold(intensity);
+    }
+
+    // Проход 2: бинаризация по глобальному порогу и разметка объектов
+    ObjectMerger merger(size.width);
+    cv::Mat binary;
+    ok = forEachTile(source, [&](const cv::Mat& tile, const cv::Rect& core, const cv::Point& offset,
+                                 bool lastRow, bool lastColumn) {
+        StageProfiler::Scope timing(Stage::Contours);
+        cv::threshold(tile, binary, results.otsuThreshold, 255, cv::THRESH_BINARY);
+        merger.processTile(binary, offset, core);
+        if (lastColumn) {
+            merger.finishTileRow(lastRow);
+        }
+    });
+    if (!ok) {
+        return false;
+    }
+
+    results.objectCount = merger.objectCount();
+    const ObjectStats& largest = merger.largest();
+    DiameterResult& diameter = results.diameter;
+    diameter = DiameterResult();
+
+    if (largest.hull.size() >= 2) {
+        diameter = MorphologyAnalyzer::calculateMaxDiameter(largest.hull);
+    } else if (largest.hull.size() == 1) {
+        diameter.point1 = diameter.point2 = cv::Point2f(largest.hull[0]);
+    }
+
+    // Длина «лестничной» границы завышает периметр в среднем в 4/pi раз
+    diameter.area = static_cast<double>(largest.pixels);
+    diameter.perimeter = largest.crackEdges * CV_PI / 4.0;
+    diameter.contourPoints = static_cast<int>(largest.hull.size());
+    diameter.circularity = diameter.perimeter > 0 ?
+                           4.0 * CV_PI * diameter.area / (diameter.perimeter * diameter.perimeter) : 0.0;
+
+    LOG_INFO("Tiled morphology: Otsu threshold " << results.otsuThreshold << ", "
+             << results.objectCount << " objects, largest " << largest.pixels << " pixels");
+    return true;
+}
@@ -0,0 +1,238 @@
+#include "VisualizationRenderer.h"
+#include "AnalysisWorkspace.h"
+#include "Logger.h"
+#include <cctype>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+void lowerThreadPriority() {
+#ifdef __linux__
+    // В Linux nice задаётся для каждого потока отдельно: потоки анализа его не получают
+    if (setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10) != 0) {
+        LOG_DEBUG("Cannot lower visualization thread priority");
+    }
+#endif
+}
+
+cv::Point2f scalePoint(const cv::Point2f& point, double scale) {
+    return cv::Point2f(static_cast<float>(point.x * scale), static_cast<float>(point.y * scale));
+}
+
+}
+
+VisualizationRenderer::VisualizationRenderer(const VisualizationOptions& options)
+    : options_(options), open_(false), capacity_(std::max<size_t>(1, options.queueCapacity)),
+      queue_(capacity_), head_(0), queued_(0), stopping_(false),
+      submitted_(0), written_(0), failed_(0), waits_(0) {
+    spare_.reserve(capacity_ + 1);
+    std::error_code error;
+    std::filesystem::create_directories(options_.directory, error);
+    open_ = std::filesystem::is_directory(options_.directory, error);
+    if (!open_) {
+        LOG_ERROR("Cannot create visualization directory: " << options_.directory);
+        return;
+    }
+
+    worker_ = std::thread(&VisualizationRenderer::run, this);
+}
+
+VisualizationRenderer::~VisualizationRenderer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    ready_.notify_all();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+void VisualizationRenderer::submit(const std::string& imagePath, const cv::Mat& grayImage,
+                                   const std::vector<cv::Point>& contour, const DiameterResult& result) {
+    if (!open_ || grayImage.empty()) {
+        return;
+    }
+
+    // Буферы прежнего задания переиспользуются: копия кадра и контура без выделения памяти
+    Job job;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!spare_.empty()) {
+            job = std::move(spare_.back());
+            spare_.pop_back();
+        }
+    }
+    job.imagePath = imagePath;
+    job.sequence = submitted_.fetch_add(1, std::memory_order_relaxed);
+    grayImage.copyTo(job.gray);
+    job.contour.assign(contour.begin(), contour.end());
+    job.result = result;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (queued_ >= capacity_) {
+            waits_.fetch_add(1, std::memory_order_relaxed);
+            space_.wait(lock, [this]() { return queued_ < capacity_; });
+        }
+        queue_[(head_ + queued_) % capacity_] = std::move(job);
+        queued_++;
+    }
+    ready_.notify_one();
+}
+
+void VisualizationRenderer::finish() {
+    if (!worker_.joinable()) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() {
+        return written_.load() + failed_.load() >= submitted_.load();
+    });
+}
+
+void VisualizationRenderer::run() {
+    lowerThreadPriority();
+
+    Job job;
+    while (true) {
+        {
+            // Всё, что поставлено до остановки, ещё будет нарисовано
+            std::unique_lock<std::mutex> lock(mutex_);
+            ready_.wait(lock, [this]() { return queued_ > 0 || stopping_; });
+            if (queued_ == 0) {
+                break;
+            }
+            job = std::move(queue_[head_]);
+            head_ = (head_ + 1) % capacity_;
+            queued_--;
+        }
+        space_.notify_one();
+
+        render(job);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (spare_.size() <= capacity_) {
+                spare_.push_back(std::move(job));
+            }
+        }
+        done_.notify_all();
+    }
+}
+
+void VisualizationRenderer::render(Job& job) {
+    std::string path = (std::filesystem::path(options_.directory) / uniqueName(job)).string();
+    cv::Mat image = job.gray;
+    DiameterResult result = job.result;
+
+    // Эскиз рисуется сразу в своём размере, а не уменьшается после рисования
+    const int side = std::max(image.rows, image.cols);
+    if (options_.thumbnailSize > 0 && side > options_.thumbnailSize) {
+        const double scale = static_cast<double>(options_.thumbnailSize) / side;
+        const int rows = std::max(1, static_cast<int>(std::lround(image.rows * scale)));
+        const int cols = std::max(1, static_cast<int>(std::lround(image.cols * scale)));
+        cv::Mat thumbnail = AnalysisWorkspace::reserve(thumbnail_, rows, cols, CV_8UC1);
+        cv::resize(job.gray, thumbnail, thumbnail.size(), 0, 0, cv::INTER_AREA);
+        image = thumbnail;
+
+        for (cv::Point& point : job.contour) {
+            point.x = static_cast<int>(std::lround(point.x * scale));
+            point.y = static_cast<int>(std::lround(point.y * scale));
+        }
+        result.point1 = scalePoint(result.point1, scale);
+        result.point2 = scalePoint(result.point2, scale);
+    }
+
+    try {
+        cv::Mat visualization = MorphologyAnalyzer::visualizeResults(image, job.contour, result, canvas_);
+        if (cv::imwrite(path, visualization)) {
+            written_.fetch_add(1, std::memory_order_release);
+            LOG_DEBUG("Visualization saved to: " << path);
+            return;
+        }
+        LOG_ERROR("Error saving visualization: " << path);
+    } catch (const cv::Exception& e) {
+        LOG_ERROR("Error rendering visualization " << path << ": " << e.what());
+    }
+    failed_.fetch_add(1, std::memory_order_release);
+}
+
+std::string VisualizationRenderer::uniqueName(const Job& job) {
+    // Тот же файл, проанализированный снова, перезаписывает свою визуализацию
+    auto known = pathNames_.find(job.imagePath);
+    if (known != pathNames_.end()) {
+        return known->second;
+    }
+
+    std::string name = fileName(job.imagePath, job.sequence);
+    if (!names_.insert(name).second) {
+        const std::string stem = name.substr(0, name.size() - std::string("_visual.png").size());
+        name = stem + "_" + std::to_string(job.sequence) + "_visual.png";
+        // Номер задания уникален, но такое имя уже могло прийти из другого файла (img_7.png)
+        for (int attempt = 1; !names_.insert(name).second; attempt++) {
+            name = stem + "_" + std::to_string(job.sequence) + "_" + std::to_string(attempt) + "_visual.png";
+        }
+    }
+    if (!job.imagePath.empty()) {
+        pathNames_[job.imagePath] = name;
+    }
+    return name;
+}
+
+VisualizationStats VisualizationRenderer::stats() const {
+    VisualizationStats stats;
+    stats.submitted = submitted_.load(std::memory_order_relaxed);
+    stats.written = written_.load(std::memory_order_relaxed);
+    stats.failed = failed_.load(std::memory_order_relaxed);
+    stats.waits = waits_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void VisualizationRenderer::printStats() const {
+    VisualizationStats current = stats();
+    std::cout << "Visualizations written to " << options_.directory << ": " << current.written;
+    if (current.failed > 0) {
+        std::cout << ", failed: " << current.failed;
+    }
+    if (current.waits > 0) {
+        std::cout << ", queue full " << current.waits << " times";
+    }
+    std::cout << std::endl;
+}
+
+std::string VisualizationRenderer::fileName(const std::string& imagePath, uint64_t sequence) {
+    // Каталог и расширение отбрасываются; номер кадра потока (источник#номер) идёт после имени
+    std::string name = imagePath.substr(imagePath.find_last_of("/\\") + 1);
+    std::string frame;
+    size_t hash = name.find('#');
+    if (hash != std::string::npos) {
+        frame = name.substr(hash + 1);
+        name.erase(hash);
+    }
+    size_t dot = name.find_last_of('.');
+    if (dot != std::string::npos && dot > 0) {
+        name.erase(dot);
+    }
+    if (!frame.empty()) {
+        name += "_" + frame;
+    }
+
+    for (char& c : name) {
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_' && c != '.') {
+            c = '_';
+        }
+    }
+    if (name.empty()) {
+        name = "image_" + std::to_string(sequence);
+    }
+    return name + "_visual.png";
+}
@@ -1,48 +1,26 @@
-#include "ImageLoader.h"
-#include "TextureAnalyzer.h"
-#include "MorphologyAnalyzer.h"
+#include "ImageAnalysisCore.h"
+#include "ThreadPool.h"
+#include "AnalysisPipeline.h"
+#include "ResultSink.h"
+#include "Logger.h"
+#include "StageProfiler.h"
+#include "TestPatterns.h"
+#include "TiledAnalyzer.h"
+#include "ResultCache.h"
+#include "AnalysisDaemon.h"
+#include "StreamAnalyzer.h"
+#include "VisualizationRenderer.h"
 #include <iostream>
 #include <iomanip>
 #include <fstream>
+#include <cstdio>
 #include <ctime>
-
-
-struct AnalysisResults {
-    double idm_value;
-    DiameterResult diameter_result;
-    std::string image_path;
-    std::string texture_interpretation;
-    std::string size_interpretation;
-};
-
-std::string interpretIDM(double idm) {
-    if (idm >= 0.8) {
-        return "Very homogeneous texture";
-    } else if (idm >= 0.6) {
-        return "Moderately homogeneous texture";
-    } else if (idm >= 0.4) {
-        return "Heterogeneous texture with variations";
-    } else if (idm >= 0.2) {
-        return "Highly heterogeneous texture";
-    } else {
-        return "Very complex, chaotic texture";
-    }
-}
-
-std::string interpretSize(double diameter, double area) {
-    std::string result = "Object ";
-    
-    if (diameter < 50) {
-        result += "small size";
-    } else if (diameter < 150) {
-        result += "medium size";
-    } else {
-        result += "large size";
-    }
-    
-    result += " (diameter: " + std::to_string(static_cast<int>(diameter)) + " pixels)";
-    return result;
-}
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+#include <csignal>
+#include <mutex>
+#include <unordered_map>
 
 void printResults(const AnalysisResults& results) {
     std::cout << "\n" << std::string(60, '=') << std::endl;
@@ -58,9 +36,33 @@ void printResults(const AnalysisResults& results) {
     std::cout << "   Interpretation: " << results.texture_interpretation << std::endl;
     std::cout << std::endl;
     
+    const TexturePyramid& pyramid = results.texture_pyramid;
+    if (pyramid.scales > 0) {
+        // Строка на уровень, столбец на расстояние; IDM усреднён по направлениям
+        std::vector<double> average = pyramid.averageOverDirections();
+        std::cout << "TEXTURE PYRAMID (IDM by scale and distance):" << std::endl;
+        std::cout << "   " << std::setw(6) << "scale";
+        for (int d = 1; d <= pyramid.distances; d++) {
+            std::cout << std::setw(9) << ("d=" + std::to_string(d));
+        }
+        std::cout << std::endl;
+        for (int s = 0; s < pyramid.scales; s++) {
+            std::cout << "   " << std::setw(6) << s << std::fixed << std::setprecision(4);
+            for (int d = 0; d < pyramid.distances; d++) {
+                std::cout << std::setw(9) << average[s * pyramid.distances + d];
+            }
+            std::cout << std::endl;
+        }
+        std::cout << std::endl;
+    }
+    
     std::cout << "MORPHOLOGICAL ANALYSIS:" << std::endl;
     std::cout << "   Maximum diameter: " << std::fixed << std::setprecision(2) 
               << results.diameter_result.maxDiameter << " pixels" << std::endl;
+    if (results.diameter_result.relativeError > 0) {
+        std::cout << "   Diameter error: at most " << std::setprecision(3) 
+                  << 100.0 * results.diameter_result.relativeError << "% (approximate)" << std::endl;
+    }
     std::cout << "   Object area: " << std::fixed << std::setprecision(1) 
               << results.diameter_result.area << " pixels²" << std::endl;
     std::cout << "   Perimeter: " << std::fixed << std::setprecision(1) 
@@ -78,20 +80,51 @@ void printResults(const AnalysisResults& results) {
               << results.diameter_result.point2.x << ", " 
               << results.diameter_result.point2.y << ")" << std::endl;
     
+    if (!results.objects.empty()) {
+        std::cout << std::endl;
+        std::cout << "OBJECTS (" << results.objects.size() << "):" << std::endl;
+        std::cout << "   " << std::setw(6) << "label" << std::setw(12) << "diameter" 
+                  << std::setw(12) << "area" << std::setw(12) << "perimeter" 
+                  << std::setw(13) << "circularity" << std::endl;
+        for (const DiameterResult& object : results.objects) {
+            std::cout << "   " << std::setw(6) << object.label << std::fixed 
+                      << std::setprecision(2) << std::setw(12) << object.maxDiameter 
+                      << std::setprecision(1) << std::setw(12) << object.area 
+                      << std::setw(12) << object.perimeter 
+                      << std::setprecision(3) << std::setw(13) << object.circularity << std::endl;
+        }
+    }
+    
     std::cout << std::string(60, '=') << std::endl;
 }
 
 void saveResultsToFile(const AnalysisResults& results, const std::string& filename) {
     std::ofstream file(filename);
     if (!file.is_open()) {
-        std::cerr << "Error creating results file: " << filename << std::endl;
+        LOG_ERROR("Error creating results file: " << filename);
         return;
     }
     
     file << "IMAGE_PATH=" << results.image_path << "\n";
     file << "IDM_VALUE=" << std::fixed << std::setprecision(6) << results.idm_value << "\n";
     file << "IDM_INTERPRETATION=" << results.texture_interpretation << "\n";
+    if (results.texture_pyramid.scales > 0) {
+        // TEXTURE_PYRAMID_<уровень>_<расстояние>=IDM по (d,0),(0,d),(d,d),(d,-d)
+        const TexturePyramid& pyramid = results.texture_pyramid;
+        for (int s = 0; s < pyramid.scales; s++) {
+            for (int d = 1; d <= pyramid.distances; d++) {
+                file << "TEXTURE_PYRAMID_" << s << "_" << d << "=" << std::setprecision(6);
+                for (int direction = 0; direction < 4; direction++) {
+                    file << (direction > 0 ? "," : "") << pyramid.at(s, d, direction);
+                }
+                file << "\n";
+            }
+        }
+    }
     file << "MAX_DIAMETER=" << std::fixed << std::setprecision(2) << results.diameter_result.maxDiameter << "\n";
+    if (results.diameter_result.relativeError > 0) {
+        file << "MAX_DIAMETER_ERROR=" << std::setprecision(6) << results.diameter_result.relativeError << "\n";
+    }
     file << "OBJECT_AREA=" << std::fixed << std::setprecision(1) << results.diameter_result.area << "\n";
     file << "PERIMETER=" << std::fixed << std::setprecision(1) << results.diameter_result.perimeter << "\n";
     file << "CIRCULARITY=" << std::fixed << std::setprecision(3) << results.diameter_result.circularity << "\n";
@@ -101,99 +134,334 @@ void saveResultsToFile(const AnalysisResults& results, const std::string& filena
     file << "DIAMETER_POINT2_X=" << results.diameter_result.point2.x << "\n";
     file << "DIAMETER_POINT2_Y=" << results.diameter_result.point2.y << "\n";
     
+    if (!results.objects.empty()) {
+        file << "OBJECT_COUNT=" << results.objects.size() << "\n";
+        // OBJECT_<метка>=диаметр,площадь,периметр,округлость
+        for (const DiameterResult& object : results.objects) {
+            file << "OBJECT_" << object.label << "=" << std::fixed 
+                 << std::setprecision(2) << object.maxDiameter << "," 
+                 << std::setprecision(1) << object.area << "," << object.perimeter << "," 
+                 << std::setprecision(3) << object.circularity << "\n";
+        }
+    }
+    
     file.close();
-    std::cout << "Results saved to: " << filename << std::endl;
+    LOG_INFO("Results saved to: " << filename);
 }
     
 
 
-AnalysisResults analyzeImage(const std::string& imagePath) {
-    AnalysisResults results;
-    results.image_path = imagePath;
-    results.idm_value = 0.0;
+std::string resultFileName(const std::string& imagePath) {
+    std::string base_filename = imagePath.substr(imagePath.find_last_of("/\\") + 1);
+    std::string::size_type const p(base_filename.find_last_of('.'));
+    std::string file_without_ext = base_filename.substr(0, p);
     
-    std::cout << "\nStarting image analysis: " << imagePath << std::endl;
-    std::cout << std::string(60, '-') << std::endl;
+    return "../results/result_" + file_without_ext + ".txt";
+}
+
+bool isImageFile(const std::filesystem::path& path) {
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    
+    static const std::vector<std::string> extensions = {
+        ".png", ".jpg", ".jpeg", ".bmp", ".tif", ".tiff", ".pgm", ".ppm", ".webp", ".npy", ".raw"
+    };
+    return std::find(extensions.begin(), extensions.end(), extension) != extensions.end();
+}
+
+// Источник пакета: каталог, шаблон (glob) или текстовый файл со списком путей
+std::vector<std::string> collectImagePaths(const std::string& source) {
+    std::vector<std::string> paths;
+    std::error_code error;
     
-    cv::Mat originalImage = ImageLoader::loadImage(imagePath);
-    if (originalImage.empty()) {
-        std::cerr << "Failed to load image" << std::endl;
-        return results;
+    if (std::filesystem::is_directory(source, error)) {
+        for (const auto& entry : std::filesystem::directory_iterator(source, error)) {
+            if (entry.is_regular_file(error) && isImageFile(entry.path())) {
+                paths.push_back(entry.path().string());
+            }
+        }
+        std::sort(paths.begin(), paths.end());
+    } else if (source.find_first_of("*?") != std::string::npos) {
+        try {
+            cv::glob(source, paths, false);
+        } catch (const cv::Exception& e) {
+            std::cerr << "Error: Cannot expand pattern " << source << ": " << e.what() << std::endl;
+        }
+    } else {
+        std::ifstream list(source);
+        if (!list.is_open()) {
+            std::cerr << "Error: Cannot open batch source " << source << std::endl;
+            return paths;
+        }
+        
+        std::string line;
+        while (std::getline(list, line)) {
+            line.erase(0, line.find_first_not_of(" \t\r"));
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            if (!line.empty() && line[0] != '#') {
+                paths.push_back(line);
+            }
+        }
     }
     
-    cv::Mat grayImage = ImageLoader::convertToGrayscale(originalImage);
-    if (grayImage.empty()) {
-        std::cerr << "Error converting to grayscale" << std::endl;
-        return results;
+    return paths;
+}
+
+// Без --output результаты пишутся по одному текстовому файлу на изображение, как раньше
+void storeResults(const AnalysisResults& results, ResultSink* sink) {
+    if (sink) {
+        sink->write(results);
+    } else {
+        saveResultsToFile(results, resultFileName(results.image_path));
+    }
+}
+
+void printCacheStats(const ResultCache* cache) {
+    if (!cache) {
+        return;
+    }
+    CacheStats stats = cache->stats();
+    std::cout << "Cache: " << stats.hits << " hits, " << stats.misses << " misses, " 
+              << stats.stores << " stored, " << stats.evictions << " evicted" << std::endl;
+}
+
+int runPipeline(const std::string& source, const PipelineOptions& options, 
+                const AnalysisOptions& analysisOptions, ResultSink* sink) {
+    std::vector<std::string> paths = collectImagePaths(source);
+    if (paths.empty()) {
+        std::cerr << "No images found for batch source: " << source << std::endl;
+        return 1;
     }
     
-    cv::Mat resizedGray = ImageLoader::resizeImage(grayImage, 512);
+    cv::setNumThreads(1);
     
-    std::cout << "\nTexture analysis..." << std::endl;
-    TextureAnalyzer textureAnalyzer;
-    results.idm_value = textureAnalyzer.analyzeMultiDirectional(resizedGray);
-    results.texture_interpretation = interpretIDM(results.idm_value);
+    // Кэш проверяют читатели конвейера, попадания сразу уходят в вывод.
+    // Ключи промахов запоминаются, чтобы анализ не хешировал файлы второй раз
+    ResultCache* cache = analysisOptions.cache;
+    std::mutex keysMutex;
+    std::unordered_map<std::string, std::string> pendingKeys;
+    AnalysisPipeline::LookupStage lookup;
+    if (cache) {
+        lookup = [&analysisOptions, &keysMutex, &pendingKeys, cache](const std::string& path,
+                                                                     AnalysisResults& results) {
+            std::string key = ImageAnalysisCore::cacheKey(path, analysisOptions);
+            if (cache->lookup(key, path, results)) {
+                return true;
+            }
+            std::lock_guard<std::mutex> lock(keysMutex);
+            pendingKeys[path] = key;
+            return false;
+        };
+    }
     
-    std::cout << "\nMorphological analysis..." << std::endl;
+    AnalysisPipeline pipeline(options, 
+        [&analysisOptions](const std::string& path) { 
+            return ImageAnalysisCore::loadGray(path, analysisOptions); 
+        },
+        [&analysisOptions, &keysMutex, &pendingKeys, cache](const std::string& path, const cv::Mat& gray) {
+            AnalysisResults results{};
+            results.image_path = path;
+            bool ok = ImageAnalysisCore::analyzeImage(gray, analysisOptions, results);
+            if (cache) {
+                std::string key;
+                {
+                    std::lock_guard<std::mutex> lock(keysMutex);
+                    auto found = pendingKeys.find(path);
+                    if (found != pendingKeys.end()) {
+                        key.swap(found->second);
+                        pendingKeys.erase(found);
+                    }
+                }
+                if (ok && !key.empty()) {
+                    cache->store(key, results);
+                }
+            }
+            return results;
+        },
+        [sink](const AnalysisResults& results) { storeResults(results, sink); },
+        lookup);
     
-    cv::Mat binaryImage = MorphologyAnalyzer::binarizeImageOtsu(resizedGray);
+    std::cout << "\nPipeline mode: " << paths.size() << " images, " << options.readers 
+              << " readers, memory budget " << options.memoryBudgetBytes / (1024 * 1024) 
+              << " MB" << std::endl;
     
-    std::vector<std::vector<cv::Point>> contours = MorphologyAnalyzer::findContours(binaryImage);
+    PipelineStats stats = pipeline.run(paths);
+    AnalysisPipeline::printStats(stats);
+    printCacheStats(cache);
     
-    if (!contours.empty()) {
-        int largestIndex = MorphologyAnalyzer::findLargestContour(contours);
-        if (largestIndex >= 0) {
-            results.diameter_result = MorphologyAnalyzer::calculateMaxDiameter(contours[largestIndex]);
-            results.size_interpretation = interpretSize(results.diameter_result.maxDiameter, 
-                                                       results.diameter_result.area);
-            
-            cv::Mat visualization = MorphologyAnalyzer::visualizeResults(
-                resizedGray, contours[largestIndex], results.diameter_result);
-            
-            
-            
-        }
-    } else {
-        std::cout << "No objects found in image" << std::endl;
-        results.size_interpretation = "No objects detected";
+    return stats.failed > 0 ? 1 : 0;
+}
+
+int runBatch(const std::string& source, int jobs, const AnalysisOptions& analysisOptions, 
+             ResultSink* sink) {
+    std::vector<std::string> paths = collectImagePaths(source);
+    if (paths.empty()) {
+        std::cerr << "No images found for batch source: " << source << std::endl;
+        return 1;
     }
     
-    return results;
+    // Параллелизм на уровне изображений; внутренний parallel_for_ OpenCV отключён
+    cv::setNumThreads(1);
+    ThreadPool pool(jobs);
+    
+    std::cout << "\nBatch mode: " << paths.size() << " images, " 
+              << pool.threadCount() << " worker threads" << std::endl;
+    
+    auto start = std::chrono::steady_clock::now();
+    
+    size_t succeeded = ImageAnalysisCore::analyzeBatch(paths, analysisOptions, &pool,
+        [sink](size_t, AnalysisResults& results) {
+            if (ImageAnalysisCore::succeeded(results)) {
+                storeResults(results, sink);
+            }
+        });
+    size_t failed = paths.size() - succeeded;
+    
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "\nBatch completed: " << paths.size() << " images, " 
+              << failed << " failed, " << std::fixed << std::setprecision(2) 
+              << seconds << " s, " << std::setprecision(1) 
+              << (seconds > 0 ? paths.size() / seconds : 0.0) << " images/s" << std::endl;
+    printCacheStats(analysisOptions.cache);
+    
+    return failed > 0 ? 1 : 0;
 }
-void createTestImages() {
-    // 1. Однородный серый квадрат
-    cv::Mat uniform = cv::Mat::ones(200, 200, CV_8UC1) * 128;
-    cv::imwrite("../test_images/uniform_gray.png", uniform);
-    
-    // 2. Белый круг на черном фоне
-    cv::Mat circle = cv::Mat::zeros(200, 200, CV_8UC1);
-    cv::circle(circle, cv::Point(100, 100), 50, 255, -1);
-    cv::imwrite("../test_images/white_circle.png", circle);
-    
-    // 3. Шахматная доска
-    cv::Mat chess = cv::Mat::zeros(200, 200, CV_8UC1);
-    for (int i = 0; i < 200; i += 25) {
-        for (int j = 0; j < 200; j += 25) {
-            if (((i/25) + (j/25)) % 2 == 0) {
-                cv::rectangle(chess, cv::Point(j, i), cv::Point(j+25, i+25), 255, -1);
+
+AnalysisDaemon* activeDaemon = nullptr;
+
+void stopDaemon(int) {
+    if (activeDaemon) {
+        activeDaemon->stop();
+    }
+}
+
+int runDaemon(const DaemonOptions& options) {
+    // Параллелизм на уровне запросов, как в пакетном режиме
+    cv::setNumThreads(1);
+    AnalysisDaemon daemon(options);
+    
+    std::cout << "\nDaemon mode: " << options.socketPath << ", queue " << options.queueCapacity 
+              << ", max batch " << options.maxBatch << std::endl;
+    
+    activeDaemon = &daemon;
+    std::signal(SIGINT, stopDaemon);
+    std::signal(SIGTERM, stopDaemon);
+    bool ok = daemon.run();
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    activeDaemon = nullptr;
+    
+    AnalysisDaemon::printStats(daemon.stats());
+    return ok ? 0 : 1;
+}
+
+// Видеофайл, номер камеры или последовательность кадров (img_%04d.png)
+int runStream(const std::string& source, const StreamOptions& options, int jobs, ResultSink* sink) {
+    cv::VideoCapture capture;
+    bool isDevice = !source.empty() && source.find_first_not_of("0123456789") == std::string::npos;
+    if (isDevice) {
+        capture.open(std::atoi(source.c_str()));
+    } else {
+        capture.open(source);
+    }
+    if (!capture.isOpened()) {
+        std::cerr << "Error: Cannot open stream " << source << std::endl;
+        return 1;
+    }
+    
+    cv::setNumThreads(1);
+    ThreadPool pool(jobs);
+    StreamAnalyzer analyzer(options);
+    
+    std::cout << "\nStream mode: " << source << ", tile " << options.tileSize 
+              << ", tolerance " << options.tolerance << std::endl;
+    
+    auto start = std::chrono::steady_clock::now();
+    cv::Mat frame;
+    AnalysisResults results{};
+    uint64_t index = 0;
+    uint64_t failed = 0;
+    while (capture.read(frame)) {
+        results.image_path = source + "#" + std::to_string(index);
+        if (analyzer.process(frame, results, &pool)) {
+            if (sink) {
+                sink->write(results);
+            } else {
+                std::cout << "Frame " << index << ": IDM " << std::fixed << std::setprecision(6) 
+                          << results.idm_value << ", diameter " << std::setprecision(2) 
+                          << results.diameter_result.maxDiameter << std::endl;
             }
+        } else {
+            failed++;
         }
+        index++;
     }
-    cv::imwrite("../test_images/chessboard.png", chess);
     
-    // 4. Квадрат 100x100
-    cv::Mat square = cv::Mat::zeros(200, 200, CV_8UC1);
-    cv::rectangle(square, cv::Point(50, 50), cv::Point(150, 150), 255, -1);
-    cv::imwrite("../test_images/square.png", square);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    StreamAnalyzer::printStats(analyzer.stats());
+    std::cout << "   " << std::fixed << std::setprecision(2) << seconds << " s, " 
+              << std::setprecision(1) << (seconds > 0 ? index / seconds : 0.0) << " frames/s" << std::endl;
     
-    // 5. Случайный шум
-    cv::Mat noise = cv::Mat::zeros(200, 200, CV_8UC1);
-    cv::randu(noise, 0, 255);
-    cv::imwrite("../test_images/noise.png", noise);
+    return failed > 0 ? 1 : 0;
+}
+
+void createTestImages() {
+    const std::vector<std::pair<std::string, std::string>> files = {
+        {"uniform", "uniform_gray.png"},
+        {"circle", "white_circle.png"},
+        {"chessboard", "chessboard.png"},
+        {"square", "square.png"},
+        {"noise", "noise.png"}
+    };
+    for (const auto& file : files) {
+        cv::imwrite("../test_images/" + file.second, TestPatterns::make(file.first, 200));
+    }
     
     std::cout << "Test images created in ../test_images/ folder" << std::endl;
 }
 
+void printUsage() {
+    std::cout << "Usage: ImageAnalysis [image] [options]\n"
+                 "\n"
+                 "Sizes, areas and diameters are in pixels of the analysed frame: images are\n"
+                 "reduced so that the larger side is at most --analysis-size (tiled mode is\n"
+                 "always full resolution).\n"
+                 "\n"
+                 "Input:\n"
+                 "  --batch DIR|GLOB|LIST    analyse a directory, a pattern or a list file\n"
+                 "  --jobs N                 batch worker threads\n"
+                 "  --pipeline               staged decode/analyse/write pipeline for --batch\n"
+                 "  --readers N              pipeline decode threads\n"
+                 "  --memory-budget MB       decoded images held by the pipeline\n"
+                 "  --raw-size WxH           frame size of headerless .raw/.gray files\n"
+                 "  --stream SOURCE          frame stream with incremental re-analysis\n"
+                 "  --stream-tile N, --stream-tolerance N, --keyframe N\n"
+                 "  --daemon SOCKET          serve requests on a UNIX socket\n"
+                 "  --queue N, --max-batch N\n"
+                 "\n"
+                 "Analysis:\n"
+                 "  --analysis-size N        larger side of the analysed frame, 0 - full resolution\n"
+                 "                           (default 512; frames above 2^31 pixels need --tiled)\n"
+                 "  --tiled, --tile-size N   full-resolution tiled analysis\n"
+                 "  --objects                measure every object, not only the largest\n"
+                 "  --min-area N             implies --objects; skip objects smaller than N pixels\n"
+                 "                           of the analysed frame (after reduction to\n"
+                 "                           --analysis-size, so N shrinks with the image)\n"
+                 "  --approx-diameter K      approximate diameter over K directions\n"
+                 "  --texture-distances N, --texture-scales N\n"
+                 "                           IDM pyramid over distances 1..N and N scales\n"
+                 "  --texture-base N         larger side of pyramid level 0 when above\n"
+                 "                           --analysis-size (default: the analysed frame)\n"
+                 "\n"
+                 "Output:\n"
+                 "  --output FILE, --format jsonl|csv|bin\n"
+                 "  --visualize DIR, --thumbnail N\n"
+                 "  --cache DIR, --cache-size MB\n"
+                 "  --log-level off|error|warning|info|debug\n"
+                 "  --profile, --trace FILE\n"
+              << std::endl;
+}
+
 int main(int argc, char* argv[]) {
 
     std::cout << "============================================================" << std::endl;
@@ -202,18 +470,251 @@ int main(int argc, char* argv[]) {
     std::cout << "============================================================" << std::endl;
     
     std::string imagePath;
+    std::string batchSource;
+    int jobs = 0;
+    bool usePipeline = false;
+    PipelineOptions pipelineOptions;
+    pipelineOptions.reportIntervalMs = 1000;
+    AnalysisOptions analysisOptions;
+    std::string outputPath;
+    std::string outputFormat;
+    std::string tracePath;
+    bool profile = false;
+    bool logLevelSet = false;
+    std::string cacheDirectory;
+    uint64_t cacheSizeMb = 256;
+    VisualizationOptions visualizationOptions;
+    DaemonOptions daemonOptions;
+    std::string streamSource;
+    StreamOptions streamOptions;
+    
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            printUsage();
+            return 0;
+        } else if (arg == "--batch" && i + 1 < argc) {
+            batchSource = argv[++i];
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            jobs = std::atoi(argv[++i]);
+        } else if (arg == "--pipeline") {
+            usePipeline = true;
+        } else if (arg == "--readers" && i + 1 < argc) {
+            pipelineOptions.readers = std::atoi(argv[++i]);
+        } else if (arg == "--memory-budget" && i + 1 < argc) {
+            pipelineOptions.memoryBudgetBytes = std::strtoull(argv[++i], nullptr, 10) * 1024 * 1024;
+        } else if (arg == "--output" && i + 1 < argc) {
+            outputPath = argv[++i];
+        } else if (arg == "--format" && i + 1 < argc) {
+            outputFormat = argv[++i];
+        } else if (arg == "--log-level" && i + 1 < argc) {
+            LogLevel level;
+            if (!Logger::parseLevel(argv[++i], level)) {
+                std::cerr << "Unknown log level: " << argv[i] 
+                          << " (expected off, error, warning, info or debug)" << std::endl;
+                return 1;
+            }
+            Logger::setLevel(level);
+            logLevelSet = true;
+        } else if (arg == "--raw-size" && i + 1 < argc) {
+            if (std::sscanf(argv[++i], "%dx%d", &analysisOptions.rawFrameSize.width, 
+                        &analysisOptions.rawFrameSize.height) != 2) {
+                std::cerr << "Invalid raw frame size: " << argv[i] << " (expected WxH)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--analysis-size" && i + 1 < argc) {
+            analysisOptions.analysisSize = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--tiled") {
+            analysisOptions.tileSize = std::max(analysisOptions.tileSize, TiledOptions().tileSize);
+        } else if (arg == "--tile-size" && i + 1 < argc) {
+            analysisOptions.tileSize = std::atoi(argv[++i]);
+        } else if (arg == "--objects") {
+            analysisOptions.allObjects = true;
+        } else if (arg == "--min-area" && i + 1 < argc) {
+            analysisOptions.allObjects = true;
+            analysisOptions.minObjectPixels = std::atoi(argv[++i]);
+        } else if (arg == "--approx-diameter" && i + 1 < argc) {
+            analysisOptions.diameterMode = DiameterMode::Approximate;
+            analysisOptions.diameterDirections = std::max(2, std::atoi(argv[++i]));
+        } else if (arg == "--texture-distances" && i + 1 < argc) {
+            analysisOptions.textureDistances = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--texture-scales" && i + 1 < argc) {
+            analysisOptions.textureScales = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--texture-base" && i + 1 < argc) {
+            analysisOptions.textureBaseSize = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--visualize" && i + 1 < argc) {
+            visualizationOptions.directory = argv[++i];
+        } else if (arg == "--thumbnail" && i + 1 < argc) {
+            visualizationOptions.thumbnailSize = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--cache" && i + 1 < argc) {
+            cacheDirectory = argv[++i];
+        } else if (arg == "--cache-size" && i + 1 < argc) {
+            cacheSizeMb = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--daemon" && i + 1 < argc) {
+            daemonOptions.socketPath = argv[++i];
+        } else if (arg == "--queue" && i + 1 < argc) {
+            daemonOptions.queueCapacity = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--max-batch" && i + 1 < argc) {
+            daemonOptions.maxBatch = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--stream" && i + 1 < argc) {
+            streamSource = argv[++i];
+        } else if (arg == "--stream-tile" && i + 1 < argc) {
+            streamOptions.tileSize = std::atoi(argv[++i]);
+        } else if (arg == "--stream-tolerance" && i + 1 < argc) {
+            streamOptions.tolerance = std::atoi(argv[++i]);
+        } else if (arg == "--keyframe" && i + 1 < argc) {
+            streamOptions.keyframeInterval = std::atoi(argv[++i]);
+        } else if (arg == "--profile") {
+            profile = true;
+        } else if (arg == "--trace" && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (imagePath.empty()) {
+            imagePath = arg;
+        }
+    }
+    
+    StageProfiler::setEnabled(profile || !tracePath.empty());
+    
+    // Тайловый анализ хранит только наибольший объект
+    if (analysisOptions.allObjects && analysisOptions.tileSize > 0) {
+        LOG_WARNING("--objects is ignored in tiled mode");
+        analysisOptions.allObjects = false;
+    }
+    if ((analysisOptions.textureDistances > 1 || analysisOptions.textureScales > 1) &&
+        (analysisOptions.tileSize > 0 || !streamSource.empty())) {
+        LOG_WARNING("--texture-distances and --texture-scales are ignored in tiled and stream modes");
+        analysisOptions.textureDistances = 1;
+        analysisOptions.textureScales = 1;
+    }
+    
+    // В кэше нет контуров: при визуализации каждое изображение анализируется заново
+    if (!visualizationOptions.directory.empty() && !cacheDirectory.empty()) {
+        LOG_WARNING("--cache is ignored with --visualize");
+        cacheDirectory.clear();
+    }
+    if (!visualizationOptions.directory.empty() && analysisOptions.tileSize > 0) {
+        LOG_WARNING("--visualize is ignored in tiled mode");
+        visualizationOptions.directory.clear();
+    }
+    
+    std::unique_ptr<ResultCache> cache;
+    if (!cacheDirectory.empty()) {
+        cache.reset(new ResultCache(cacheDirectory, cacheSizeMb * 1024 * 1024));
+        if (!cache->isOpen()) {
+            return 1;
+        }
+        analysisOptions.cache = cache.get();
+    }
+    
+    std::unique_ptr<VisualizationRenderer> visualizer;
+    if (!visualizationOptions.directory.empty()) {
+        visualizer.reset(new VisualizationRenderer(visualizationOptions));
+        if (!visualizer->isOpen()) {
+            return 1;
+        }
+        analysisOptions.visualizer = visualizer.get();
+    }
+    
+    // Очередь визуализаций дописывается до итоговых отчётов
+    auto finishVisualizations = [&]() {
+        if (visualizer) {
+            visualizer->finish();
+            visualizer->printStats();
+        }
+    };
+    
+    auto reportTimings = [&]() {
+        if (profile) {
+            StageProfiler::printReport();
+        }
+        if (!tracePath.empty() && StageProfiler::writeChromeTrace(tracePath)) {
+            std::cout << "Trace written to: " << tracePath << std::endl;
+        }
+    };
+    
+    if (!daemonOptions.socketPath.empty()) {
+        daemonOptions.workers = jobs;
+        daemonOptions.analysis = analysisOptions;
+        int status = runDaemon(daemonOptions);
+        printCacheStats(cache.get());
+        finishVisualizations();
+        reportTimings();
+        return status;
+    }
+    
+    std::unique_ptr<ResultSink> sink;
+    if ((!batchSource.empty() || !streamSource.empty()) && !outputPath.empty()) {
+        if (outputFormat.empty()) {
+            outputFormat = outputPath.substr(outputPath.find_last_of('.') + 1);
+        }
+        ResultFormat format;
+        if (!ResultSink::parseFormat(outputFormat, format)) {
+            std::cerr << "Unknown output format: " << outputFormat 
+                      << " (expected jsonl, csv or bin)" << std::endl;
+            return 1;
+        }
+        sink = ResultSink::create(format, outputPath);
+        if (!sink->isOpen()) {
+            return 1;
+        }
+    }
+    
+    auto reportOutput = [&]() {
+        if (sink) {
+            sink->flush();
+            std::cout << "Results written to: " << outputPath << " (" 
+                      << sink->recordsWritten() << " records)" << std::endl;
+        }
+    };
+    
+    if (!streamSource.empty()) {
+        streamOptions.analysis = analysisOptions;
+        int status = runStream(streamSource, streamOptions, jobs, sink.get());
+        reportOutput();
+        finishVisualizations();
+        reportTimings();
+        return status;
+    }
+    
+    if (!batchSource.empty()) {
+        // Конвейер декодирует изображения целиком; тайловый режим читает их сам
+        if (usePipeline && analysisOptions.tileSize > 0) {
+            LOG_WARNING("--pipeline is ignored in tiled mode, using --batch workers");
+            usePipeline = false;
+        }
+        
+        int status = 0;
+        if (usePipeline) {
+            pipelineOptions.analyzers = jobs;
+            status = runPipeline(batchSource, pipelineOptions, analysisOptions, sink.get());
+        } else {
+            status = runBatch(batchSource, jobs, analysisOptions, sink.get());
+        }
+        
+        reportOutput();
+        finishVisualizations();
+        reportTimings();
+        return status;
+    }
 
-    if (argc > 1) {
-        imagePath = argv[1];
+    if (!imagePath.empty()) {
         std::cout << "\nImage path provided via command line: " << imagePath << std::endl;
     } else {
         std::cout << "\nEnter image path: ";
         std::getline(std::cin, imagePath);
     }
     
-    AnalysisResults results = analyzeImage(imagePath);
+    // В интерактивном режиме по умолчанию показываются промежуточные шаги
+    if (!logLevelSet) {
+        Logger::setLevel(LogLevel::Info);
+    }
+    
+    AnalysisResults results{};
+    bool analysed = ImageAnalysisCore::analyzeFile(imagePath, analysisOptions, results);
+    finishVisualizations();
+    reportTimings();
     
-    if (results.idm_value > 0 || results.diameter_result.maxDiameter > 0) {
+    if (analysed) {
         printResults(results);
         
 
@@ -222,12 +723,7 @@ int main(int argc, char* argv[]) {
         std::cin >> saveChoice;
         
         if (saveChoice == 'y' || saveChoice == 'Y') {
-            std::string base_filename = imagePath.substr(imagePath.find_last_of("/\\") + 1);
-            std::string::size_type const p(base_filename.find_last_of('.'));
-            std::string file_without_ext = base_filename.substr(0, p);
-            
-            std::string filename = "../results/result_" + file_without_ext + ".txt";
-            saveResultsToFile(results, filename);
+            saveResultsToFile(results, resultFileName(imagePath));
         }
 
     } else {
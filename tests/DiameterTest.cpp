@@ -0,0 +1,82 @@
+#include "TestSupport.h"
+#include "MorphologyAnalyzer.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+// Сравнение режимов диаметра: RotatingCalipers должен совпадать с BruteForce,
+// Approximate - не превышать точный диаметр и отставать от него не больше approximationError(K).
+// Контуры берутся из test_images/ и из случайных наборов точек
+
+namespace {
+
+const int kApproximateDirections[] = {2, 3, 8, 32, 128};
+
+void check(const std::vector<cv::Point>& contour, const std::string& name) {
+    DiameterResult exact = MorphologyAnalyzer::calculateMaxDiameter(contour, DiameterMode::BruteForce);
+    DiameterResult calipers = MorphologyAnalyzer::calculateMaxDiameter(contour, DiameterMode::RotatingCalipers);
+    const double tolerance = 1e-6 * std::max(1.0, exact.maxDiameter);
+    TEST_CHECK(std::abs(calipers.maxDiameter - exact.maxDiameter) <= tolerance,
+               name << ": rotating calipers " << calipers.maxDiameter << ", brute force " << exact.maxDiameter);
+
+    for (int directions : kApproximateDirections) {
+        DiameterResult approximate = MorphologyAnalyzer::calculateMaxDiameter(
+            contour, DiameterMode::Approximate, directions);
+        const double bound = MorphologyAnalyzer::approximationError(directions);
+        const double lowest = exact.maxDiameter * (1.0 - bound) - tolerance;
+        TEST_CHECK(approximate.maxDiameter <= exact.maxDiameter + tolerance && approximate.maxDiameter >= lowest &&
+                   approximate.relativeError <= bound,
+                   name << ": approximate K=" << directions << " gives " << approximate.maxDiameter
+                        << ", exact " << exact.maxDiameter << ", bound " << bound);
+    }
+}
+
+void checkTestImages(const std::string& directory) {
+    TestSupport::forEachImage(directory, cv::IMREAD_GRAYSCALE, [](const cv::Mat& gray, const std::string& name) {
+        std::vector<std::vector<cv::Point>> contours =
+            MorphologyAnalyzer::findContours(MorphologyAnalyzer::binarizeImageOtsu(gray));
+        for (size_t i = 0; i < contours.size(); i++) {
+            check(contours[i], name + " contour " + std::to_string(i));
+        }
+    });
+}
+
+// Равномерные точки, точки на окружности (много равных диаметров), отрезок и повторы
+void checkRandomPolygons(int count) {
+    std::mt19937 random(20240517);
+    for (int n = 0; n < count; n++) {
+        std::uniform_int_distribution<int> sizeDistribution(1, 300);
+        const int points = sizeDistribution(random);
+        const int shape = n % 4;
+        std::uniform_int_distribution<int> coordinate(-1000, 1000);
+        std::uniform_real_distribution<double> angle(0.0, 2.0 * M_PI);
+
+        std::vector<cv::Point> contour;
+        for (int i = 0; i < points; i++) {
+            if (shape == 0) {
+                contour.emplace_back(coordinate(random), coordinate(random));
+            } else if (shape == 1) {
+                double a = angle(random);
+                contour.emplace_back(static_cast<int>(std::lround(500 * std::cos(a))),
+                                     static_cast<int>(std::lround(500 * std::sin(a))));
+            } else if (shape == 2) {
+                int t = coordinate(random);
+                contour.emplace_back(t, 3 * t + 7);
+            } else {
+                contour.emplace_back(coordinate(random) / 200, coordinate(random) / 200);
+            }
+        }
+        check(contour, "random polygon " + std::to_string(n));
+    }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    return TestSupport::run(argc, argv, [](const std::string& directory) {
+        checkTestImages(directory);
+        checkRandomPolygons(3000);
+    });
+}
@@ -0,0 +1,148 @@
+#include "TestSupport.h"
+#include "TextureAnalyzer.h"
+#include "AnalysisWorkspace.h"
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+// Признаки Харалика против формул по плотной нормированной GLCM p(i, j):
+//   contrast = sum (i - j)^2 p, energy = sum p^2, entropy = -sum p ln p,
+//   correlation = (sum i j p - mx my) / (sx sy), homogeneity = sum p / (1 + |i - j|),
+//   IDM = sum p / (1 + (i - j)^2)
+// для всех поддерживаемых уровней и нескольких смещений. GLCM getNormalizedGLCM сверяется
+// с подсчётом пар с нуля. У постоянного изображения sx sy = 0, корреляция принимается равной 1
+
+namespace {
+
+const int kLevels[] = {8, 16, 32, 64, 128, 256};
+const int kOffsets[][2] = {{1, 0}, {0, 1}, {1, 1}, {1, -1}, {2, -3}};
+// Признаки считаются по целым счётчикам с нормировкой в конце, формулы - по долям
+const double kTolerance = 1e-9;
+
+bool agrees(double actual, double expected) {
+    return std::abs(actual - expected) <= kTolerance * std::max(1.0, std::abs(expected));
+}
+
+std::vector<std::vector<double>> countGLCM(const cv::Mat& image, int dx, int dy, int levels) {
+    int shift = 0;
+    while ((256 >> shift) > levels) {
+        shift++;
+    }
+    std::vector<std::vector<double>> glcm(levels, std::vector<double>(levels, 0.0));
+    double total = 0.0;
+    for (int y = std::max(0, -dy); y < image.rows - std::max(0, dy); y++) {
+        for (int x = std::max(0, -dx); x < image.cols - std::max(0, dx); x++) {
+            glcm[image.at<uchar>(y, x) >> shift][image.at<uchar>(y + dy, x + dx) >> shift] += 1.0;
+            total += 1.0;
+        }
+    }
+    for (auto& row : glcm) {
+        for (double& p : row) {
+            p /= total;
+        }
+    }
+    return glcm;
+}
+
+HaralickFeatures textbook(const std::vector<std::vector<double>>& p) {
+    const int levels = static_cast<int>(p.size());
+    HaralickFeatures f{};
+    double meanX = 0.0, meanY = 0.0;
+    for (int i = 0; i < levels; i++) {
+        for (int j = 0; j < levels; j++) {
+            meanX += i * p[i][j];
+            meanY += j * p[i][j];
+        }
+    }
+    double varianceX = 0.0, varianceY = 0.0, covariance = 0.0;
+    for (int i = 0; i < levels; i++) {
+        for (int j = 0; j < levels; j++) {
+            const double value = p[i][j];
+            const double d = i - j;
+            f.contrast += d * d * value;
+            f.energy += value * value;
+            if (value > 0) {
+                f.entropy -= value * std::log(value);
+            }
+            f.homogeneity += value / (1.0 + std::abs(d));
+            f.idm += value / (1.0 + d * d);
+            varianceX += (i - meanX) * (i - meanX) * value;
+            varianceY += (j - meanY) * (j - meanY) * value;
+            covariance += (i - meanX) * (j - meanY) * value;
+        }
+    }
+    const double deviation = std::sqrt(varianceX * varianceY);
+    f.correlation = deviation > 1e-12 ? covariance / deviation : 1.0;
+    return f;
+}
+
+std::string describe(const HaralickFeatures& f) {
+    return "contrast " + std::to_string(f.contrast) + ", energy " + std::to_string(f.energy) +
+           ", entropy " + std::to_string(f.entropy) + ", correlation " + std::to_string(f.correlation) +
+           ", homogeneity " + std::to_string(f.homogeneity) + ", IDM " + std::to_string(f.idm);
+}
+
+bool matches(const HaralickFeatures& actual, const HaralickFeatures& expected) {
+    return agrees(actual.contrast, expected.contrast) && agrees(actual.energy, expected.energy) &&
+           agrees(actual.entropy, expected.entropy) && agrees(actual.correlation, expected.correlation) &&
+           agrees(actual.homogeneity, expected.homogeneity) && agrees(actual.idm, expected.idm);
+}
+
+void check(const cv::Mat& gray, const std::string& name) {
+    AnalysisWorkspace workspace;
+    for (int levels : kLevels) {
+        TextureAnalyzer analyzer(levels);
+        for (const auto& offset : kOffsets) {
+            const std::string where = name + " levels " + std::to_string(levels) + " offset (" +
+                                      std::to_string(offset[0]) + "," + std::to_string(offset[1]) + ")";
+
+            analyzer.buildGLCM(gray, offset[0], offset[1]);
+            const std::vector<std::vector<double>> glcm = analyzer.getNormalizedGLCM();
+            const std::vector<std::vector<double>> counted = countGLCM(gray, offset[0], offset[1], levels);
+            bool same = glcm.size() == counted.size();
+            for (size_t i = 0; same && i < glcm.size(); i++) {
+                for (size_t j = 0; same && j < glcm[i].size(); j++) {
+                    same = agrees(glcm[i][j], counted[i][j]);
+                }
+            }
+            TEST_CHECK(same, where << ": getNormalizedGLCM differs from counted pairs");
+
+            const HaralickFeatures expected = textbook(counted);
+            const HaralickFeatures features = analyzer.computeFeatures();
+            TEST_CHECK(matches(features, expected),
+                       where << ": computeFeatures " << describe(features) << "; textbook " << describe(expected));
+
+            const HaralickFeatures stateless = TextureAnalyzer::computeFeatures(gray, offset[0], offset[1], levels,
+                                                                                FeatureAll, workspace);
+            TEST_CHECK(matches(stateless, expected),
+                       where << ": static computeFeatures " << describe(stateless) << "; textbook "
+                             << describe(expected));
+        }
+    }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    return TestSupport::run(argc, argv, [](const std::string& directory) {
+        TestSupport::forEachImage(directory, cv::IMREAD_GRAYSCALE, check);
+
+        cv::Mat noise(67, 93, CV_8UC1);
+        cv::randu(noise, 0, 256);
+        check(noise, "noise 93x67");
+
+        // Постоянное изображение: одна ячейка GLCM, корреляция по соглашению 1
+        cv::Mat uniform(31, 45, CV_8UC1, cv::Scalar(137));
+        check(uniform, "uniform 45x31");
+        for (int levels : kLevels) {
+            AnalysisWorkspace workspace;
+            const HaralickFeatures features = TextureAnalyzer::computeFeatures(uniform, 1, 0, levels, FeatureAll,
+                                                                               workspace);
+            // contrast, energy, entropy, correlation, homogeneity, IDM
+            const HaralickFeatures expected{0.0, 1.0, 0.0, 1.0, 1.0, 1.0, FeatureAll};
+            TEST_CHECK(features.correlation == 1.0 && matches(features, expected),
+                       "uniform levels " << levels << ": " << describe(features));
+        }
+    });
+}
@@ -0,0 +1,103 @@
+#include "TestSupport.h"
+#include "TextureAnalyzer.h"
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+// Скользящая карта IDM против подсчёта с нуля: для каждого пикселя окно обрезается краями
+// изображения, пары (1,0), (0,1), (1,1), (1,-1) берутся целиком внутри окна, IDM направлений
+// с парами усредняются. Веса карты - фиксированная точка с 32 битами дроби, результат - float,
+// так что расхождение ограничено точностью float, а не накоплением при сдвиге окна
+
+namespace {
+
+const int kWindows[] = {3, 5, 15};
+const int kLevels[] = {256, 8};
+// Ошибка округления float для значений до 1 плюс 2^-33 на пару от весов
+const double kTolerance = 1e-6;
+
+double windowIDM(const cv::Mat& image, int levels, int x0, int y0, int x1, int y1) {
+    int shift = 0;
+    while ((256 >> shift) > levels) {
+        shift++;
+    }
+    const int offsets[4][2] = {{1, 0}, {0, 1}, {1, 1}, {1, -1}};
+    double total = 0.0;
+    int valid = 0;
+    for (const auto& offset : offsets) {
+        double sum = 0.0;
+        int pairs = 0;
+        for (int y = y0; y < y1; y++) {
+            const int ny = y + offset[1];
+            if (ny < y0 || ny >= y1) {
+                continue;
+            }
+            for (int x = x0; x + offset[0] < x1; x++) {
+                const int k = std::abs((image.at<uchar>(y, x) >> shift) -
+                                       (image.at<uchar>(ny, x + offset[0]) >> shift));
+                sum += 1.0 / (1.0 + static_cast<double>(k) * k);
+                pairs++;
+            }
+        }
+        if (pairs > 0 && sum > 0) {
+            total += sum / pairs;
+            valid++;
+        }
+    }
+    return valid > 0 ? total / valid : 0.0;
+}
+
+void check(const cv::Mat& image, const std::string& name) {
+    for (int levels : kLevels) {
+        TextureAnalyzer analyzer(levels);
+        for (int window : kWindows) {
+            const cv::Mat map = analyzer.computeIDMMap(image, window);
+            if (map.size() != image.size() || map.type() != CV_32F) {
+                TestSupport::fail(name + ": window " + std::to_string(window) + " gave no map");
+                continue;
+            }
+
+            const int radius = window / 2;
+            double worst = 0.0;
+            cv::Point worstAt;
+            for (int y = 0; y < image.rows; y++) {
+                for (int x = 0; x < image.cols; x++) {
+                    const double expected = windowIDM(image, levels, std::max(0, x - radius), std::max(0, y - radius),
+                                                      std::min(image.cols, x + radius + 1),
+                                                      std::min(image.rows, y + radius + 1));
+                    const double error = std::abs(map.at<float>(y, x) - expected);
+                    if (error > worst) {
+                        worst = error;
+                        worstAt = cv::Point(x, y);
+                    }
+                }
+            }
+            TEST_CHECK(worst <= kTolerance,
+                       name << " levels " << levels << " window " << window << ": error " << worst
+                            << " at (" << worstAt.x << "," << worstAt.y << ")");
+        }
+    }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    return TestSupport::run(argc, argv, [](const std::string& directory) {
+        TestSupport::forEachImage(directory, cv::IMREAD_GRAYSCALE, check);
+
+        // Окно больше изображения по обеим сторонам и по одной
+        cv::Mat noise(11, 37, CV_8UC1);
+        cv::randu(noise, 0, 256);
+        check(noise, "noise 37x11");
+        TextureAnalyzer analyzer(256);
+        const cv::Mat whole = analyzer.computeIDMMap(noise, 41);
+        const double expected = windowIDM(noise, 256, 0, 0, noise.cols, noise.rows);
+        TEST_CHECK(!whole.empty() && std::abs(whole.at<float>(5, 18) - expected) <= kTolerance,
+                   "noise 37x11 window 41: IDM " << (whole.empty() ? -1.0f : whole.at<float>(5, 18))
+                                                 << ", whole image " << expected);
+
+        // Окно вырождается в одну строку или один столбец
+        check(noise.row(0).clone(), "noise row");
+        check(noise.col(0).clone(), "noise column");
+    });
+}
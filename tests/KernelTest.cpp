@@ -0,0 +1,210 @@
+#include "TestSupport.h"
+#include "HistogramKernels.h"
+#include "TextureAnalyzer.h"
+#include "AnalysisWorkspace.h"
+#include <random>
+#include <string>
+#include <vector>
+
+// Векторные ядра гистограмм против скалярных: для каждого ISA, доступного на этой машине,
+// счётчики строковых ядер, accumulateDirections, accumulateFrame и accumulateOffsets должны
+// совпадать со Scalar в точности. Ширины нечётные и меньше ширины вектора, проход
+// режется на полосы строк, уровни от 8 до 256. В конце то же через setIsa для всего анализа
+
+namespace {
+
+const int kLevels[] = {8, 16, 32, 64, 128, 256};
+const int kWidths[] = {1, 2, 3, 5, 7, 8, 15, 16, 17, 31, 32, 33, 47, 63, 64, 65, 127, 200, 257};
+const int kRows = 11;
+// Границы полос строк: проход по полосам должен дать то же, что один проход
+const int kStripes[] = {0, 1, 4, 7, 11};
+const int kDistances = 4;
+
+std::vector<KernelIsa> availableIsas() {
+    std::vector<KernelIsa> isas;
+    for (KernelIsa isa : {KernelIsa::SSE2, KernelIsa::AVX2}) {
+        if (static_cast<int>(isa) <= static_cast<int>(HistogramKernels::detectIsa())) {
+            isas.push_back(isa);
+        }
+    }
+    return isas;
+}
+
+std::string describe(KernelIsa isa, int width, int levels) {
+    return std::string(HistogramKernels::isaName(isa)) + " width " + std::to_string(width) +
+           " levels " + std::to_string(levels);
+}
+
+// Случайные значения и длинные серии одинаковых (одна и та же ячейка подряд)
+cv::Mat makeImage(int rows, int cols, int type, std::mt19937& random, bool runs) {
+    cv::Mat image(rows, cols, type);
+    std::uniform_int_distribution<int> value(0, 255);
+    for (int y = 0; y < rows; y++) {
+        uchar* row = image.ptr<uchar>(y);
+        for (int x = 0; x < cols * image.channels(); x++) {
+            row[x] = static_cast<uchar>(runs ? (x / 9 + y) * 37 : value(random));
+        }
+    }
+    return image;
+}
+
+// Строковые ядра на невыровненных указателях, подгистограммы сливаются как в accumulate*
+void checkRowKernels(KernelIsa isa, const cv::Mat& image, int levels) {
+    int levelBits = 0;
+    while ((1 << levelBits) < levels) {
+        levelBits++;
+    }
+    const int shift = 8 - levelBits;
+    const int bins = levels * levels;
+    const int sub = HistogramKernels::kSubHistograms;
+
+    for (int start = 0; start < 4 && start < image.cols; start++) {
+        const int count = image.cols - start;
+        const uchar* row = image.ptr<uchar>(0) + start;
+        const uchar* neighbor = image.ptr<uchar>(image.rows - 1) + start;
+
+        std::vector<int> expected(sub * levels, 0);
+        std::vector<int> actual(sub * levels, 0);
+        HistogramKernels::differenceRow(KernelIsa::Scalar)(row, neighbor, count, shift, expected.data(), levels);
+        HistogramKernels::differenceRow(isa)(row, neighbor, count, shift, actual.data(), levels);
+        std::vector<int> expectedMerged(levels, 0);
+        std::vector<int> actualMerged(levels, 0);
+        HistogramKernels::mergeSubHistograms(expected.data(), levels, expectedMerged.data());
+        HistogramKernels::mergeSubHistograms(actual.data(), levels, actualMerged.data());
+        TEST_CHECK(actualMerged == expectedMerged, describe(isa, image.cols, levels) << ": differenceRow from " << start);
+
+        std::vector<int> expectedCells(static_cast<size_t>(sub) * bins, 0);
+        std::vector<int> actualCells(static_cast<size_t>(sub) * bins, 0);
+        HistogramKernels::cooccurrenceRow(KernelIsa::Scalar)(row, neighbor, count, shift, levelBits,
+                                                             expectedCells.data(), bins);
+        HistogramKernels::cooccurrenceRow(isa)(row, neighbor, count, shift, levelBits, actualCells.data(), bins);
+        std::vector<int> expectedGLCM(bins, 0);
+        std::vector<int> actualGLCM(bins, 0);
+        HistogramKernels::mergeSubHistograms(expectedCells.data(), bins, expectedGLCM.data());
+        HistogramKernels::mergeSubHistograms(actualCells.data(), bins, actualGLCM.data());
+        TEST_CHECK(actualGLCM == expectedGLCM, describe(isa, image.cols, levels) << ": cooccurrenceRow from " << start);
+    }
+
+    const int offsets[5][2] = {{1, 0}, {0, 1}, {1, 1}, {1, -1}, {2, -3}};
+    for (const auto& offset : offsets) {
+        std::vector<int> expected(levels, 0);
+        std::vector<int> actual(levels, 0);
+        const int expectedPairs = HistogramKernels::accumulateDifferences(image, offset[0], offset[1], levels,
+                                                                          expected.data(), KernelIsa::Scalar);
+        const int pairs = HistogramKernels::accumulateDifferences(image, offset[0], offset[1], levels,
+                                                                  actual.data(), isa);
+        TEST_CHECK(actual == expected && pairs == expectedPairs,
+                   describe(isa, image.cols, levels) << ": accumulateDifferences (" << offset[0] << ","
+                                                     << offset[1] << ")");
+
+        std::vector<int> expectedGLCM(bins, 0);
+        std::vector<int> actualGLCM(bins, 0);
+        HistogramKernels::accumulateCooccurrence(image, offset[0], offset[1], levels, expectedGLCM.data(),
+                                                 KernelIsa::Scalar);
+        HistogramKernels::accumulateCooccurrence(image, offset[0], offset[1], levels, actualGLCM.data(), isa);
+        TEST_CHECK(actualGLCM == expectedGLCM,
+                   describe(isa, image.cols, levels) << ": accumulateCooccurrence (" << offset[0] << ","
+                                                     << offset[1] << ")");
+    }
+}
+
+// Весь кадр одним проходом Scalar против прохода полосами kStripes в проверяемом ISA
+void checkSweeps(KernelIsa isa, const cv::Mat& gray, const cv::Mat& color, int levels) {
+    std::vector<int> expected(4 * levels, 0);
+    HistogramKernels::accumulateDirections(gray, 0, gray.rows, levels, expected.data(), KernelIsa::Scalar);
+    std::vector<int> actual(4 * levels, 0);
+    for (size_t s = 0; s + 1 < sizeof(kStripes) / sizeof(kStripes[0]); s++) {
+        HistogramKernels::accumulateDirections(gray, kStripes[s], kStripes[s + 1], levels, actual.data(), isa);
+    }
+    TEST_CHECK(actual == expected, describe(isa, gray.cols, levels) << ": accumulateDirections");
+
+    for (const cv::Mat& frame : {gray, color}) {
+        cv::Mat expectedGray;
+        if (frame.channels() == 1) {
+            expectedGray = frame;
+        } else {
+            cv::cvtColor(frame, expectedGray, frame.channels() == 3 ? cv::COLOR_BGR2GRAY : cv::COLOR_BGRA2GRAY);
+        }
+        std::vector<int> expectedFrame(4 * levels, 0);
+        std::vector<int> expectedIntensity(256, 0);
+        cv::Mat scalarGray(frame.size(), CV_8UC1);
+        HistogramKernels::accumulateFrame(frame, scalarGray, 0, frame.rows, levels, expectedFrame.data(),
+                                          expectedIntensity.data(), KernelIsa::Scalar);
+
+        std::vector<int> actualFrame(4 * levels, 0);
+        std::vector<int> actualIntensity(256, 0);
+        cv::Mat frameGray(frame.size(), CV_8UC1);
+        for (size_t s = 0; s + 1 < sizeof(kStripes) / sizeof(kStripes[0]); s++) {
+            HistogramKernels::accumulateFrame(frame, frameGray, kStripes[s], kStripes[s + 1], levels,
+                                              actualFrame.data(), actualIntensity.data(), isa);
+        }
+        const cv::Mat& written = frame.channels() == 1 ? frame : frameGray;
+        TEST_CHECK(actualFrame == expectedFrame && actualIntensity == expectedIntensity &&
+                   expectedFrame == expected && cv::norm(written, expectedGray, cv::NORM_INF) == 0,
+                   describe(isa, frame.cols, levels) << ": accumulateFrame, " << frame.channels() << " channels");
+    }
+
+    const size_t offsetSize = 4 * static_cast<size_t>(kDistances) * levels;
+    std::vector<int> expectedOffsets(offsetSize, 0);
+    HistogramKernels::accumulateOffsets(gray, 0, gray.rows, kDistances, levels, expectedOffsets.data(),
+                                        KernelIsa::Scalar);
+    std::vector<int> actualOffsets(offsetSize, 0);
+    for (size_t s = 0; s + 1 < sizeof(kStripes) / sizeof(kStripes[0]); s++) {
+        HistogramKernels::accumulateOffsets(gray, kStripes[s], kStripes[s + 1], kDistances, levels,
+                                            actualOffsets.data(), isa);
+    }
+    TEST_CHECK(actualOffsets == expectedOffsets, describe(isa, gray.cols, levels) << ": accumulateOffsets");
+}
+
+void checkKernels() {
+    std::mt19937 random(20241017);
+    for (KernelIsa isa : availableIsas()) {
+        for (int width : kWidths) {
+            for (bool runs : {false, true}) {
+                const cv::Mat gray = makeImage(kRows, width, CV_8UC1, random, runs);
+                const cv::Mat color = makeImage(kRows, width, width % 2 ? CV_8UC3 : CV_8UC4, random, runs);
+                for (int levels : kLevels) {
+                    checkRowKernels(isa, gray, levels);
+                    checkSweeps(isa, gray, color, levels);
+                }
+            }
+        }
+    }
+}
+
+// Весь анализ через выбранный setIsa: IDM и признаки совпадают со скалярными
+void checkSelectedIsa(const cv::Mat& gray, const std::string& name) {
+    const KernelIsa detected = HistogramKernels::detectIsa();
+    AnalysisWorkspace workspace;
+    for (int levels : kLevels) {
+        HistogramKernels::setIsa(KernelIsa::Scalar);
+        const double expectedIDM = TextureAnalyzer::multiDirectionalIDM(gray, levels, workspace);
+        const HaralickFeatures expected = TextureAnalyzer::computeFeatures(gray, 1, -1, levels, FeatureAll, workspace);
+        for (KernelIsa isa : availableIsas()) {
+            HistogramKernels::setIsa(isa);
+            const double idm = TextureAnalyzer::multiDirectionalIDM(gray, levels, workspace);
+            const HaralickFeatures features = TextureAnalyzer::computeFeatures(gray, 1, -1, levels, FeatureAll,
+                                                                               workspace);
+            TEST_CHECK(idm == expectedIDM && features.energy == expected.energy &&
+                       features.contrast == expected.contrast && features.correlation == expected.correlation,
+                       name << " " << describe(isa, gray.cols, levels) << ": IDM " << idm << ", scalar "
+                            << expectedIDM);
+        }
+    }
+    HistogramKernels::setIsa(detected);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    return TestSupport::run(argc, argv, [](const std::string& directory) {
+        std::cout << "Kernels checked against scalar:";
+        for (KernelIsa isa : availableIsas()) {
+            std::cout << " " << HistogramKernels::isaName(isa);
+        }
+        std::cout << std::endl;
+
+        checkKernels();
+        TestSupport::forEachImage(directory, cv::IMREAD_GRAYSCALE, checkSelectedIsa);
+    });
+}
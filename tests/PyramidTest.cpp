@@ -0,0 +1,75 @@
+#include "TestSupport.h"
+#include "TextureAnalyzer.h"
+#include "AnalysisWorkspace.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <string>
+
+// Пирамида текстуры против отдельной гистограммы разностей на каждое смещение:
+// analyzePyramid должен давать в точности calculateIDM после buildDifferenceHistogram
+// для всех расстояний, направлений и уровней. Размеры нечётные, с пулом и без
+
+namespace {
+
+const int kDistances = 5;
+const int kScales = 4;
+const int kLevels[] = {256, 32};
+
+void check(const cv::Mat& image, const std::string& name, ThreadPool* pool) {
+    for (int levels : kLevels) {
+        AnalysisWorkspace workspace;
+        TexturePyramid pyramid = TextureAnalyzer::analyzePyramid(image, levels, kDistances, kScales,
+                                                                 workspace, pool);
+
+        // Уровни строятся так же, как в analyzePyramid: pyrDown до ((rows + 1) / 2, (cols + 1) / 2)
+        cv::Mat level = image;
+        int scales = 0;
+        TextureAnalyzer analyzer(levels);
+        while (scales < kScales && std::min(level.rows, level.cols) > kDistances) {
+            for (int d = 1; d <= kDistances; d++) {
+                const int offsets[4][2] = {{d, 0}, {0, d}, {d, d}, {d, -d}};
+                for (int direction = 0; direction < 4; direction++) {
+                    analyzer.buildDifferenceHistogram(level, offsets[direction][0], offsets[direction][1]);
+                    const double expected = analyzer.calculateIDM();
+                    const bool present = scales < pyramid.scales;
+                    TEST_CHECK(present && pyramid.at(scales, d, direction) == expected,
+                               name << (pool ? " (pool)" : "") << " levels " << levels << " scale " << scales
+                                    << " distance " << d << " direction " << direction << ": pyramid "
+                                    << (present ? pyramid.at(scales, d, direction) : -1.0)
+                                    << ", per offset " << expected);
+                }
+            }
+            scales++;
+            cv::Mat next;
+            cv::pyrDown(level, next, cv::Size((level.cols + 1) / 2, (level.rows + 1) / 2));
+            level = next;
+        }
+
+        TEST_CHECK(pyramid.scales == scales && pyramid.distances == kDistances,
+                   name << " levels " << levels << ": pyramid has " << pyramid.scales << " scales, expected "
+                        << scales);
+    }
+}
+
+void checkAll(const std::string& directory, ThreadPool* pool) {
+    TestSupport::forEachImage(directory, cv::IMREAD_GRAYSCALE, [pool](const cv::Mat& gray, const std::string& name) {
+        // Нечётные стороны
+        cv::Mat odd = gray(cv::Rect(0, 0, gray.cols - (1 - gray.cols % 2), gray.rows - (1 - gray.rows % 2)));
+        check(odd, name, pool);
+    });
+
+    // Достаточно строк, чтобы проход шёл несколькими полосами
+    cv::Mat noise(389, 517, CV_8UC1);
+    cv::randu(noise, 0, 255);
+    check(noise, "noise 517x389", pool);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    return TestSupport::run(argc, argv, [](const std::string& directory) {
+        checkAll(directory, nullptr);
+        ThreadPool pool(4);
+        checkAll(directory, &pool);
+    });
+}
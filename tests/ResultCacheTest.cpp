@@ -0,0 +1,280 @@
+#include "TestSupport.h"
+#include "ResultCache.h"
+#include "ImageAnalysisCore.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <string>
+#include <vector>
+
+// Кэш результатов: запись и чтение того же результата, отбрасывание обрезанной
+// и испорченной записи, смена ключа при смене любого параметра из cacheParameters
+// и вытеснение давно не читанных записей при превышении maxBytes
+
+namespace {
+
+AnalysisResults sampleResults() {
+    AnalysisResults results{};
+    results.image_path = "original.png";
+    results.idm_value = 0.625;
+    results.texture_interpretation = "Moderately homogeneous texture";
+    results.size_interpretation = "Medium object";
+    DiameterResult& d = results.diameter_result;
+    d.maxDiameter = 141.5;
+    d.point1 = cv::Point2f(3.0f, 4.5f);
+    d.point2 = cv::Point2f(103.0f, 104.5f);
+    d.area = 7854.0;
+    d.perimeter = 314.25;
+    d.contourPoints = 412;
+    d.circularity = 0.97;
+    d.relativeError = 0.0012;
+    for (int label = 1; label <= 2; label++) {
+        DiameterResult object = d;
+        object.label = label;
+        object.maxDiameter = 10.0 * label;
+        object.area = 50.0 * label;
+        results.objects.push_back(object);
+    }
+    results.texture_pyramid.distances = 2;
+    results.texture_pyramid.scales = 1;
+    for (int i = 0; i < 8; i++) {
+        results.texture_pyramid.idm.push_back(0.1 * i);
+    }
+    return results;
+}
+
+bool sameDiameter(const DiameterResult& a, const DiameterResult& b) {
+    return a.maxDiameter == b.maxDiameter && a.point1 == b.point1 && a.point2 == b.point2 &&
+           a.area == b.area && a.perimeter == b.perimeter && a.contourPoints == b.contourPoints &&
+           a.circularity == b.circularity && a.relativeError == b.relativeError;
+}
+
+bool sameResults(const AnalysisResults& a, const AnalysisResults& b) {
+    if (a.idm_value != b.idm_value || !sameDiameter(a.diameter_result, b.diameter_result) ||
+        a.texture_interpretation != b.texture_interpretation || a.size_interpretation != b.size_interpretation ||
+        a.objects.size() != b.objects.size() || a.texture_pyramid.distances != b.texture_pyramid.distances ||
+        a.texture_pyramid.scales != b.texture_pyramid.scales || a.texture_pyramid.idm != b.texture_pyramid.idm) {
+        return false;
+    }
+    for (size_t i = 0; i < a.objects.size(); i++) {
+        if (a.objects[i].label != b.objects[i].label || !sameDiameter(a.objects[i], b.objects[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string entryPath(const TestSupport::TemporaryDirectory& directory, const std::string& key) {
+    return directory.file(key + ".iac");
+}
+
+// Ключи без файла изображения: lookup требует только 32 символа
+std::string syntheticKey(int index) {
+    char text[33];
+    std::snprintf(text, sizeof(text), "%032x", index);
+    return text;
+}
+
+void checkRoundTrip(const std::string& image) {
+    TestSupport::TemporaryDirectory directory("ResultCacheTest");
+    ResultCache cache(directory.path().string(), 0);
+    TEST_CHECK(cache.isOpen(), "cache directory not opened");
+
+    const std::string key = ResultCache::makeKey(image, "levels=256");
+    TEST_CHECK(key.size() == 32, "key of " << image << ": '" << key << "'");
+    TEST_CHECK(ResultCache::makeKey("/nonexistent/image.png", "levels=256").empty(),
+               "key of a missing file is not empty");
+
+    AnalysisResults missing{};
+    TEST_CHECK(!cache.lookup(key, image, missing), "lookup before store hit");
+
+    const AnalysisResults stored = sampleResults();
+    cache.store(key, stored);
+    AnalysisResults loaded{};
+    TEST_CHECK(cache.lookup(key, "renamed.png", loaded) && sameResults(loaded, stored) &&
+               loaded.image_path == "renamed.png",
+               "round trip: IDM " << loaded.idm_value << ", diameter " << loaded.diameter_result.maxDiameter
+                                  << ", objects " << loaded.objects.size() << ", path " << loaded.image_path);
+
+    // Другой ключ той же длины не должен читать чужую запись
+    AnalysisResults other{};
+    TEST_CHECK(!cache.lookup(syntheticKey(7), image, other), "lookup of an unrelated key hit");
+
+    const CacheStats stats = cache.stats();
+    TEST_CHECK(stats.hits == 1 && stats.misses == 2 && stats.stores == 1,
+               "stats: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.stores << " stores");
+}
+
+void checkCorruptEntries(const std::string& image) {
+    TestSupport::TemporaryDirectory directory("ResultCacheTest");
+    ResultCache cache(directory.path().string(), 0);
+    const std::string key = ResultCache::makeKey(image, "levels=256");
+    const std::string path = entryPath(directory, key);
+    const AnalysisResults stored = sampleResults();
+
+    // Обрезанная запись, запись с изменённым байтом в середине и с лишним хвостом
+    for (int damage = 0; damage < 3; damage++) {
+        cache.store(key, stored);
+        const uintmax_t size = std::filesystem::file_size(path);
+        if (damage == 0) {
+            std::filesystem::resize_file(path, size / 2);
+        } else if (damage == 1) {
+            std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+            file.seekg(static_cast<std::streamoff>(size / 2));
+            char byte = 0;
+            file.read(&byte, 1);
+            byte = static_cast<char>(byte ^ 0x5a);
+            file.seekp(static_cast<std::streamoff>(size / 2));
+            file.write(&byte, 1);
+        } else {
+            std::ofstream file(path, std::ios::binary | std::ios::app);
+            file << "tail";
+        }
+
+        AnalysisResults loaded{};
+        TEST_CHECK(!cache.lookup(key, image, loaded), "damaged entry " << damage << " was returned");
+        TEST_CHECK(!std::filesystem::exists(path), "damaged entry " << damage << " was not removed");
+    }
+
+    // После отбрасывания ключ снова пригоден
+    cache.store(key, stored);
+    AnalysisResults loaded{};
+    TEST_CHECK(cache.lookup(key, image, loaded) && sameResults(loaded, stored), "store after corrupt entry");
+}
+
+void checkKeys(const std::string& image, const std::string& otherImage) {
+    TestSupport::TemporaryDirectory directory("ResultCacheTest");
+    ResultCache cache(directory.path().string(), 0);
+
+    AnalysisOptions base;
+    base.cache = &cache;
+    const std::string baseKey = ImageAnalysisCore::cacheKey(image, base);
+    TEST_CHECK(baseKey.size() == 32 && ImageAnalysisCore::cacheKey(image, base) == baseKey,
+               "key is not stable: " << baseKey);
+    TEST_CHECK(ImageAnalysisCore::cacheKey(otherImage, base) != baseKey, "different files share a key");
+
+    AnalysisOptions noCache = base;
+    noCache.cache = nullptr;
+    TEST_CHECK(ImageAnalysisCore::cacheKey(image, noCache).empty(), "key without a cache");
+
+    // Точные режимы диаметра дают одинаковый результат и прежний ключ
+    AnalysisOptions exact = base;
+    exact.diameterMode = DiameterMode::BruteForce;
+    TEST_CHECK(ImageAnalysisCore::cacheKey(image, exact) == baseKey, "exact diameter mode changed the key");
+
+    struct Variant {
+        const char* name;
+        AnalysisOptions options;
+    };
+    std::vector<Variant> variants;
+    auto add = [&](const char* name, void (*change)(AnalysisOptions&)) {
+        AnalysisOptions options = base;
+        change(options);
+        variants.push_back({name, options});
+    };
+    add("levels", [](AnalysisOptions& o) { o.levels = 64; });
+    add("analysisSize", [](AnalysisOptions& o) { o.analysisSize = 256; });
+    add("tileSize", [](AnalysisOptions& o) { o.tileSize = 128; });
+    add("allObjects", [](AnalysisOptions& o) { o.allObjects = true; });
+    add("minObjectPixels", [](AnalysisOptions& o) { o.allObjects = true; o.minObjectPixels = 20; });
+    add("rawFrameSize", [](AnalysisOptions& o) { o.rawFrameSize = cv::Size(640, 480); });
+    add("diameterMode", [](AnalysisOptions& o) { o.diameterMode = DiameterMode::Approximate; });
+    add("diameterDirections", [](AnalysisOptions& o) {
+        o.diameterMode = DiameterMode::Approximate;
+        o.diameterDirections = 8;
+    });
+    add("textureDistances", [](AnalysisOptions& o) { o.textureDistances = 3; });
+    add("textureScales", [](AnalysisOptions& o) { o.textureScales = 2; });
+    add("textureBaseSize", [](AnalysisOptions& o) {
+        o.textureScales = 2;
+        o.textureBaseSize = 1024;
+    });
+
+    std::set<std::string> keys = {baseKey};
+    for (const Variant& variant : variants) {
+        const std::string key = ImageAnalysisCore::cacheKey(image, variant.options);
+        TEST_CHECK(key.size() == 32 && keys.insert(key).second,
+                   "changing " << variant.name << " gave an already used key " << key);
+    }
+}
+
+void checkEviction() {
+    TestSupport::TemporaryDirectory directory("ResultCacheTest");
+    const AnalysisResults stored = sampleResults();
+
+    // Размер одной записи: все записи одного результата одинаковы
+    uintmax_t entrySize;
+    {
+        ResultCache probe(directory.path().string(), 0);
+        probe.store(syntheticKey(1000), stored);
+        entrySize = std::filesystem::file_size(entryPath(directory, syntheticKey(1000)));
+        std::filesystem::remove(entryPath(directory, syntheticKey(1000)));
+    }
+
+    // Четыре с половиной записи: после пятой остаётся не больше 90%, то есть четыре
+    const uint64_t maxBytes = entrySize * 9 / 2;
+    ResultCache cache(directory.path().string(), maxBytes);
+    const int entries = 12;
+    // Время последнего чтения задаётся явно, чтобы порядок не зависел от точности часов ФС
+    const auto start = std::filesystem::file_time_type::clock::now() - std::chrono::hours(1);
+    for (int i = 0; i < entries; i++) {
+        cache.store(syntheticKey(i), stored);
+        std::error_code error;
+        std::filesystem::last_write_time(entryPath(directory, syntheticKey(i)), start + std::chrono::seconds(i),
+                                         error);
+    }
+
+    uint64_t used = 0;
+    int kept = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(directory.path())) {
+        used += entry.file_size();
+        kept++;
+    }
+    const CacheStats stats = cache.stats();
+    TEST_CHECK(used <= maxBytes && stats.evictions > 0 && kept + static_cast<int>(stats.evictions) == entries,
+               "eviction: " << used << " of " << maxBytes << " bytes in " << kept << " entries, "
+                            << stats.evictions << " evicted");
+
+    AnalysisResults loaded{};
+    TEST_CHECK(cache.lookup(syntheticKey(entries - 1), "newest.png", loaded) && sameResults(loaded, stored),
+               "newest entry was evicted");
+    TEST_CHECK(!std::filesystem::exists(entryPath(directory, syntheticKey(0))), "oldest entry survived");
+
+    // Прочитанная запись становится самой свежей и переживает следующую очистку
+    const int survivor = entries - kept;
+    TEST_CHECK(cache.lookup(syntheticKey(survivor), "survivor.png", loaded), "oldest kept entry missing");
+    for (int i = entries; i < entries + kept - 1; i++) {
+        cache.store(syntheticKey(i), stored);
+        std::error_code error;
+        std::filesystem::last_write_time(entryPath(directory, syntheticKey(i)), start + std::chrono::seconds(i),
+                                         error);
+    }
+    TEST_CHECK(std::filesystem::exists(entryPath(directory, syntheticKey(survivor))),
+               "entry read before eviction was evicted");
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    return TestSupport::run(argc, argv, [](const std::string& directory) {
+        std::vector<std::string> images;
+        for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+            if (entry.path().extension() == ".png") {
+                images.push_back(entry.path().string());
+            }
+        }
+        if (images.size() < 2) {
+            TestSupport::fail("need two images in " + directory);
+            return;
+        }
+        std::sort(images.begin(), images.end());
+
+        checkRoundTrip(images[0]);
+        checkCorruptEntries(images[0]);
+        checkKeys(images[0], images[1]);
+        checkEviction();
+    });
+}
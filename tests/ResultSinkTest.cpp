@@ -0,0 +1,228 @@
+#include "TestSupport.h"
+#include "ResultSink.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Двоичный приёмник результатов: запись, повторное открытие с дописыванием и отказ
+// открывать чужой файл. Файл разбирается здесь же по описанию формата в ResultSink.h:
+// FileHeader, затем блоки - BlockHeader, столбцы, длины путей, пути, выравнивание на 8 байт
+
+namespace {
+
+struct Record {
+    std::string path;
+    double idm;
+    double maxDiameter;
+    double area;
+    double perimeter;
+    double circularity;
+    float point1X;
+    float point1Y;
+    float point2X;
+    float point2Y;
+    int32_t contourPoints;
+};
+
+struct ParsedFile {
+    bool valid = false;
+    BinarySink::FileHeader header{};
+    std::vector<Record> records;
+};
+
+std::string readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+template <typename T>
+bool readColumn(const std::string& data, size_t& offset, uint32_t count, std::vector<T>& column) {
+    if (offset + static_cast<size_t>(count) * sizeof(T) > data.size()) {
+        return false;
+    }
+    column.resize(count);
+    std::memcpy(column.data(), data.data() + offset, static_cast<size_t>(count) * sizeof(T));
+    offset += static_cast<size_t>(count) * sizeof(T);
+    return true;
+}
+
+ParsedFile parse(const std::string& path) {
+    ParsedFile parsed;
+    const std::string data = readFile(path);
+    if (data.size() < sizeof(parsed.header)) {
+        return parsed;
+    }
+    std::memcpy(&parsed.header, data.data(), sizeof(parsed.header));
+    size_t offset = sizeof(parsed.header);
+
+    for (uint64_t block = 0; block < parsed.header.blockCount; block++) {
+        BinarySink::BlockHeader blockHeader;
+        if (offset + sizeof(blockHeader) > data.size()) {
+            return parsed;
+        }
+        const size_t start = offset;
+        std::memcpy(&blockHeader, data.data() + offset, sizeof(blockHeader));
+        offset += sizeof(blockHeader);
+        const uint32_t count = blockHeader.recordCount;
+
+        std::vector<double> idm, maxDiameter, area, perimeter, circularity;
+        std::vector<float> point1X, point1Y, point2X, point2Y;
+        std::vector<int32_t> contourPoints;
+        std::vector<uint32_t> pathLengths;
+        if (!readColumn(data, offset, count, idm) || !readColumn(data, offset, count, maxDiameter) ||
+            !readColumn(data, offset, count, area) || !readColumn(data, offset, count, perimeter) ||
+            !readColumn(data, offset, count, circularity) || !readColumn(data, offset, count, point1X) ||
+            !readColumn(data, offset, count, point1Y) || !readColumn(data, offset, count, point2X) ||
+            !readColumn(data, offset, count, point2Y) || !readColumn(data, offset, count, contourPoints) ||
+            !readColumn(data, offset, count, pathLengths) || offset + blockHeader.pathBytes > data.size()) {
+            return parsed;
+        }
+
+        size_t pathOffset = offset;
+        for (uint32_t i = 0; i < count; i++) {
+            Record record;
+            record.path = data.substr(pathOffset, pathLengths[i]);
+            pathOffset += pathLengths[i];
+            record.idm = idm[i];
+            record.maxDiameter = maxDiameter[i];
+            record.area = area[i];
+            record.perimeter = perimeter[i];
+            record.circularity = circularity[i];
+            record.point1X = point1X[i];
+            record.point1Y = point1Y[i];
+            record.point2X = point2X[i];
+            record.point2Y = point2Y[i];
+            record.contourPoints = contourPoints[i];
+            parsed.records.push_back(record);
+        }
+        offset += blockHeader.pathBytes;
+        offset += (8 - (offset - start) % 8) % 8;
+    }
+
+    parsed.valid = offset == data.size() && parsed.header.recordCount == parsed.records.size();
+    return parsed;
+}
+
+AnalysisResults sample(int index) {
+    AnalysisResults results{};
+    // Пути разной длины, чтобы выравнивание блока менялось
+    results.image_path = "images/frame_" + std::string(static_cast<size_t>(index % 5), 'x') +
+                         std::to_string(index) + ".png";
+    results.idm_value = 0.01 * index;
+    results.diameter_result.maxDiameter = 10.5 + index;
+    results.diameter_result.area = 100.0 * index;
+    results.diameter_result.perimeter = 40.25 + index;
+    results.diameter_result.circularity = 1.0 / (1 + index);
+    results.diameter_result.point1 = cv::Point2f(static_cast<float>(index), 2.5f);
+    results.diameter_result.point2 = cv::Point2f(3.5f, static_cast<float>(-index));
+    results.diameter_result.contourPoints = 7 * index;
+    return results;
+}
+
+bool matches(const Record& record, const AnalysisResults& results) {
+    const DiameterResult& d = results.diameter_result;
+    return record.path == results.image_path && record.idm == results.idm_value &&
+           record.maxDiameter == d.maxDiameter && record.area == d.area && record.perimeter == d.perimeter &&
+           record.circularity == d.circularity && record.point1X == d.point1.x && record.point1Y == d.point1.y &&
+           record.point2X == d.point2.x && record.point2Y == d.point2.y && record.contourPoints == d.contourPoints;
+}
+
+// Файл содержит ровно sample(0) .. sample(count - 1) в blocks блоках
+void checkFile(const std::string& path, int count, uint64_t blocks, const std::string& stage) {
+    const ParsedFile parsed = parse(path);
+    TEST_CHECK(parsed.valid && parsed.header.magic == BinarySink::kMagic &&
+               parsed.header.version == BinarySink::kVersion && parsed.header.recordCount == static_cast<uint64_t>(count) &&
+               parsed.header.blockCount == blocks,
+               stage << ": header " << parsed.header.recordCount << " records in " << parsed.header.blockCount
+                     << " blocks, parsed " << parsed.records.size() << (parsed.valid ? "" : " (malformed)"));
+    for (size_t i = 0; i < parsed.records.size() && i < static_cast<size_t>(count); i++) {
+        TEST_CHECK(matches(parsed.records[i], sample(static_cast<int>(i))),
+                   stage << ": record " << i << " is " << parsed.records[i].path);
+    }
+}
+
+void checkWriteAndAppend(const TestSupport::TemporaryDirectory& directory) {
+    const std::string path = directory.file("results.bin");
+    {
+        BinarySink sink(path);
+        TEST_CHECK(sink.isOpen(), "new binary file not opened");
+        for (int i = 0; i < 3; i++) {
+            sink.write(sample(i));
+        }
+        sink.flush();
+        checkFile(path, 3, 1, "first flush");
+
+        // Второй пакет того же приёмника - отдельный блок, заголовок обновлён
+        for (int i = 3; i < 5; i++) {
+            sink.write(sample(i));
+        }
+        sink.flush();
+        checkFile(path, 5, 2, "second flush");
+        TEST_CHECK(sink.recordsWritten() == 5, "recordsWritten " << sink.recordsWritten());
+    }
+
+    // Повторное открытие дописывает; несброшенный пакет пишет деструктор
+    {
+        BinarySink sink(path);
+        TEST_CHECK(sink.isOpen(), "existing binary file not reopened");
+        for (int i = 5; i < 9; i++) {
+            sink.write(sample(i));
+        }
+    }
+    checkFile(path, 9, 3, "reopen and append");
+
+    // Приёмник без записей не добавляет пустой блок
+    {
+        BinarySink sink(path);
+        sink.flush();
+    }
+    checkFile(path, 9, 3, "reopen without records");
+
+    // Пустой существующий файл начинается заново
+    const std::string emptyPath = directory.file("empty.bin");
+    { std::ofstream create(emptyPath, std::ios::binary); }
+    {
+        BinarySink sink(emptyPath);
+        TEST_CHECK(sink.isOpen(), "empty file not opened");
+        sink.write(sample(0));
+    }
+    checkFile(emptyPath, 1, 1, "empty file");
+}
+
+void checkForeignFile(const TestSupport::TemporaryDirectory& directory, const std::string& name,
+                      const std::string& content) {
+    const std::string path = directory.file(name);
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << content;
+    }
+    {
+        BinarySink sink(path);
+        TEST_CHECK(!sink.isOpen(), name << ": foreign file opened");
+        sink.write(sample(0));
+        sink.flush();
+    }
+    TEST_CHECK(readFile(path) == content, name << ": foreign file was modified");
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    return TestSupport::run(argc, argv, [](const std::string&) {
+        TestSupport::TemporaryDirectory directory("ResultSinkTest");
+        checkWriteAndAppend(directory);
+
+        checkForeignFile(directory, "results.csv",
+                         "image_path,idm,idm_interpretation,max_diameter\nimage.png,0.5,Texture,10\n");
+        // Свой формат другой версии тоже не трогается
+        BinarySink::FileHeader header{};
+        header.magic = BinarySink::kMagic;
+        header.version = BinarySink::kVersion + 1;
+        checkForeignFile(directory, "future.bin",
+                         std::string(reinterpret_cast<const char*>(&header), sizeof(header)));
+        // Обрывок короче заголовка
+        checkForeignFile(directory, "short.bin", "IAR");
+    });
+}
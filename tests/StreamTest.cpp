@@ -0,0 +1,87 @@
+#include "TestSupport.h"
+#include "StreamAnalyzer.h"
+#include "ImageAnalysisCore.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <random>
+#include <string>
+
+// Потоковый режим при tolerance = 0: на каждом кадре IDM и диаметр должны совпадать
+// с ImageAnalysisCore::analyzeImage для того же кадра. Кадры получаются из изображений
+// test_images/ и шума локальными изменениями, в том числе в нижних строках тайлов,
+// куда смотрят пары (1,-1) тайла снизу
+
+namespace {
+
+const int kTileSize = 16;
+const int kFrames = 24;
+
+// Несколько прямоугольников и отдельных пикселей на границах тайлов
+void changeFrame(cv::Mat& frame, std::mt19937& random) {
+    std::uniform_int_distribution<int> value(0, 255);
+    std::uniform_int_distribution<int> count(1, 4);
+    std::uniform_int_distribution<int> side(1, 6);
+    std::uniform_int_distribution<int> column(0, frame.cols - 1);
+    std::uniform_int_distribution<int> row(0, frame.rows - 1);
+
+    const int rectangles = count(random);
+    for (int i = 0; i < rectangles; i++) {
+        cv::Rect rect(column(random), row(random), side(random), side(random));
+        frame(rect & cv::Rect(0, 0, frame.cols, frame.rows)).setTo(value(random));
+    }
+
+    std::uniform_int_distribution<int> tileRow(1, frame.rows / kTileSize);
+    const int pixels = count(random);
+    for (int i = 0; i < pixels; i++) {
+        const int y = std::min(frame.rows - 1, tileRow(random) * kTileSize - 1);
+        frame.at<uchar>(y, column(random)) = static_cast<uchar>(value(random));
+    }
+}
+
+void checkSequence(const cv::Mat& first, const std::string& name, ThreadPool* pool) {
+    StreamOptions options;
+    options.tileSize = kTileSize;
+    options.tolerance = 0;
+    options.analysis.analysisSize = 0;
+    StreamAnalyzer stream(options);
+
+    std::mt19937 random(20241017);
+    cv::Mat frame = first.clone();
+    for (int index = 0; index < kFrames; index++) {
+        if (index > 0) {
+            changeFrame(frame, random);
+        }
+
+        AnalysisResults streamed;
+        AnalysisResults expected;
+        const bool streamOk = stream.process(frame, streamed, pool);
+        const bool expectedOk = ImageAnalysisCore::analyzeImage(frame, options.analysis, expected);
+        TEST_CHECK(streamOk == expectedOk && streamed.idm_value == expected.idm_value &&
+                   streamed.diameter_result.maxDiameter == expected.diameter_result.maxDiameter &&
+                   streamed.diameter_result.area == expected.diameter_result.area,
+                   name << (pool ? " (pool)" : "") << " frame " << index << ": stream IDM " << streamed.idm_value
+                        << ", diameter " << streamed.diameter_result.maxDiameter << "; analyzeImage IDM "
+                        << expected.idm_value << ", diameter " << expected.diameter_result.maxDiameter);
+    }
+}
+
+void checkAll(const std::string& directory, ThreadPool* pool) {
+    TestSupport::forEachImage(directory, cv::IMREAD_GRAYSCALE, [pool](const cv::Mat& gray, const std::string& name) {
+        checkSequence(gray, name, pool);
+    });
+
+    // Размер не кратен тайлу ни по одной стороне
+    cv::Mat noise(157, 203, CV_8UC1);
+    cv::randu(noise, 0, 255);
+    checkSequence(noise, "noise 203x157", pool);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    return TestSupport::run(argc, argv, [](const std::string& directory) {
+        checkAll(directory, nullptr);
+        ThreadPool pool(4);
+        checkAll(directory, &pool);
+    });
+}
@@ -0,0 +1,89 @@
+#include "TestSupport.h"
+#include "TextureAnalyzer.h"
+#include "MorphologyAnalyzer.h"
+#include "AnalysisWorkspace.h"
+#include "ThreadPool.h"
+#include <string>
+#include <vector>
+
+// Совмещённый проход sweepFrame против отдельных шагов: серый кадр совпадает с cv::cvtColor,
+// IDM - с multiDirectionalIDM по нему, порог otsuThreshold по гистограмме яркости прохода -
+// с cv::threshold(THRESH_OTSU). Отдельно otsuThreshold по гистограмме серого изображения
+// сравнивается с cv::threshold на test_images/
+
+namespace {
+
+const int kLevels[] = {256, 64, 8};
+
+void checkFrame(const cv::Mat& frame, const std::string& name, ThreadPool* pool) {
+    cv::Mat expectedGray;
+    if (frame.channels() == 1) {
+        expectedGray = frame;
+    } else {
+        cv::cvtColor(frame, expectedGray, frame.channels() == 3 ? cv::COLOR_BGR2GRAY : cv::COLOR_BGRA2GRAY);
+    }
+    cv::Mat binary;
+    const int expectedThreshold = static_cast<int>(
+        cv::threshold(expectedGray, binary, 0, 255, cv::THRESH_BINARY + cv::THRESH_OTSU));
+
+    for (int levels : kLevels) {
+        AnalysisWorkspace reference;
+        const double expectedIDM = TextureAnalyzer::multiDirectionalIDM(expectedGray, levels, reference);
+
+        AnalysisWorkspace workspace;
+        cv::Mat gray;
+        const double idm = TextureAnalyzer::sweepFrame(frame, levels, workspace, gray, pool);
+        const int threshold = MorphologyAnalyzer::otsuThreshold(workspace.intensity);
+
+        TEST_CHECK(gray.size() == expectedGray.size() && cv::norm(gray, expectedGray, cv::NORM_INF) == 0 &&
+                   idm == expectedIDM && threshold == expectedThreshold,
+                   name << " (" << frame.channels() << " channels" << (pool ? ", pool" : "") << ") levels "
+                        << levels << ": sweep IDM " << idm << ", threshold " << threshold << "; separate IDM "
+                        << expectedIDM << ", threshold " << expectedThreshold);
+    }
+}
+
+void checkOtsu(const cv::Mat& gray, const std::string& name) {
+    std::vector<int64_t> histogram(256, 0);
+    for (int y = 0; y < gray.rows; y++) {
+        const uchar* row = gray.ptr<uchar>(y);
+        for (int x = 0; x < gray.cols; x++) {
+            histogram[row[x]]++;
+        }
+    }
+    cv::Mat binary;
+    const int expected = static_cast<int>(cv::threshold(gray, binary, 0, 255, cv::THRESH_BINARY + cv::THRESH_OTSU));
+    const int threshold = MorphologyAnalyzer::otsuThreshold(histogram);
+    TEST_CHECK(threshold == expected, name << ": otsuThreshold " << threshold << ", cv::threshold " << expected);
+}
+
+void checkAll(const cv::Mat& color, const std::string& name, ThreadPool* pool) {
+    cv::Mat gray;
+    cv::Mat bgra;
+    cv::cvtColor(color, gray, cv::COLOR_BGR2GRAY);
+    cv::cvtColor(color, bgra, cv::COLOR_BGR2BGRA);
+    if (!pool) {
+        checkOtsu(gray, name);
+    }
+    checkFrame(gray, name, pool);
+    checkFrame(color, name, pool);
+    checkFrame(bgra, name, pool);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    return TestSupport::run(argc, argv, [](const std::string& directory) {
+        ThreadPool pool(4);
+        TestSupport::forEachImage(directory, cv::IMREAD_COLOR, [&pool](const cv::Mat& color, const std::string& name) {
+            checkAll(color, name, nullptr);
+            checkAll(color, name, &pool);
+        });
+
+        // Цветной шум нечётного размера, достаточно строк для нескольких полос
+        cv::Mat noise(389, 517, CV_8UC3);
+        cv::randu(noise, cv::Scalar::all(0), cv::Scalar::all(256));
+        checkAll(noise, "noise 517x389", nullptr);
+        checkAll(noise, "noise 517x389", &pool);
+    });
+}
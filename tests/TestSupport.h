@@ -0,0 +1,89 @@
+#pragma once
+
+#include "Logger.h"
+#include <opencv2/opencv.hpp>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <string>
+
+// Общая обвязка тестов ctest: счётчик проверок и провалов, обход test_images/
+// и итоговая строка. Каждый тест - исполняемый файл, main которого зовёт TestSupport::run
+
+namespace TestSupport {
+
+inline int& failures() {
+    static int count = 0;
+    return count;
+}
+
+inline int& checks() {
+    static int count = 0;
+    return count;
+}
+
+inline void fail(const std::string& message) {
+    failures()++;
+    std::cerr << "FAIL " << message << std::endl;
+}
+
+// Изображения каталога, прочитанные с flags; пустой каталог - провал
+inline void forEachImage(const std::string& directory, int flags,
+                         const std::function<void(const cv::Mat& image, const std::string& name)>& fn) {
+    int images = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        cv::Mat image = cv::imread(entry.path().string(), flags);
+        if (image.empty()) {
+            continue;
+        }
+        images++;
+        fn(image, entry.path().filename().string());
+    }
+    if (images == 0) {
+        fail("no images in " + directory);
+    }
+}
+
+// Пустой каталог во временном каталоге системы на время теста; удаляется вместе с содержимым
+class TemporaryDirectory {
+public:
+    explicit TemporaryDirectory(const std::string& name)
+        : path_(std::filesystem::temp_directory_path() /
+                (name + "-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()))) {
+        std::filesystem::create_directories(path_);
+    }
+    ~TemporaryDirectory() {
+        std::error_code error;
+        std::filesystem::remove_all(path_, error);
+    }
+
+    TemporaryDirectory(const TemporaryDirectory&) = delete;
+    TemporaryDirectory& operator=(const TemporaryDirectory&) = delete;
+
+    const std::filesystem::path& path() const { return path_; }
+    std::string file(const std::string& name) const { return (path_ / name).string(); }
+
+private:
+    std::filesystem::path path_;
+};
+
+// Логи выключены, каталог изображений - первый аргумент (по умолчанию test_images)
+inline int run(int argc, char* argv[], const std::function<void(const std::string& directory)>& body) {
+    Logger::setLevel(LogLevel::Off);
+    body(argc > 1 ? argv[1] : "test_images");
+    std::cout << checks() << " checks, " << failures() << " failures" << std::endl;
+    return failures() == 0 ? 0 : 1;
+}
+
+}
+
+// Проверка с сообщением, которое собирается только при провале
+#define TEST_CHECK(condition, message)                              \
+    do {                                                            \
+        TestSupport::checks()++;                                    \
+        if (!(condition)) {                                         \
+            TestSupport::failures()++;                              \
+            std::cerr << "FAIL " << message << std::endl;           \
+        }                                                           \
+    } while (0)
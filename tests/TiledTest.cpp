@@ -0,0 +1,99 @@
+#include "TestSupport.h"
+#include "TiledAnalyzer.h"
+#include "TextureAnalyzer.h"
+#include "AnalysisWorkspace.h"
+#include <algorithm>
+#include <string>
+
+// Тайловый анализ против анализа всего изображения в полном разрешении: IDM по направлениям
+// совпадает с multiDirectionalIDM (каждая пара на границе тайлов посчитана ровно один раз),
+// а число объектов и площадь наибольшего - с разметкой всего изображения.
+// Стороны тайлов не делят размер изображения
+
+namespace {
+
+const int kTileSizes[] = {16, 17, 23, 64, 199};
+
+class MatTileSource : public TileSource {
+public:
+    explicit MatTileSource(const cv::Mat& image) : image_(image) {}
+
+    cv::Size size() const override { return image_.size(); }
+
+    bool read(const cv::Rect& region, cv::Mat& tile) override {
+        tile = image_(region);
+        return true;
+    }
+
+private:
+    cv::Mat image_;
+};
+
+bool analyzeTiled(const cv::Mat& image, int tileSize, TiledResults& results) {
+    TiledOptions options;
+    options.tileSize = tileSize;
+    TiledAnalyzer analyzer(options);
+    MatTileSource source(image);
+    return analyzer.analyze(source, results);
+}
+
+void checkImage(const cv::Mat& gray, const std::string& name) {
+    AnalysisWorkspace workspace;
+    const double expectedIDM = TextureAnalyzer::multiDirectionalIDM(gray, 256, workspace);
+
+    for (int tileSize : kTileSizes) {
+        TiledResults tiled;
+        if (!analyzeTiled(gray, tileSize, tiled)) {
+            TestSupport::fail(name + " tile " + std::to_string(tileSize) + ": analysis failed");
+            continue;
+        }
+        TEST_CHECK(tiled.idm == expectedIDM,
+                   name << " tile " << tileSize << ": tiled IDM " << tiled.idm << ", whole image " << expectedIDM);
+
+        // Та же разметка по тому же порогу, но без разрезания на тайлы
+        cv::Mat binary;
+        cv::threshold(gray, binary, tiled.otsuThreshold, 255, cv::THRESH_BINARY);
+        cv::Mat labels, stats, centroids;
+        const int count = cv::connectedComponentsWithStats(binary, labels, stats, centroids, 8, CV_32S);
+        int largest = 0;
+        for (int l = 1; l < count; l++) {
+            largest = std::max(largest, stats.at<int>(l, cv::CC_STAT_AREA));
+        }
+        TEST_CHECK(tiled.objectCount == count - 1 && tiled.diameter.area == largest,
+                   name << " tile " << tileSize << ": tiled " << tiled.objectCount << " objects, largest "
+                        << tiled.diameter.area << "; whole image " << count - 1 << " objects, largest " << largest);
+    }
+}
+
+// Круг с центром в углу четырёх тайлов и отдельный квадрат: два объекта,
+// наибольший - круг целиком. Диагональная линия через угол тайлов - один объект
+void checkObjectAcrossTiles() {
+    const int tileSize = 40;
+    cv::Mat circle = cv::Mat::zeros(90, 107, CV_8UC1);
+    cv::circle(circle, cv::Point(tileSize, tileSize), 15, 255, -1);
+    const int circlePixels = cv::countNonZero(circle);
+    cv::Mat image = circle.clone();
+    cv::rectangle(image, cv::Point(85, 70), cv::Point(95, 80), 255, -1);
+
+    TiledResults tiled;
+    TEST_CHECK(analyzeTiled(image, tileSize, tiled) && tiled.objectCount == 2 && tiled.diameter.area == circlePixels,
+               "circle across four tiles: " << tiled.objectCount << " objects, largest " << tiled.diameter.area
+                                            << " pixels, expected 2 objects, largest " << circlePixels);
+
+    cv::Mat line = cv::Mat::zeros(90, 107, CV_8UC1);
+    cv::line(line, cv::Point(tileSize - 10, tileSize - 10), cv::Point(tileSize + 10, tileSize + 10), 255, 1,
+             cv::LINE_8);
+    TEST_CHECK(analyzeTiled(line, tileSize, tiled) && tiled.objectCount == 1 &&
+               tiled.diameter.area == cv::countNonZero(line),
+               "diagonal line across tile corner: " << tiled.objectCount << " objects, largest "
+                                                    << tiled.diameter.area << " pixels");
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    return TestSupport::run(argc, argv, [](const std::string& directory) {
+        TestSupport::forEachImage(directory, cv::IMREAD_GRAYSCALE, checkImage);
+        checkObjectAcrossTiles();
+    });
+}